@@ -0,0 +1,44 @@
+#pragma once
+
+#include <cstdint>
+#include <limits>
+
+namespace plzerow {
+
+// PL/0 integers are 32-bit and wrap on overflow. The same helpers are used
+// by constant folding and by the VM, so a folded expression always has the
+// value the program would have computed at run time.
+
+constexpr std::int32_t wrapping_add(std::int32_t lhs, std::int32_t rhs) {
+  return static_cast<std::int32_t>(static_cast<std::uint32_t>(lhs) +
+                                   static_cast<std::uint32_t>(rhs));
+}
+
+constexpr std::int32_t wrapping_subtract(std::int32_t lhs, std::int32_t rhs) {
+  return static_cast<std::int32_t>(static_cast<std::uint32_t>(lhs) -
+                                   static_cast<std::uint32_t>(rhs));
+}
+
+constexpr std::int32_t wrapping_multiply(std::int32_t lhs, std::int32_t rhs) {
+  return static_cast<std::int32_t>(static_cast<std::uint32_t>(lhs) *
+                                   static_cast<std::uint32_t>(rhs));
+}
+
+constexpr std::int32_t wrapping_negate(std::int32_t value) {
+  return wrapping_subtract(0, value);
+}
+
+// the caller rules out rhs == 0, which is a run-time error
+constexpr std::int32_t wrapping_divide(std::int32_t lhs, std::int32_t rhs) {
+  if (rhs == -1) {
+    return wrapping_negate(lhs);
+  }
+  return lhs / rhs;
+}
+
+static_assert(wrapping_add(std::numeric_limits<std::int32_t>::max(), 1) ==
+              std::numeric_limits<std::int32_t>::min());
+static_assert(wrapping_divide(std::numeric_limits<std::int32_t>::min(), -1) ==
+              std::numeric_limits<std::int32_t>::min());
+
+} // namespace plzerow
@@ -0,0 +1,50 @@
+#pragma once
+
+#include "ast_nodes.hpp"
+#include <cstdint>
+#include <span>
+#include <utility>
+#include <vector>
+
+namespace plzerow {
+
+// The node table of one compilation. Nodes, child lists and expression
+// operands are each appended to a single flat array and linked by 32-bit
+// indices, so building a tree costs a handful of amortised vector growths
+// and a walk touches memory in roughly the order it was parsed. Nothing in
+// the table owns anything, so clear() and the destructor are O(1) in the
+// number of nodes.
+class Ast {
+public:
+  template <typename T, typename... Args>
+  NodeIndex make_node(SourceLoc loc, Args &&...args);
+
+  // copies a finished child list into the pool; the caller's scratch
+  // storage can be reused as soon as this returns
+  NodeRange add_children(std::span<const NodeIndex> children);
+  ExprRange add_operands(std::span<const Operand> operands);
+
+  const ASTNode &operator[](NodeIndex node) const;
+  std::span<const NodeIndex> children(NodeRange range) const;
+  std::span<const Operand> operands(ExprRange range) const;
+
+  NodeIndex root() const;
+  void set_root(NodeIndex root);
+  std::size_t size() const;
+  void clear();
+
+private:
+  std::vector<ASTNode> _nodes;
+  std::vector<NodeIndex> _children;
+  std::vector<Operand> _operands;
+  NodeIndex _root = no_node;
+};
+
+template <typename T, typename... Args>
+NodeIndex Ast::make_node(SourceLoc loc, Args &&...args) {
+  const auto node = static_cast<NodeIndex>(_nodes.size());
+  _nodes.emplace_back(loc, T{std::forward<Args>(args)...});
+  return node;
+}
+
+} // namespace plzerow
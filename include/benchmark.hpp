@@ -0,0 +1,22 @@
+#pragma once
+
+#include <string>
+
+namespace plzerow {
+
+// Throughput of the front end on one file, run instead of compiling it.
+// The file is read once, each variant is run a few times and the best run
+// is printed, so tools/ scripts can compare variants in the same process.
+
+// tokenizes the file with the byte-at-a-time scan the kernels replaced, the
+// scalar kernels and the ones picked for this CPU, in MB/s and against the
+// first, then classifies its words with the keyword
+// perfect hash and with the std::unordered_map it replaced, in millions of
+// words a second
+void bench_lex(const std::string &filename);
+
+// parses the file from its tokens, and lexes and parses it serially, through
+// a std::function token source and pipelined, in millions of tokens a second
+void bench_parse(const std::string &filename);
+
+} // namespace plzerow
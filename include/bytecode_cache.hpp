@@ -0,0 +1,57 @@
+#pragma once
+
+#include "chunk.hpp"
+#include "compiler.hpp"
+#include <cstdint>
+#include <optional>
+#include <string>
+#include <string_view>
+
+namespace plzerow {
+
+// bumped whenever the instruction set or the file layout changes
+constexpr std::uint32_t bytecode_version = 3;
+
+/*
+ * A compiled chunk on disk:
+ *
+ *   header  code, padded to 4 bytes  debug table  constants  global names
+ *
+ * The header holds a magic number, the format version, the byte order, the
+ * key the chunk was compiled for, the size of every section and a checksum
+ * of everything after it. The code and the debug table are mapped and run in
+ * place; the constants and the names of the globals are decoded when the
+ * file is opened. A constant is its type followed by an integer as a zigzag
+ * varint, so small ones take a byte or two, or the 8 bytes of a double.
+ * Files are written in the host's byte order, so one from another machine
+ * fails the checks like a damaged one does.
+ */
+class BytecodeFile {
+public:
+  static bool write(const std::string &path, const Chunk &chunk,
+                    std::uint64_t key);
+  // nullopt if the file is missing, fails a check or has another key
+  static std::optional<Chunk> map(const std::string &path, std::uint64_t key);
+};
+
+// Compiled programs in a directory, one file per key. A key hashes the
+// source text together with the compiler version and every option that
+// changes the generated code.
+class BytecodeCache {
+public:
+  BytecodeCache(std::string directory, const CompilerOptions &options);
+
+  std::uint64_t key(std::string_view source) const;
+  std::optional<Chunk> load(std::uint64_t key) const;
+  // best effort, a chunk that cannot be stored is compiled again next time
+  void store(std::uint64_t key, const Chunk &chunk) const;
+
+private:
+  std::string path(std::uint64_t key) const;
+
+  std::string _directory;
+  // hash of what the key covers besides the source
+  std::uint64_t _seed;
+};
+
+} // namespace plzerow
@@ -0,0 +1,91 @@
+#pragma once
+
+#include "ast.hpp"
+#include "ast_nodes.hpp"
+#include "interner.hpp"
+#include "resolver.hpp"
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+namespace plzerow {
+
+/*
+ * Translates a resolved program into a C translation unit, for batch runs
+ * that are worth building with an optimizing C compiler.
+ *
+ * The main program's variables become file scope variables and every
+ * procedure a static function. A procedure's variables are locals, except
+ * those a nested procedure refers to, which live in a frame struct that
+ * also links to the enclosing procedure's frame; nested procedures take a
+ * pointer to their parent's frame. while and if become C loops and
+ * conditionals.
+ *
+ * Arithmetic wraps and division by zero fails with the line the VM reports,
+ * divisions that may fail are evaluated into temporaries in the VM's order
+ * so the first one to fail is the same. The unit exports
+ *
+ *   int plzerow_run(int32_t *globals);
+ *
+ * which runs the program and stores the main program's variables, and,
+ * unless PLZEROW_NO_MAIN is defined, a main that prints them the way the VM
+ * does. Calls nest at most as deep as PLZEROW_STACK_SIZE bytes of stack
+ * allow, beyond that the program fails with a stack overflow; main runs the
+ * program on a thread with a stack of that size.
+ */
+class CBackend {
+public:
+  CBackend(const Ast &ast, const SymbolTable &table, const Interner &symbols);
+
+  std::string translate();
+
+private:
+  struct Function {
+    NodeIndex block;
+    std::string name;
+    std::uint32_t level;
+    // the procedure that declares it
+    std::int32_t parent;
+    // it has a frame struct, i.e. nested procedures
+    bool framed;
+  };
+
+  void collect(NodeIndex block, std::int32_t procedure, std::int32_t parent,
+               std::uint32_t level, std::string name);
+  void declare(const Function &function, std::int32_t index);
+  void define(const Function &function, std::int32_t index);
+  std::string signature(const Function &function, std::int32_t index) const;
+
+  void statement(NodeIndex node);
+  std::string condition(NodeIndex node);
+  std::string expression(NodeIndex node);
+  std::string variable(NodeIndex node) const;
+  std::string frame(std::uint8_t hops) const;
+
+  void line(const std::string &text);
+  void flush_temporaries();
+
+  const Ast &_ast;
+  const SymbolTable &_table;
+  const Interner &_symbols;
+  // the C function of every procedure, indexed like the symbol table
+  // numbers them, the main program is procedure 0
+  std::vector<Function> _functions;
+  std::string _declarations;
+  std::string _definitions;
+  // of the procedure being defined
+  std::uint32_t _level = 0;
+  std::size_t _indent = 0;
+  // divisions that may fail, in evaluation order, evaluated ahead of the
+  // statement they belong to
+  std::vector<std::string> _temporaries;
+  std::size_t _temporary_count = 0;
+  // the most temporaries and variables of any one procedure
+  std::size_t _largest_frame = 0;
+  // tracked like the code generator does, so division by zero reports the
+  // same line
+  SourceLoc _loc{0, 0};
+};
+
+} // namespace plzerow
@@ -1,40 +1,96 @@
 #pragma once
 
+#include "source_buffer.hpp"
+#include "source_loc.hpp"
 #include "value.hpp"
 #include <cstdint>
+#include <memory>
+#include <span>
+#include <string>
+#include <string_view>
 #include <vector>
 
 namespace plzerow {
 
-using LineCounter = std::uint32_t;
+// The bytes from offset up to the next entry's offset were compiled from
+// loc. Entries are appended in offset order as the code is, so the table is
+// a prefix sum of its run lengths from the start and finding the entry of
+// an offset is a binary search.
+struct DebugEntry {
+  std::uint32_t offset;
+  SourceLoc loc;
+};
+
 using InstructionContainer = std::vector<std::uint8_t>;
-using LinumContainer = std::vector<LineCounter>;
-using InstructionPointer = InstructionContainer::const_iterator;
+using DebugContainer = std::vector<DebugEntry>;
+using DebugTable = std::span<const DebugEntry>;
+using InstructionPointer = const std::uint8_t *;
 
+// A chunk either owns its code and line table or, once loaded from a
+// bytecode file, runs them in place from the file's mapping, in which case
+// it is read-only.
 class Chunk {
+  friend class BytecodeFile;
   friend class Debugger;
 
 public:
-  std::uint8_t append(std::uint8_t instruction, std::size_t linum);
-  std::uint8_t append(std::uint8_t instruction, const Value &value,
-                      std::size_t linum);
+  void append(std::uint8_t instruction, SourceLoc loc);
+  // CONSTANT, or CONSTANT_LONG past the first short_constants, with the
+  // index of value in the pool, which adds it unless it is there already.
+  // False, appending nothing, if the pool is full.
+  bool append_constant(const Value &value, SourceLoc loc);
 
   InstructionPointer cbegin() const;
+  std::size_t size() const;
+  // rewrites an operand byte emitted earlier, e.g. a jump offset
+  void patch(std::size_t offset, std::uint8_t byte);
 
   template <typename Visitor>
   auto visit_constant(std::size_t index, Visitor &&visitor) const;
 
   Value constant(std::size_t index) const;
+  std::size_t constant_count() const;
+  // the index of value, which is added unless the pool holds it already
+  std::size_t add_constant(const Value &value);
+  // the constant CONSTANT or CONSTANT_LONG at offset pushes
+  Value constant_at(std::size_t offset) const;
+
+  DebugTable debug_info() const;
 
-  std::uint16_t linum(std::size_t instruction_index) const;
+  // names of the main program's variables, by slot, for printing them
+  // when the program halts
+  void add_global(std::string_view name);
+  const std::vector<std::string> &globals() const;
+
+  // where the instruction at offset was compiled from, in O(log n)
+  SourceLoc location(std::size_t offset) const;
+  std::uint32_t linum(std::size_t offset) const;
 
 private:
-  std::uint8_t append(std::uint8_t instruction);
-  void add_linum(std::uint16_t linum, std::uint16_t op_size);
+  void append(std::uint8_t instruction);
+  void add_location(SourceLoc loc);
 
   InstructionContainer _instructions;
-  LinumContainer _linums;
+  DebugContainer _debug_info;
   ValueArray _constants;
+  std::vector<std::string> _globals;
+  std::shared_ptr<const SourceBuffer> _mapping;
+  std::span<const std::uint8_t> _mapped_instructions;
+  DebugTable _mapped_debug_info;
+};
+
+// Walks the debug table alongside the instructions, for passes that look
+// up the location of every instruction in order.
+class DebugCursor {
+public:
+  explicit DebugCursor(DebugTable entries) : _entries{entries} {}
+
+  SourceLoc location(std::size_t offset);
+
+private:
+  DebugTable _entries;
+  std::size_t _next = 0;
+  SourceLoc _loc{0, 0};
 };
 
 template <typename Visitor>
@@ -0,0 +1,72 @@
+#pragma once
+
+#include "ast.hpp"
+#include "ast_nodes.hpp"
+#include "chunk.hpp"
+#include "resolver.hpp"
+#include <cstddef>
+#include <cstdint>
+#include <optional>
+#include <string>
+#include <utility>
+#include <vector>
+
+namespace plzerow {
+
+// The code of one block, compiled on its own. Jumps are relative and stay
+// inside the block, so only calls and constant indices depend on where the
+// fragment ends up and what else is in the program.
+struct Fragment {
+  Chunk code;
+  // operand offset and callee of every CALL, addresses are filled in once
+  // every fragment is placed
+  std::vector<std::pair<std::size_t, std::int32_t>> calls;
+  // reported in program order when the fragments are linked
+  std::vector<std::string> errors;
+};
+
+// The value of an expression made only of literals and constants. Anything
+// that would fail at run time, i.e. dividing by zero, is not folded.
+std::optional<std::int32_t> fold(const Ast &ast, const SymbolTable &table,
+                                 NodeIndex node);
+
+// Compiles the statement of a single block, which only reads the AST and the
+// symbol table, so blocks can be compiled concurrently. Each block compiles
+// to
+//
+//   ENTER <variables>  statement  RETURN
+//
+// and its nested procedures are separate fragments.
+class CodeGenerator {
+public:
+  CodeGenerator(const Ast &ast, const SymbolTable &table);
+
+  Fragment generate(NodeIndex block);
+
+private:
+  void statement(NodeIndex node);
+  void condition(NodeIndex node);
+  void expression(NodeIndex node);
+  std::optional<std::int32_t> fold(NodeIndex node) const;
+
+  void load(NodeIndex node);
+  void store(NodeIndex node);
+
+  void emit_byte(std::uint8_t byte);
+  void emit_bytes(std::uint8_t byte1, std::uint8_t byte2);
+  void emit_return();
+  void emit_constant(std::int32_t value);
+  std::size_t emit_jump(std::uint8_t instruction);
+  void patch_jump(std::size_t offset);
+  void emit_loop(std::size_t loop_start);
+  void emit_call(const Resolution &procedure);
+
+  void error(const std::string &message);
+
+  const Ast &_ast;
+  const SymbolTable &_table;
+  Fragment _fragment;
+  SourceLoc _loc{0, 0};
+};
+
+} // namespace plzerow
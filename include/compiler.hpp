@@ -1,30 +1,97 @@
 #pragma once
 
+#include "ast.hpp"
 #include "ast_nodes.hpp"
+#include "chunk.hpp"
+#include "code_generator.hpp"
+#include "interner.hpp"
 #include "lexer.hpp"
-#include "parser.hpp"
+#include "native_build.hpp"
+#include "resolver.hpp"
+#include "source_buffer.hpp"
+#include <cstddef>
 #include <cstdint>
-#include <memory>
+#include <optional>
+#include <string>
+#include <utility>
+#include <vector>
 
 namespace plzerow {
 
-enum class CompilerResult { OK, LexicalError, ParseError };
+enum class CompilerResult { OK, LexicalError, ParseError, SemanticError };
+
+// the instruction set the program is compiled to and executed in; Threaded
+// runs the stack instructions decoded into threaded code, Jit as native code
+// where the host supports it
+enum class Engine { Stack, Register, Jit, Threaded };
+
+struct CompilerOptions {
+  // > 1 tokenizes resident sources with the ParallelLexer
+  unsigned lex_threads = 1;
+  // lexes on a second thread while the parser consumes its tokens
+  bool pipeline = false;
+  // > 1 generates the code of the program's blocks on a thread pool, the
+  // bytecode is the same for any count
+  unsigned codegen_threads = 1;
+  Engine engine = Engine::Stack;
+  // 0 compiles straight from the AST, 1 and 2 go through the SSA form and
+  // its optimizations (see ir_optimize.hpp)
+  unsigned opt_level = 0;
+  // prints the optimized SSA form before it is lowered
+  bool dump_ir = false;
+  // -O2 inlines procedures of up to inline_threshold SSA instructions, 0
+  // turns it off, and grows no procedure by more than inline_budget
+  unsigned inline_threshold = 40;
+  unsigned inline_budget = 400;
+  // runfile keeps compiled programs here and reuses them while the source
+  // and the options above are unchanged, empty turns the cache off
+  std::string cache_dir;
+  // Engine::Jit runs the program in the interpreter as well and reports
+  // any difference between the two
+  bool jit_verify = false;
+  // runfile translates the program to C instead of, or with verify as well
+  // as, running it
+  NativeOptions native;
+};
 
 class Compiler {
 public:
   Compiler() = default;
+  Compiler(CompilerOptions options) : _options{options} {}
 
   CompilerResult compile(std::vector<char> &&source_code);
+  CompilerResult compile(const std::string &filename, SourceBuffer &&source);
+  // the bytecode of the last successful compile
+  Chunk take_chunk();
+  // the last successful compile as C, see c_backend.hpp
+  std::string c_source() const;
 
 private:
-  void print(const std::unique_ptr<ASTNode> &node) const;
-  void emit_byte(std::uint8_t byte);
-  void emit_bytes(std::uint8_t byte1, std::uint8_t byte2);
-  void emit_return();
+  void print(NodeIndex node) const;
 
-  std::unique_ptr<ASTNode> _ast;
-  Parser _parser;
+  CompilerResult generate();
+  // each block with the procedure it is the body of, in the order they are
+  // laid out
+  void layout(NodeIndex block, std::int32_t procedure,
+              std::vector<std::pair<NodeIndex, std::int32_t>> &order) const;
+  void link(const std::vector<std::pair<NodeIndex, std::int32_t>> &blocks,
+            const std::vector<Fragment> &fragments);
+  void optimize();
+  CompilerResult lower();
+
+  void compile_error(const std::string &err);
+
+  CompilerOptions _options;
+  Interner _symbols;
+  Ast _ast;
   Lexer _lexer;
+  SourceBuffer _source;
+  std::vector<Token> _tokens;
+
+  Chunk _chunk;
+  SymbolTable _table;
+  SourceLoc _loc{0, 0};
+  bool _had_error = false;
 };
 
 } // namespace plzerow
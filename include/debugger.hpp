@@ -9,6 +9,12 @@ public:
   static std::size_t disassemble_instruction(std::size_t offset,
                                              const Chunk &chunk);
   static std::size_t disassemble(const std::string &name, const Chunk &chunk);
+
+  // the same for chunks lowered to the register instruction set
+  static std::size_t disassemble_register_instruction(std::size_t offset,
+                                                      const Chunk &chunk);
+  static std::size_t disassemble_registers(const std::string &name,
+                                           const Chunk &chunk);
 };
 
 } // namespace plzerow
@@ -1,14 +1,18 @@
 #pragma once
 
+#include "source_buffer.hpp"
 #include <istream>
 #include <string>
 #include <vector>
 
 namespace plzerow {
 
+enum class InputMode { Read, Map, Stream };
+
 class InputHandler {
 public:
   static std::vector<char> read_from_repl(std::istream &is);
   static std::vector<char> read_from_file(const std::string &filename);
+  static SourceBuffer open_file(const std::string &filename, InputMode mode);
 };
 } // namespace plzerow
@@ -0,0 +1,41 @@
+#pragma once
+
+#include <cstdint>
+#include <memory>
+#include <string_view>
+#include <unordered_map>
+#include <vector>
+
+namespace plzerow {
+
+using SymbolId = std::uint32_t;
+constexpr SymbolId no_symbol = ~SymbolId{0};
+
+// Maps every distinct identifier of a compilation to a dense 32-bit id. The
+// names are copied once into an arena owned by the interner, so the views
+// returned by name() stay valid for the interner's lifetime regardless of
+// what happens to the source buffer.
+class Interner {
+public:
+  Interner() = default;
+  Interner(Interner &&) noexcept = default;
+  Interner &operator=(Interner &&) noexcept = default;
+  Interner(const Interner &) = delete;
+  Interner &operator=(const Interner &) = delete;
+
+  SymbolId intern(std::string_view name);
+  std::string_view name(SymbolId symbol) const;
+  std::size_t size() const;
+
+private:
+  std::string_view store(std::string_view name);
+
+  static constexpr std::size_t block_size = 1 << 16;
+
+  std::vector<std::unique_ptr<char[]>> _blocks;
+  std::size_t _block_used = block_size;
+  std::vector<std::string_view> _names;
+  std::unordered_map<std::string_view, SymbolId> _ids;
+};
+
+} // namespace plzerow
@@ -0,0 +1,114 @@
+#pragma once
+
+#include "source_loc.hpp"
+#include <cstdint>
+#include <limits>
+#include <ostream>
+#include <string>
+#include <vector>
+
+namespace plzerow::ir {
+
+// The middle end's intermediate representation: one control-flow graph in
+// SSA form per procedure. Variables that no nested procedure can see are
+// SSA values; everything else stays in the frame and is read and written
+// with Load and Store.
+using ValueId = std::uint32_t;
+using BlockId = std::uint32_t;
+constexpr ValueId no_value = std::numeric_limits<ValueId>::max();
+
+enum class Op : std::uint8_t {
+  Const,    // constant
+  Load,     // hops, slot
+  Store,    // hops, slot, operands: value
+  Negate,   // operands: value
+  Odd,      // operands: value
+  Add,      // operands: lhs, rhs
+  Subtract, // operands: lhs, rhs
+  Multiply, // operands: lhs, rhs
+  Divide,   // operands: lhs, rhs
+  Equal,    // operands: lhs, rhs
+  NotEqual, // operands: lhs, rhs
+  Less,     // operands: lhs, rhs
+  Greater,  // operands: lhs, rhs
+  Call,     // hops, constant: the callee's function index
+  Phi,      // operands: one per predecessor, in order
+  Jump,     // successors: target
+  Branch,   // operands: condition, successors: true, false
+  Return,
+};
+
+struct Instruction {
+  Op op;
+  BlockId block = 0;
+  SourceLoc loc = {0, 0};
+  std::int32_t constant = 0;
+  std::uint8_t hops = 0;
+  std::uint8_t slot = 0;
+  std::vector<ValueId> operands = {};
+  bool removed = false;
+};
+
+struct Block {
+  // phis first, the terminator last
+  std::vector<ValueId> instructions;
+  std::vector<BlockId> predecessors;
+  std::vector<BlockId> successors;
+  bool removed = false;
+};
+
+struct Function {
+  std::string name;
+  std::uint32_t level = 0;
+  // the frame's variables, promoted or not, keep their slots
+  std::uint8_t slots = 0;
+  std::vector<Instruction> values;
+  std::vector<Block> blocks;
+
+  BlockId add_block();
+  // appends to the block, or puts a phi in front of its other instructions
+  ValueId add(BlockId block, Instruction instruction);
+  ValueId terminator(BlockId block) const;
+  void add_edge(BlockId from, BlockId to);
+  // drops the edge and the phi operands that flow along it
+  void remove_edge(BlockId from, BlockId to);
+  void replace_uses(ValueId value, ValueId replacement);
+  // detaches the instruction from its block
+  void remove(ValueId value);
+};
+
+// functions[0] is the main program, a Call names its callee by index
+struct Module {
+  std::vector<Function> functions;
+  std::vector<std::string> globals;
+};
+
+bool is_terminator(Op op);
+bool is_commutative(Op op);
+// whether the instruction must run even if its value is unused: stores,
+// calls, control flow and divisions that may divide by zero
+bool has_side_effects(const Function &function, const Instruction &instruction);
+
+// blocks reachable from the entry, in reverse postorder, taking the false
+// successor of a branch before the true one so loop bodies and then
+// branches directly follow their condition
+std::vector<BlockId> reverse_postorder(const Function &function);
+// the immediate dominator of every reachable block, the entry dominates
+// itself, unreachable blocks have none
+std::vector<BlockId> dominators(const Function &function,
+                                const std::vector<BlockId> &order);
+bool dominates(const std::vector<BlockId> &idom, BlockId a, BlockId b);
+
+// the functions the main program can reach through calls
+std::vector<bool> called_functions(const Module &module);
+
+// the users of every value
+std::vector<std::vector<ValueId>> users(const Function &function);
+
+// replaces phis whose operands are all the same value, or the phi itself,
+// with that value until none are left
+void remove_trivial_phis(Function &function);
+
+void print(std::ostream &out, const Module &module);
+
+} // namespace plzerow::ir
@@ -0,0 +1,18 @@
+#pragma once
+
+#include "ast.hpp"
+#include "interner.hpp"
+#include "ir.hpp"
+#include "resolver.hpp"
+
+namespace plzerow::ir {
+
+// Lowers a program that has already compiled without errors to SSA form,
+// with Braun et al.'s "Simple and Efficient Construction of Static Single
+// Assignment Form". A procedure's variables are promoted to SSA values
+// unless a nested procedure refers to them. Function i is procedure i of
+// the symbol table.
+Module build(const Ast &ast, const Interner &symbols,
+             const SymbolTable &table);
+
+} // namespace plzerow::ir
@@ -0,0 +1,24 @@
+#pragma once
+
+#include "ir.hpp"
+#include <cstddef>
+
+namespace plzerow::ir {
+
+struct InlineLimits {
+  // callees with more instructions than this are never inlined, 0 turns
+  // inlining off
+  std::size_t threshold = 40;
+  // the instructions inlining may add to any one function
+  std::size_t budget = 400;
+};
+
+// Replaces calls to small procedures that cannot reach themselves through
+// the call graph with a copy of their body. Callees are inlined into their
+// callers before those are inlined any further, so a chain of helpers
+// collapses from the bottom up. A procedure that keeps variables in its
+// frame, or calls a procedure nested in it, needs its own frame and is left
+// alone; every other frame access is rebased onto the caller's static link.
+void inline_calls(Module &module, const InlineLimits &limits);
+
+} // namespace plzerow::ir
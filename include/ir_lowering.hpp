@@ -0,0 +1,19 @@
+#pragma once
+
+#include "chunk.hpp"
+#include "ir.hpp"
+#include <optional>
+
+namespace plzerow::ir {
+
+// Translates the module back to stack machine code. SSA values that are
+// used once, right where they are computed, stay on the stack; the others
+// get frame slots after the procedure's variables, shared by values that
+// are never live at the same time. Phis become copies on the incoming
+// edges, which are split where a branch would otherwise carry them.
+//
+// Returns nullopt if a frame needs more than 255 slots, the code more than
+// 256 distinct constants, or a jump more than a 16-bit offset.
+std::optional<Chunk> lower(Module module);
+
+} // namespace plzerow::ir
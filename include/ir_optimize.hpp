@@ -0,0 +1,39 @@
+#pragma once
+
+#include "ir.hpp"
+#include "ir_inline.hpp"
+
+namespace plzerow::ir {
+
+// Wegman and Zadeck's sparse conditional constant propagation: folds values
+// that are constant on every path that can run, turns branches on constants
+// into jumps and drops the blocks no path reaches any more.
+void propagate_constants(Function &function);
+
+// removes instructions whose values are never used and have no side effects
+void eliminate_dead_code(Function &function);
+
+// dominator-based global value numbering: an instruction that recomputes a
+// value available from a dominating instruction is replaced by it. Loads
+// are only merged within a block and up to the next store or call.
+void number_values(Function &function);
+
+// moves instructions whose operands are defined outside a while loop into a
+// block in front of its header, innermost loops first. Loads move only out
+// of loops that neither store nor call.
+void hoist_loop_invariants(Function &function);
+
+// Rewrites while loops around their induction variables, innermost first.
+// A loop that runs a known number of times and only steps and sums
+// induction variables is replaced by their closed forms, one whose values
+// all follow from constants is run at compile time and replaced by its
+// results. In the others, a known trip count turns the test into a < or >
+// against the last value, and products of an induction variable and an
+// invariant become additions.
+void optimize_loops(Function &function);
+
+// -O1 propagates constants and removes dead code, -O2 also inlines small
+// procedures, numbers values, hoists loop invariants and optimizes loops
+void optimize(Module &module, unsigned level, const InlineLimits &limits = {});
+
+} // namespace plzerow::ir
@@ -0,0 +1,66 @@
+#pragma once
+
+#include "chunk.hpp"
+#include <cstddef>
+#include <cstdint>
+#include <optional>
+#include <vector>
+
+namespace plzerow {
+
+/*
+ * Native x86-64 code for a chunk of stack instructions.
+ *
+ * Every procedure becomes a native function. Its frame is a static link
+ * followed by its variables in a frame area of its own, addressed from rbx,
+ * and calls run on a separate native stack, so neither recursion depth nor
+ * frame size depends on the thread that runs the program. The operand
+ * stack exists only at translation time: its entries live in registers,
+ * spill to a scratch area past the seventh and constants are folded into
+ * immediates. This relies on the stack being empty at every jump, jump
+ * target and call, which holds for everything the compiler emits; a chunk
+ * where it does not, or that holds a non-integer constant, is not
+ * translated.
+ *
+ * The code is written to a writable mapping that is made executable, and
+ * never writable again, before it runs. Division by zero and running out
+ * of frames or native stack call back into the runtime, which records the
+ * failing instruction and unwinds straight back to run(). Both areas are
+ * fixed, 256MB of frames and 64MB of native stack, so a program recursing
+ * deeper stops with StackOverflow where the interpreter keeps growing its
+ * frames; the VM then runs it interpreted instead.
+ */
+class JitCode {
+public:
+  enum class Status : std::uint32_t { OK, DivisionByZero, StackOverflow };
+
+  struct Result {
+    Status status;
+    // of the failing instruction
+    std::size_t offset;
+    // the main program's variables when it stopped
+    std::vector<std::int32_t> globals;
+  };
+
+  // nullopt on hosts other than x86-64 and for chunks it does not translate
+  static std::optional<JitCode> compile(const Chunk &chunk);
+
+  JitCode(JitCode &&other) noexcept;
+  JitCode &operator=(JitCode &&other) noexcept;
+  JitCode(const JitCode &) = delete;
+  JitCode &operator=(const JitCode &) = delete;
+  ~JitCode();
+
+  Result run(std::size_t globals) const;
+
+private:
+  JitCode() = default;
+  void release();
+
+  void *_code = nullptr;
+  std::size_t _size = 0;
+  // operand stack entries past the registers
+  std::size_t _spills = 0;
+};
+
+} // namespace plzerow
@@ -1,8 +1,15 @@
 #pragma once
 
+#include "interner.hpp"
+#include "scanner.hpp"
+#include "source_buffer.hpp"
 #include "token.hpp"
 #include "token_type.hpp"
+#include <algorithm>
+#include <array>
+#include <cstddef>
 #include <string>
+#include <string_view>
 #include <vector>
 
 namespace plzerow {
@@ -22,11 +29,90 @@ constexpr char kw_procedure[] = "procedure";
 constexpr char kw_end[] = "end";
 constexpr char kw_print[] = "print";
 
+/*
+ * Keyword recognition through a perfect hash computed at compile time from
+ * the kw_* constants. The hash only looks at the length and the first and
+ * last characters, so classifying an identifier costs one table load and at
+ * most one short compare, without allocating.
+ */
+
+struct Keyword {
+  std::string_view text;
+  TOKEN token;
+};
+
+constexpr std::array keywords{
+    Keyword{kw_var, TOKEN::VAR},
+    Keyword{kw_odd, TOKEN::ODD},
+    Keyword{kw_const, TOKEN::CONST},
+    Keyword{kw_cond, TOKEN::IF},
+    Keyword{kw_do, TOKEN::DO},
+    Keyword{kw_then, TOKEN::THEN},
+    Keyword{kw_call, TOKEN::CALL},
+    Keyword{kw_begin, TOKEN::BEGIN},
+    Keyword{kw_while, TOKEN::WHILE},
+    Keyword{kw_end, TOKEN::END},
+    Keyword{kw_procedure, TOKEN::PROCEDURE},
+};
+
+constexpr std::size_t keyword_table_size = 32;
+
+constexpr std::size_t keyword_hash(std::string_view text,
+                                   std::size_t multiplier) {
+  return (text.size() + static_cast<unsigned char>(text.front()) * multiplier +
+          static_cast<unsigned char>(text.back())) %
+         keyword_table_size;
+}
+
+constexpr std::size_t find_keyword_multiplier() {
+  for (std::size_t multiplier = 1; multiplier < 256; ++multiplier) {
+    std::array<bool, keyword_table_size> used{};
+    bool collision = false;
+    for (const auto &keyword : keywords) {
+      auto &slot = used[keyword_hash(keyword.text, multiplier)];
+      collision |= slot;
+      slot = true;
+    }
+    if (!collision)
+      return multiplier;
+  }
+  return 0;
+}
+
+constexpr std::size_t keyword_multiplier = find_keyword_multiplier();
+static_assert(keyword_multiplier != 0, "no perfect hash for the keyword set");
+
+constexpr auto keyword_table = [] {
+  std::array<Keyword, keyword_table_size> table{};
+  for (auto &entry : table)
+    entry = {"", TOKEN::IDENT};
+  for (const auto &keyword : keywords)
+    table[keyword_hash(keyword.text, keyword_multiplier)] = keyword;
+  return table;
+}();
+
+constexpr std::size_t longest_keyword = [] {
+  std::size_t longest = 0;
+  for (const auto &keyword : keywords)
+    longest = std::max(longest, keyword.text.size());
+  return longest;
+}();
+
+constexpr TOKEN keyword_or_ident(std::string_view identifier) {
+  if (identifier.size() > longest_keyword)
+    return TOKEN::IDENT;
+  const auto &entry =
+      keyword_table[keyword_hash(identifier, keyword_multiplier)];
+  return entry.text == identifier ? entry.token : TOKEN::IDENT;
+}
+
 class Lexer {
 public:
   Lexer() = default;
   Lexer(const std::string &filename, std::vector<char> &&source);
   Lexer(std::vector<char> &&source);
+  Lexer(const std::string &filename, SourceBuffer &&source,
+        Interner *symbols = nullptr);
 
   Lexer(Lexer &&) noexcept = default;
   Lexer &operator=(Lexer &&) noexcept = default;
@@ -34,12 +120,24 @@ public:
   Lexer &operator=(const Lexer &) = delete;
   ~Lexer() = default;
 
+  // Tokens refer into the lexer's buffer; they are valid until the lexer is
+  // destroyed. Moving the lexer keeps them valid. With a streaming source a
+  // token is only valid until the next call to next(), and tokenize() must
+  // not be used.
   Token next();
   std::vector<Token> tokenize();
 
+  // state at the end of the buffer, used to stitch chunks lexed in parallel
+  std::size_t linum() const;
+  bool ended_in_comment() const;
+
   // debugging
   void dump_lexeme(const Token &lex) const;
   void parse_error(const std::string &err) const;
+  void set_report_errors(bool report_errors);
+  // scans with kernels instead of the ones picked for this CPU
+  void set_scan_kernels(const ScanKernels &kernels);
+  static void report_error(const std::string &filename, const Token &token);
   bool at_end() const;
 
 private:
@@ -50,15 +148,25 @@ private:
   Token parse_number();
 
   // helpers
+  bool refill(std::size_t keep_from);
+  void skip_to(const char *position);
+  void skip_lines(const LineRun &run);
+  const char *cursor() const;
+  const char *buffer_end() const;
+  std::string_view lexeme(std::size_t start) const;
   char peek() const;
   char peek_next() const;
   void match(const char rhs);
   char advance();
 
   // active state
-  std::vector<char> _buffer;
-  std::string _literal;
+  const ScanKernels *_scan = &scan_kernels();
+  SourceBuffer _source;
+  const char *_data = nullptr;
+  Interner *_symbols = nullptr;
   TOKEN _token;
+  bool _in_comment = false;
+  bool _report_errors = true;
 
   // position tracking
   std::size_t _linum = 1;
@@ -0,0 +1,44 @@
+#pragma once
+
+#include <optional>
+#include <string>
+
+namespace plzerow {
+
+// What runfile does with the program's C translation (see c_backend.hpp)
+// instead of running it, nothing if every field is empty.
+struct NativeOptions {
+  // writes the translation to this file
+  std::string emit_c;
+  // builds it into an executable, or with shared a shared object, here
+  std::string output;
+  bool shared = false;
+  // runs the program both natively and in the interpreter and reports any
+  // difference in what they print
+  bool verify = false;
+
+  bool enabled() const { return !emit_c.empty() || !output.empty() || verify; }
+};
+
+// how --native-verify ended; main exits with 1 when the native program
+// behaved differently and 2 when it could not be built
+enum class NativeCheck { Same, Differs, NotBuilt };
+
+// what a native program printed and its exit status, -1 if it did not exit
+// normally
+struct NativeRun {
+  int status;
+  std::string out;
+  std::string err;
+};
+
+// Builds a translation with the system C compiler, $CC or else cc, which
+// reports its own errors. Only available on unix hosts.
+bool build_native(const std::string &c_source, const std::string &output,
+                  bool shared);
+
+// Builds a translation into an executable in a temporary directory and runs
+// it, nullopt if it could not be built.
+std::optional<NativeRun> run_native(const std::string &c_source);
+
+} // namespace plzerow
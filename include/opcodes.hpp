@@ -0,0 +1,188 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <iterator>
+
+namespace plzerow {
+
+// How an instruction's operands are laid out after its opcode, which also
+// fixes its size. Registers, slots, static link hops, variable counts and
+// constant indices are one byte, long constant indices three, jump offsets
+// two bytes and call addresses four, all big-endian.
+enum class Operands : std::uint8_t {
+  None,
+  Constant,         // constant
+  LongConstant,     // long constant
+  Byte,             // slot or variable count
+  Variable,         // hops, slot
+  Forward,          // forward offset
+  Backward,         // backward offset
+  Call,             // hops to the callee's enclosing frame, address
+  SlotConstant,     // slot, constant
+  SlotLongConstant, // slot, long constant
+  SlotForward,      // slot, forward offset
+  RegisterPair,     // dst, src
+  RegisterTriple,   // dst, lhs, rhs or dst, hops, slot or hops, slot, src
+};
+
+// bytes taken by an instruction with these operands, including its opcode
+constexpr std::size_t layout_size(Operands layout) {
+  switch (layout) {
+  case Operands::Constant:
+  case Operands::Byte:
+    return 2;
+  case Operands::Variable:
+  case Operands::Forward:
+  case Operands::Backward:
+  case Operands::SlotConstant:
+  case Operands::RegisterPair:
+    return 3;
+  case Operands::LongConstant:
+  case Operands::SlotForward:
+  case Operands::RegisterTriple:
+    return 4;
+  case Operands::SlotLongConstant:
+    return 5;
+  case Operands::Call:
+    return 6;
+  default:
+    return 1;
+  }
+}
+
+// Every stack instruction, in opcode order, as X(opcode, operands). The
+// opcodes, their sizes and names and the interpreter's dispatch tables are
+// all generated from it.
+#define PLZEROW_OPCODES(X)                                                     \
+  X(OP_RETURN, None)                                                           \
+  X(OP_CONSTANT, Constant)                                                     \
+  X(OP_CONSTANT_LONG, LongConstant)                                            \
+  X(OP_NEGATE, None)                                                           \
+  X(OP_ADD, None)                                                              \
+  X(OP_MULTIPLY, None)                                                         \
+  X(OP_SUBTRACT, None)                                                         \
+  X(OP_DIVIDE, None)                                                           \
+  X(OP_ODD, None)                                                              \
+  X(OP_EQUAL, None)                                                            \
+  X(OP_NOT_EQUAL, None)                                                        \
+  X(OP_LESS, None)                                                             \
+  X(OP_GREATER, None)                                                          \
+  X(OP_GET_LOCAL, Byte)                                                        \
+  X(OP_SET_LOCAL, Byte)                                                        \
+  X(OP_GET_VAR, Variable)                                                      \
+  X(OP_SET_VAR, Variable)                                                      \
+  X(OP_JUMP, Forward)                                                          \
+  X(OP_JUMP_IF_FALSE, Forward) /* pops the condition */                        \
+  X(OP_LOOP, Backward)                                                         \
+  X(OP_CALL, Call)                                                             \
+  X(OP_ENTER, Byte)                                                            \
+  /* superinstructions, emitted only by the peephole pass */                   \
+  X(OP_ADD_CONST, Constant)                                                    \
+  X(OP_SUBTRACT_CONST, Constant)                                               \
+  X(OP_INC_LOCAL, SlotConstant)                                                \
+  X(OP_JUMP_IF_NOT_LESS, Forward)    /* pops both operands */                  \
+  X(OP_JUMP_IF_NOT_GREATER, Forward) /* pops both operands */
+
+enum OP_CODE : std::uint8_t {
+#define PLZEROW_OPCODE(opcode, operands) opcode,
+  PLZEROW_OPCODES(PLZEROW_OPCODE)
+#undef PLZEROW_OPCODE
+};
+
+// the disassembler's name of every opcode, indexed by it
+constexpr const char *opcode_names[] = {
+#define PLZEROW_OPCODE(opcode, operands) #opcode,
+    PLZEROW_OPCODES(PLZEROW_OPCODE)
+#undef PLZEROW_OPCODE
+};
+
+constexpr std::size_t opcode_count = std::size(opcode_names);
+
+// None for bytes that are not an opcode
+constexpr Operands operands(std::uint8_t instruction) {
+  switch (instruction) {
+#define PLZEROW_OPCODE(opcode, layout)                                         \
+  case opcode:                                                                 \
+    return Operands::layout;
+    PLZEROW_OPCODES(PLZEROW_OPCODE)
+#undef PLZEROW_OPCODE
+  default:
+    return Operands::None;
+  }
+}
+
+// bytes taken by an instruction including its operands
+constexpr std::size_t instruction_size(std::uint8_t instruction) {
+  return layout_size(operands(instruction));
+}
+
+// Code refers to the first short_constants constants of a chunk with one
+// byte, the superinstructions only to those, and to the rest with three.
+constexpr std::size_t short_constants = 256;
+constexpr std::size_t max_constants = std::size_t{1} << 24;
+
+constexpr std::uint32_t read_long_constant(const std::uint8_t *operand) {
+  return static_cast<std::uint32_t>(operand[0] << 16 | operand[1] << 8 |
+                                    operand[2]);
+}
+
+// Register machine instructions, three-address over the registers of the
+// current frame: a procedure's variables first, then its temporaries.
+// Register operands come first, the destination leading. Like
+// PLZEROW_OPCODES, the opcodes, their sizes and names and the register
+// interpreter's dispatch table are generated from this list.
+#define PLZEROW_REG_OPCODES(X)                                                 \
+  X(REG_RETURN, None)                                                          \
+  X(REG_LOADK, SlotConstant)                                                   \
+  X(REG_LOADK_LONG, SlotLongConstant)                                          \
+  X(REG_MOVE, RegisterPair)                                                    \
+  X(REG_NEGATE, RegisterPair)                                                  \
+  X(REG_ODD, RegisterPair)                                                     \
+  X(REG_ADD, RegisterTriple)                                                   \
+  X(REG_SUBTRACT, RegisterTriple)                                              \
+  X(REG_MULTIPLY, RegisterTriple)                                              \
+  X(REG_DIVIDE, RegisterTriple)                                                \
+  X(REG_EQUAL, RegisterTriple)                                                 \
+  X(REG_NOT_EQUAL, RegisterTriple)                                             \
+  X(REG_LESS, RegisterTriple)                                                  \
+  X(REG_GREATER, RegisterTriple)                                               \
+  X(REG_GET_VAR, RegisterTriple) /* dst, hops, slot */                         \
+  X(REG_SET_VAR, RegisterTriple) /* hops, slot, src */                         \
+  X(REG_JUMP, Forward)                                                         \
+  X(REG_JUMP_IF_FALSE, SlotForward) /* condition, forward offset */            \
+  X(REG_LOOP, Backward)                                                        \
+  X(REG_CALL, Call)                                                            \
+  X(REG_ENTER, Byte) /* register count */
+
+enum REG_CODE : std::uint8_t {
+#define PLZEROW_OPCODE(opcode, operands) opcode,
+  PLZEROW_REG_OPCODES(PLZEROW_OPCODE)
+#undef PLZEROW_OPCODE
+};
+
+constexpr const char *register_opcode_names[] = {
+#define PLZEROW_OPCODE(opcode, operands) #opcode,
+    PLZEROW_REG_OPCODES(PLZEROW_OPCODE)
+#undef PLZEROW_OPCODE
+};
+
+constexpr std::size_t register_opcode_count = std::size(register_opcode_names);
+
+constexpr Operands register_operands(std::uint8_t instruction) {
+  switch (instruction) {
+#define PLZEROW_OPCODE(opcode, layout)                                         \
+  case opcode:                                                                 \
+    return Operands::layout;
+    PLZEROW_REG_OPCODES(PLZEROW_OPCODE)
+#undef PLZEROW_OPCODE
+  default:
+    return Operands::None;
+  }
+}
+
+constexpr std::size_t register_instruction_size(std::uint8_t instruction) {
+  return layout_size(register_operands(instruction));
+}
+
+} // namespace plzerow
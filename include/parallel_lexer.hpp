@@ -0,0 +1,60 @@
+#pragma once
+
+#include "interner.hpp"
+#include "token.hpp"
+#include <string>
+#include <string_view>
+#include <vector>
+
+namespace plzerow {
+
+// Tokenizes a fully resident source on a thread pool. The source is split
+// into segments at newline boundaries, every segment is lexed independently
+// as if it started outside a comment, and the token arrays are stitched back
+// together with their line numbers rebased.
+//
+// A segment that really starts inside a `{ ... }` comment does not need a
+// second lex: any '}' either closes a comment or is a one-character error
+// token, so the speculative lex is back in the normal state right after the
+// segment's first '}'. Its tokens from there on are exactly what a lexer
+// that started inside the comment would produce.
+//
+// Identifiers are interned into a per-segment table while lexing; the tables
+// are merged into `symbols` in segment order, so symbol ids are assigned in
+// first-occurrence order exactly as a serial Lexer would assign them.
+//
+// The result is identical to Lexer::tokenize() on the same source, including
+// the order of lexical error reports.
+class ParallelLexer {
+public:
+  ParallelLexer(const std::string &filename, std::string_view source,
+                Interner &symbols, unsigned threads);
+
+  std::vector<Token> tokenize();
+
+private:
+  struct Segment {
+    std::string_view text;
+    std::vector<Token> tokens;
+    Interner symbols;
+    // local symbol id -> id in the session interner
+    std::vector<SymbolId> remap;
+    std::vector<SymbolId> first_seen;
+    std::size_t newlines = 0;
+    bool ends_in_comment = false;
+    // line and column of the first '}' in the segment, if any
+    bool has_close = false;
+    std::size_t close_linum = 0;
+    std::size_t close_column = 0;
+  };
+
+  std::vector<std::string_view> split() const;
+  void lex(Segment &segment) const;
+
+  std::string _filename;
+  std::string_view _source;
+  Interner &_symbols;
+  unsigned _threads;
+};
+
+} // namespace plzerow
@@ -1,26 +1,24 @@
 #pragma once
 
+#include "ast.hpp"
 #include "ast_nodes.hpp"
 #include "token.hpp"
-#include <functional>
-#include <memory>
+#include "token_source.hpp"
+#include <string>
+#include <utility>
 #include <vector>
 
-namespace {
-
-using Tokens = std::vector<plzerow::Token>;
-using TokenIterator = Tokens::const_iterator;
-using TokenGenerator = std::function<plzerow::Token()>;
-
-} // namespace
-
 namespace plzerow {
 
-class Parser {
+// Parsers are instantiated in parser.cpp for each token source the compiler
+// uses: the Lexer, TokenArray and TokenPipeline, and for the TokenFunction
+// --bench-parse compares them with.
+template <TokenSource Source> class Parser {
 public:
-  Parser();
-  Parser(TokenGenerator &&next_token);
-  std::unique_ptr<ASTNode> parse();
+  explicit Parser(Source &source);
+  Ast parse();
+  // true once a lexical or syntax error has been seen
+  bool had_error() const;
 
 private:
   const Token &current() const;
@@ -28,32 +26,39 @@ private:
   void expect(TOKEN expected_token);
   void next();
 
-  std::unique_ptr<ASTNode> block();
-  std::unique_ptr<ASTNode> statement();
-  std::unique_ptr<ASTNode> expression();
-  std::unique_ptr<ASTNode> condition();
-  std::unique_ptr<ASTNode> term();
-  std::unique_ptr<ASTNode> factor();
+  NodeIndex block();
+  NodeIndex statement();
+  NodeIndex expression();
+  NodeIndex condition();
+  NodeIndex term();
+  NodeIndex factor();
 
-  std::unique_ptr<ASTNode> make_constant();
-  std::unique_ptr<ASTNode> make_var();
-  std::unique_ptr<ASTNode> make_procedure();
+  NodeIndex make_constant();
+  NodeIndex make_var();
+  NodeIndex make_procedure();
 
   template <typename T, typename... Args>
-  std::unique_ptr<ASTNode> make_node(Args &&...args);
+  NodeIndex make_node(Args &&...args);
+  NodeRange children_since(std::size_t mark);
+  ExprRange operands_since(std::size_t mark);
+  static SourceLoc location(const Token &token);
 
-  void parse_error(const std::string &err) const;
+  void parse_error(const std::string &err);
 
-  std::function<Token()> _next_token;
+  Source &_source;
   Token _current;
   Token _previous;
-  std::unique_ptr<ASTNode> _program;
+  bool _had_error = false;
+  Ast _ast;
+  // child lists under construction, innermost on top
+  std::vector<NodeIndex> _node_scratch;
+  std::vector<Operand> _operand_scratch;
 };
 
+template <TokenSource Source>
 template <typename T, typename... Args>
-std::unique_ptr<ASTNode> Parser::make_node(Args &&...args) {
-  return make_ast_node<T>(current().linum(), current().token_start(),
-                          T{std::forward<Args>(args)...});
+NodeIndex Parser<Source>::make_node(Args &&...args) {
+  return _ast.make_node<T>(location(current()), std::forward<Args>(args)...);
 }
 
 } // namespace plzerow
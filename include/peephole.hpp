@@ -0,0 +1,13 @@
+#pragma once
+
+#include "chunk.hpp"
+
+namespace plzerow {
+
+// Rewrites common instruction sequences of finished stack machine code into
+// superinstructions and drops pushes that are popped right away. Sequences
+// are fused only where no jump lands inside them; jumps, calls and the line
+// table are rewritten to match the new offsets.
+Chunk peephole(const Chunk &code);
+
+} // namespace plzerow
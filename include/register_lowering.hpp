@@ -0,0 +1,18 @@
+#pragma once
+
+#include "chunk.hpp"
+#include <optional>
+
+namespace plzerow {
+
+// Translates stack machine code into the register instruction set. Every
+// stack position of a procedure becomes a temporary register after its
+// variables, and loads of variables and constants are folded into the
+// operands of the instruction that consumes them, so `f := f * n` becomes a
+// single MULTIPLY f, f, n.
+//
+// Returns nullopt if a procedure needs more than 256 registers or a jump
+// no longer fits its 16-bit offset.
+std::optional<Chunk> lower_to_registers(const Chunk &code);
+
+} // namespace plzerow
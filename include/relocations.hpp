@@ -0,0 +1,44 @@
+#pragma once
+
+#include "chunk.hpp"
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+namespace plzerow {
+
+// Passes that rewrite a chunk move its instructions around. They record
+// the new offset of every old instruction and the operands that point at
+// old offsets, and patch those once the whole chunk has been rewritten.
+class Relocations {
+public:
+  enum class Kind : std::uint8_t {
+    Forward,  // 16-bit offset from the end of the operand
+    Backward, // 16-bit offset back from the end of the operand
+    Address,  // 32-bit absolute address
+  };
+
+  explicit Relocations(std::size_t old_size) : _offsets(old_size + 1, 0) {}
+
+  void move(std::size_t old_offset, std::size_t new_offset) {
+    _offsets[old_offset] = new_offset;
+  }
+  void add(std::size_t operand, std::size_t old_target, Kind kind) {
+    _entries.push_back({operand, old_target, kind});
+  }
+
+  // false if a jump no longer fits its 16-bit offset
+  bool apply(Chunk &chunk) const;
+
+private:
+  struct Entry {
+    std::size_t operand;
+    std::size_t target;
+    Kind kind;
+  };
+
+  std::vector<std::size_t> _offsets;
+  std::vector<Entry> _entries;
+};
+
+} // namespace plzerow
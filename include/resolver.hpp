@@ -0,0 +1,85 @@
+#pragma once
+
+#include "ast.hpp"
+#include "ast_nodes.hpp"
+#include "interner.hpp"
+#include <cstddef>
+#include <cstdint>
+#include <optional>
+#include <string>
+#include <utility>
+#include <vector>
+
+namespace plzerow {
+
+// what a name refers to where it is used
+struct Resolution {
+  enum class Kind : std::uint8_t { None, Constant, Variable, Procedure };
+  Kind kind = Kind::None;
+  // static links to follow from the using block to the declaring one
+  std::uint8_t depth = 0;
+  // the constant's value, the variable's frame slot or the procedure's
+  // index, the main program is procedure 0
+  std::int32_t value = 0;
+  // the ConstDecl, VarDecl or Procedure node
+  NodeIndex decl = no_node;
+};
+
+// The names of a program resolved ahead of code generation, indexed by
+// node. Assignment, Call and Primary nodes map to what they name, and
+// declarations to themselves.
+class SymbolTable {
+  friend class Resolver;
+
+public:
+  const Resolution &operator[](NodeIndex node) const;
+  // whether a procedure nested in the variable's block refers to it
+  bool captured(NodeIndex decl) const;
+  // the number of procedures, counting the main program
+  std::size_t procedures() const;
+
+private:
+  std::vector<Resolution> _resolutions;
+  std::vector<bool> _captured;
+  std::size_t _procedures = 0;
+};
+
+// Walks the scopes of the program in the order the code generator does and
+// reports undeclared and redeclared names, assignments to anything but a
+// variable, calls to anything but a procedure, blocks with more than 255
+// variables and references more than 255 levels out.
+class Resolver {
+public:
+  Resolver(const Ast &ast, const Interner &symbols);
+
+  // nullopt if any error was reported
+  std::optional<SymbolTable> resolve();
+
+private:
+  struct Binding {
+    Resolution::Kind kind = Resolution::Kind::None;
+    std::uint32_t level = 0;
+    std::int32_t value = 0;
+    NodeIndex decl = no_node;
+  };
+
+  void block(NodeIndex node);
+  void statement(NodeIndex node);
+  void expression(NodeIndex node);
+  void declare(NodeIndex node, SymbolId name, Binding binding);
+  void close_scope(std::size_t mark);
+  const Resolution *resolve(NodeIndex node, SymbolId name);
+  void error(NodeIndex node, const std::string &message);
+
+  const Ast &_ast;
+  const Interner &_symbols;
+  SymbolTable _table;
+  // innermost binding of every symbol, indexed by SymbolId; entering a
+  // scope saves what its declarations hide and closing it restores them
+  std::vector<Binding> _bindings;
+  std::vector<std::pair<SymbolId, Binding>> _shadowed;
+  std::uint32_t _level = 0;
+  bool _had_error = false;
+};
+
+} // namespace plzerow
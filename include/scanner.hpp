@@ -0,0 +1,41 @@
+#pragma once
+
+#include <cstddef>
+
+namespace plzerow {
+
+// Result of skipping a run of whitespace or comment text. `last_newline` is
+// only meaningful when `newlines` is non-zero.
+struct LineRun {
+  const char *end;
+  std::size_t newlines;
+  const char *last_newline;
+};
+
+// Byte-scanning kernels used by the lexer. Every kernel scans [begin, end)
+// and returns the first position that does not belong to the run (or `end`).
+// The implementation is picked once at startup based on the CPU: AVX2 and
+// SSE2 variants scan 32/16 bytes per step, with a scalar fallback for other
+// architectures and for the tail of the buffer.
+struct ScanKernels {
+  const char *name;
+  LineRun (*skip_whitespace)(const char *begin, const char *end);
+  LineRun (*find_comment_end)(const char *begin, const char *end);
+  const char *(*skip_ident)(const char *begin, const char *end);
+  const char *(*skip_number)(const char *begin, const char *end);
+};
+
+const ScanKernels &scan_kernels();
+const ScanKernels &scalar_scan_kernels();
+
+constexpr bool is_ident_start(char c) {
+  return (c >= 'a' && c <= 'z') || (c >= 'A' && c <= 'Z') || c == '_';
+}
+
+constexpr bool is_digit(char c) { return c >= '0' && c <= '9'; }
+
+constexpr bool is_ident_char(char c) { return is_ident_start(c) || is_digit(c); }
+
+constexpr bool is_number_char(char c) { return is_digit(c) || c == '\''; }
+
+} // namespace plzerow
@@ -0,0 +1,63 @@
+#pragma once
+
+#include <cstddef>
+#include <fstream>
+#include <optional>
+#include <string>
+#include <string_view>
+#include <vector>
+
+namespace plzerow {
+
+// Source text as seen by the Lexer. A buffer either holds the whole program
+// (an owned copy, a borrowed view or a read-only memory mapping of the file)
+// or a sliding window over a file stream.
+//
+// In streaming mode only [data(), data() + size()) is resident. When the
+// lexer runs off the end of the window it calls refill(), which drops the
+// bytes before `keep_from`, moves the rest to the front and reads the next
+// chunk of the file, so memory use is bounded by the window size (or the
+// longest token, whichever is larger). Pointers into the window are
+// invalidated by refill().
+class SourceBuffer {
+public:
+  static constexpr std::size_t default_window_size = 1 << 20;
+
+  SourceBuffer() = default;
+  explicit SourceBuffer(std::vector<char> &&buffer);
+
+  // non-owning, the caller keeps `text` alive
+  static SourceBuffer view(std::string_view text);
+  static std::optional<SourceBuffer> map(const std::string &filename);
+  static std::optional<SourceBuffer>
+  stream(const std::string &filename,
+         std::size_t window_size = default_window_size);
+
+  SourceBuffer(SourceBuffer &&other) noexcept;
+  SourceBuffer &operator=(SourceBuffer &&other) noexcept;
+  SourceBuffer(const SourceBuffer &) = delete;
+  SourceBuffer &operator=(const SourceBuffer &) = delete;
+  ~SourceBuffer();
+
+  const char *data() const;
+  std::size_t size() const;
+
+  // true once every byte of the source has been made available
+  bool exhausted() const;
+
+  // streaming only: returns the number of bytes discarded from the front
+  std::size_t refill(std::size_t keep_from);
+
+private:
+  void release();
+
+  std::vector<char> _buffer;
+  std::ifstream _stream;
+  const char *_data = nullptr;
+  std::size_t _size = 0;
+  void *_mapping = nullptr;
+  std::size_t _mapping_size = 0;
+  bool _exhausted = true;
+};
+
+} // namespace plzerow
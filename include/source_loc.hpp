@@ -0,0 +1,15 @@
+#pragma once
+
+#include <cstdint>
+
+namespace plzerow {
+
+// where in the source something starts, {0, 0} where that is unknown
+struct SourceLoc {
+  std::uint32_t linum;
+  std::uint32_t column;
+
+  friend bool operator==(const SourceLoc &, const SourceLoc &) = default;
+};
+
+} // namespace plzerow
@@ -0,0 +1,49 @@
+#pragma once
+
+#include <condition_variable>
+#include <functional>
+#include <future>
+#include <memory>
+#include <mutex>
+#include <queue>
+#include <thread>
+#include <type_traits>
+#include <vector>
+
+namespace plzerow {
+
+class ThreadPool {
+public:
+  explicit ThreadPool(unsigned threads = std::thread::hardware_concurrency());
+  ThreadPool(const ThreadPool &) = delete;
+  ThreadPool &operator=(const ThreadPool &) = delete;
+  ~ThreadPool();
+
+  template <typename F> auto submit(F &&task);
+
+  unsigned size() const;
+
+private:
+  void run();
+
+  std::vector<std::jthread> _workers;
+  std::queue<std::function<void()>> _tasks;
+  std::mutex _mutex;
+  std::condition_variable _ready;
+  bool _stopping = false;
+};
+
+template <typename F> auto ThreadPool::submit(F &&task) {
+  using Result = std::invoke_result_t<F>;
+  auto packaged =
+      std::make_shared<std::packaged_task<Result()>>(std::forward<F>(task));
+  auto future = packaged->get_future();
+  {
+    std::lock_guard lock{_mutex};
+    _tasks.emplace([packaged]() { (*packaged)(); });
+  }
+  _ready.notify_one();
+  return future;
+}
+
+} // namespace plzerow
@@ -0,0 +1,57 @@
+#pragma once
+
+#include "chunk.hpp"
+#include "value.hpp"
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+namespace plzerow {
+
+// the address of the interpreter's handler for every byte value
+using HandlerTable = std::array<const void *, 256>;
+
+// A stack instruction decoded once: the operands are read into fields,
+// constants are the values themselves and jumps and calls refer to the
+// instruction they land on.
+struct ThreadedInstruction {
+  // the handler run() jumps to, set by bind
+  const void *handler = nullptr;
+  // CONSTANT and CONSTANT_LONG
+  Value constant{std::int32_t{0}};
+  // ADD_CONST, SUBTRACT_CONST and INC_LOCAL
+  std::int32_t number = 0;
+  // jumps and calls, an index into the code
+  std::uint32_t target = 0;
+  std::uint8_t opcode;
+  std::uint8_t hops = 0;
+  // a variable's slot, ENTER's variable count
+  std::uint8_t slot = 0;
+};
+
+/*
+ * The stack instructions of a chunk as threaded code, one entry per
+ * instruction, for --engine=threaded. The chunk stays what is cached and
+ * disassembled; every entry keeps the offset of the instruction it came
+ * from, which is how runtime errors find their line.
+ */
+class ThreadedCode {
+public:
+  ThreadedCode() = default;
+  explicit ThreadedCode(const Chunk &chunk);
+
+  // sets every entry's handler to the one for its opcode
+  void bind(const HandlerTable &handlers);
+
+  const ThreadedInstruction *code() const { return _code.data(); }
+  std::size_t offset(const ThreadedInstruction *instruction) const {
+    return _offsets[instruction - _code.data()];
+  }
+
+private:
+  std::vector<ThreadedInstruction> _code;
+  std::vector<std::uint32_t> _offsets;
+};
+
+} // namespace plzerow
@@ -1,24 +1,44 @@
 #pragma once
 
+#include "interner.hpp"
 #include "token_type.hpp"
+#include <cstdint>
 #include <ostream>
-#include <string>
-#include <utility>
+#include <string_view>
 
 namespace plzerow {
 
+// A token does not own its literal: it is a view into the source buffer held
+// by the Lexer that produced it, and stays valid for as long as that Lexer
+// (or whatever owns its buffer) is alive. Identifiers also carry their
+// interned symbol, which outlives the source, and numbers their value; both
+// share one 32-bit payload.
 class Token {
 public:
   Token(TOKEN token, std::size_t linum, std::size_t token_start)
-      : _token{token}, _literal{""}, _linum{linum}, _token_start{token_start} {}
-  Token(TOKEN token, const std::string &literal, std::size_t linum,
+      : _literal{}, _linum{static_cast<std::uint32_t>(linum)},
+        _token_start{static_cast<std::uint32_t>(token_start)},
+        _payload{no_symbol}, _token{token} {}
+  Token(TOKEN token, std::string_view literal, std::size_t linum,
         std::size_t token_start)
-      : _token{token}, _literal{literal}, _linum{linum},
-        _token_start{token_start} {}
-  Token(TOKEN token, std::string &&literal, std::size_t linum,
-        std::size_t token_start)
-      : _token{token}, _literal{std::move(literal)}, _linum{linum},
-        _token_start{token_start} {}
+      : _literal{literal}, _linum{static_cast<std::uint32_t>(linum)},
+        _token_start{static_cast<std::uint32_t>(token_start)},
+        _payload{no_symbol}, _token{token} {}
+  Token(TOKEN token, std::string_view literal, SymbolId symbol,
+        std::size_t linum, std::size_t token_start)
+      : _literal{literal}, _linum{static_cast<std::uint32_t>(linum)},
+        _token_start{static_cast<std::uint32_t>(token_start)},
+        _payload{symbol}, _token{token} {}
+  Token(TOKEN token, std::string_view literal, std::int32_t number,
+        std::size_t linum, std::size_t token_start)
+      : _literal{literal}, _linum{static_cast<std::uint32_t>(linum)},
+        _token_start{static_cast<std::uint32_t>(token_start)},
+        _payload{static_cast<std::uint32_t>(number)}, _token{token} {}
+  Token(TOKEN token, std::string_view literal, LexError error,
+        std::size_t linum, std::size_t token_start)
+      : _literal{literal}, _linum{static_cast<std::uint32_t>(linum)},
+        _token_start{static_cast<std::uint32_t>(token_start)}, _payload{0},
+        _token{token}, _error{error} {}
 
   Token(const Token &) = default;
   Token(Token &&) noexcept = default;
@@ -27,17 +47,23 @@ public:
   ~Token() = default;
 
   TOKEN type() const;
-  const std::string &literal() const;
+  std::string_view literal() const;
+  SymbolId symbol() const;
+  std::int32_t number() const;
   std::size_t linum() const;
   std::size_t token_start() const;
+  // reported by the lexer, or by whatever defers its reports
+  LexError error() const;
 
   friend std::ostream &operator<<(std::ostream &os, const Token &lexeme);
 
 private:
+  std::string_view _literal;
+  std::uint32_t _linum;
+  std::uint32_t _token_start;
+  std::uint32_t _payload;
   TOKEN _token;
-  std::string _literal;
-  std::size_t _linum;
-  std::size_t _token_start;
+  LexError _error = LexError::NONE;
 };
 
 } // namespace plzerow
@@ -0,0 +1,51 @@
+#pragma once
+
+#include "lexer.hpp"
+#include "token.hpp"
+#include "token_queue.hpp"
+#include <cstddef>
+#include <string>
+#include <thread>
+#include <vector>
+
+namespace plzerow {
+
+// Runs a Lexer on its own thread and hands its tokens to the Parser through
+// a TokenQueue, so lexing the rest of the file overlaps with parsing.
+//
+// The lexer must own a fully resident source: tokens sit in the queue while
+// the lexer moves on, and a streaming window would invalidate their literals.
+// Lexical errors are reported when the parser pulls the offending token,
+// which keeps them interleaved with parse errors exactly as in serial mode.
+//
+// The lexer thread stops after ENDFILE or the first ERROR token. The parser
+// does not consume an ERROR token, so it rarely asks for more; if it does,
+// the rest of the file is lexed on its thread, one token per call, so the
+// diagnostics still match serial mode. Destroying the pipeline earlier, e.g.
+// when the parser stops at the program's final '.', closes the queue and
+// joins the thread. Out-of-range number literals are NUMBER tokens and do
+// not stop the lexer thread.
+class TokenPipeline {
+public:
+  TokenPipeline(Lexer &lexer, const std::string &filename);
+  TokenPipeline(const TokenPipeline &) = delete;
+  TokenPipeline &operator=(const TokenPipeline &) = delete;
+  ~TokenPipeline();
+
+  const Token &next();
+
+private:
+  void produce();
+
+  Lexer &_lexer;
+  std::string _filename;
+  TokenQueue _queue;
+  const std::vector<Token> *_batch = nullptr;
+  std::size_t _next = 0;
+  // set once the ERROR token the producer stopped at has been pulled
+  bool _lex_here = false;
+  Token _pulled{TOKEN::ENDFILE, 0, 0};
+  std::jthread _producer;
+};
+
+} // namespace plzerow
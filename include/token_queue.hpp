@@ -0,0 +1,47 @@
+#pragma once
+
+#include "token.hpp"
+#include <array>
+#include <atomic>
+#include <cstddef>
+#include <vector>
+
+namespace plzerow {
+
+// Bounded single-producer/single-consumer ring of token batches. Slots are
+// vectors that keep their capacity, so once every slot has been filled the
+// queue allocates nothing. Each side only blocks when the ring is full or
+// empty, which throttles the lexer to the parser's pace; both waits are
+// futex-backed atomic waits, no lock is ever taken.
+class TokenQueue {
+public:
+  static constexpr std::size_t batch_size = 1024;
+  static constexpr std::size_t capacity = 8;
+
+  TokenQueue();
+  TokenQueue(const TokenQueue &) = delete;
+  TokenQueue &operator=(const TokenQueue &) = delete;
+
+  // producer: the next free slot, emptied, or nullptr once the consumer
+  // has closed the queue
+  std::vector<Token> *acquire();
+  void publish();
+
+  // consumer: the oldest published batch, waiting for one if needed
+  const std::vector<Token> &front();
+  void pop();
+  // stops the producer at its next acquire(), unblocking it if it waits
+  void close();
+
+private:
+  std::array<std::vector<Token>, capacity> _slots;
+
+  // both counters only grow; a slot is counter % capacity
+  alignas(64) std::atomic<std::size_t> _head = 0;
+  std::size_t _cached_tail = 0;
+  alignas(64) std::atomic<std::size_t> _tail = 0;
+  std::size_t _cached_head = 0;
+  alignas(64) std::atomic<bool> _closed = false;
+};
+
+} // namespace plzerow
@@ -0,0 +1,61 @@
+#pragma once
+
+#include "token.hpp"
+#include "token_type.hpp"
+#include <algorithm>
+#include <concepts>
+#include <cstddef>
+#include <functional>
+#include <span>
+#include <utility>
+
+namespace plzerow {
+
+// Anything the Parser can pull tokens from. The Parser is instantiated per
+// source type, so next() is a direct call rather than a type-erased one.
+// A source keeps returning ENDFILE once it is exhausted.
+template <typename T>
+concept TokenSource = requires(T source) {
+  { source.next() } -> std::convertible_to<Token>;
+};
+
+// Serves an already tokenized program, e.g. from the ParallelLexer. The array
+// must end in ENDFILE. Being an array, any lookahead is a single index.
+class TokenArray {
+public:
+  explicit TokenArray(std::span<const Token> tokens) : _tokens{tokens} {}
+
+  const Token &next() {
+    const auto &token = peek();
+    _next = std::min(_next + 1, _tokens.size() - 1);
+    return token;
+  }
+
+  const Token &peek(std::size_t ahead = 0) const {
+    return _tokens[std::min(_next + ahead, _tokens.size() - 1)];
+  }
+
+private:
+  std::span<const Token> _tokens;
+  std::size_t _next = 0;
+};
+
+static_assert(TokenSource<TokenArray>);
+
+// Pulls tokens through a std::function, the way the Parser did before it
+// was templated on its source. Only --bench-parse uses it, to show what the
+// direct call saves.
+class TokenFunction {
+public:
+  explicit TokenFunction(std::function<const Token &()> next)
+      : _next{std::move(next)} {}
+
+  const Token &next() { return _next(); }
+
+private:
+  std::function<const Token &()> _next;
+};
+
+static_assert(TokenSource<TokenFunction>);
+
+} // namespace plzerow
@@ -2,7 +2,7 @@
 
 namespace plzerow {
 
-enum class TOKEN {
+enum class TOKEN : char {
   PROGRAM,
   IDENT = 'I',
   NUMBER = 'N',
@@ -36,4 +36,13 @@ enum class TOKEN {
   UNKNOWN,
 };
 
+// What the lexer rejected in a token. An unexpected character becomes an
+// ERROR token; a number literal out of range stays a NUMBER, valued 0, so
+// the parser goes on without reporting errors of its own.
+enum class LexError : char {
+  NONE,
+  UNEXPECTED_CHARACTER,
+  NUMBER_OUT_OF_RANGE,
+};
+
 }
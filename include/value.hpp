@@ -2,7 +2,9 @@
 
 #include <cstdint>
 #include <iostream>
+#include <optional>
 #include <ostream>
+#include <unordered_map>
 #include <utility>
 #include <variant>
 #include <vector>
@@ -28,6 +30,8 @@ using Value = std::variant<double, std::int32_t>;
 using ValueContainer = std::vector<Value>;
 using ValuePointer = ValueContainer::const_pointer;
 
+// A constant pool that keeps every distinct value once. Values are the same
+// if they have the same type and bits, so 0.0 and -0.0 stay apart.
 class ValueArray {
 public:
   const std::vector<Value> &values() const;
@@ -35,10 +39,20 @@ public:
 
   template <typename Visitor>
   auto visit(std::size_t index, Visitor &&visitor) const;
+  std::optional<std::size_t> find(const Value &value) const;
+  // the index of the same value if there is one, else of value appended
   std::size_t append(const Value &value);
 
 private:
+  struct Hash {
+    std::size_t operator()(const Value &value) const;
+  };
+  struct Same {
+    bool operator()(const Value &lhs, const Value &rhs) const;
+  };
+
   std::vector<Value> _values;
+  std::unordered_map<Value, std::size_t, Hash, Same> _indices;
 };
 
 template <typename T> T ValueArray::at(std::size_t index) const {
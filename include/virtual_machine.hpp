@@ -1,48 +1,83 @@
 #pragma once
 
+#include "bytecode_cache.hpp"
 #include "chunk.hpp"
 #include "compiler.hpp"
+#include "inputhandler.hpp"
+#include "native_build.hpp"
+#include "opcodes.hpp"
+#include "threaded_code.hpp"
 #include "value.hpp"
 #include <cstdint>
+#include <optional>
 #include <stack>
+#include <string>
 #include <utility>
+#include <vector>
 
 namespace plzerow {
 
-enum OP_CODE : std::uint8_t {
-  OP_RETURN,
-  OP_CONSTANT,
-  OP_CONSTANT_LONG,
-  OP_NEGATE,
-  OP_ADD,
-  OP_MULTIPLY,
-  OP_SUBTRACT,
-  OP_DIVIDE
-};
-
 enum class InterpretResult { OK, COMPILE_ERROR, RUNTIME_ERROR };
 
 class VM {
 public:
   VM() = default;
-  VM(Chunk &&chunk) : _chunk{std::forward<Chunk>(chunk)} {
-    _ip = _chunk.cbegin();
-  };
+  VM(CompilerOptions options);
+  VM(Chunk &&chunk) { load(std::forward<Chunk>(chunk)); };
   InterpretResult run();
 
   void repl();
-  void runfile(const std::string &filename);
+  // NativeCheck::Same unless --native-verify found otherwise
+  NativeCheck runfile(const std::string &filename,
+                      InputMode input_mode = InputMode::Map);
 
 private:
+  // one procedure activation; variables live in _variables from base on
+  struct Frame {
+    std::size_t base;
+    // the frame of the lexically enclosing procedure
+    std::size_t static_link;
+    InstructionPointer return_address;
+  };
+
+  void load(Chunk &&chunk);
+  void execute(CompilerResult result);
+  NativeCheck translate(const std::string &filename, InputMode input_mode);
+  NativeCheck verify_native(const std::string &c_source);
+  InterpretResult run_stack();
+  InterpretResult run_registers();
+  InterpretResult run_jit();
+  InterpretResult run_threaded();
+
   InstructionPointer next();
   std::uint8_t next_test();
+  std::uint16_t read_short();
+  std::uint32_t read_long_constant();
+  std::uint32_t read_address();
 
   Value pop_stack();
+  std::int32_t pop_number();
+  Value &variable(std::size_t hops, std::uint8_t slot);
+  std::int32_t &variable_register(std::size_t hops, std::uint8_t slot);
+  InterpretResult runtime_error(const std::string &err) const;
+  void print_globals() const;
 
   InstructionPointer _ip;
   Chunk _chunk;
   std::stack<Value> _stack;
+  std::vector<Frame> _frames;
+  std::vector<Value> _variables;
+  // the register engine's frames hold their variables and temporaries in
+  // _registers, constants are converted once when the chunk is loaded
+  Engine _engine = Engine::Stack;
+  bool _jit_verify = false;
+  NativeOptions _native;
+  std::vector<std::int32_t> _registers;
+  std::vector<std::int32_t> _numbers;
+  // the chunk decoded for the threaded engine
+  ThreadedCode _threaded;
   Compiler _compiler;
+  std::optional<BytecodeCache> _cache;
 };
 
 } // namespace plzerow
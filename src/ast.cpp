@@ -0,0 +1,42 @@
+#include "ast.hpp"
+
+namespace plzerow {
+
+NodeRange Ast::add_children(std::span<const NodeIndex> children) {
+  const NodeRange range{static_cast<std::uint32_t>(_children.size()),
+                        static_cast<std::uint32_t>(children.size())};
+  _children.insert(_children.end(), children.begin(), children.end());
+  return range;
+}
+
+ExprRange Ast::add_operands(std::span<const Operand> operands) {
+  const ExprRange range{static_cast<std::uint32_t>(_operands.size()),
+                        static_cast<std::uint32_t>(operands.size())};
+  _operands.insert(_operands.end(), operands.begin(), operands.end());
+  return range;
+}
+
+const ASTNode &Ast::operator[](NodeIndex node) const { return _nodes[node]; }
+
+std::span<const NodeIndex> Ast::children(NodeRange range) const {
+  return std::span{_children}.subspan(range.first, range.count);
+}
+
+std::span<const Operand> Ast::operands(ExprRange range) const {
+  return std::span{_operands}.subspan(range.first, range.count);
+}
+
+NodeIndex Ast::root() const { return _root; }
+
+void Ast::set_root(NodeIndex root) { _root = root; }
+
+std::size_t Ast::size() const { return _nodes.size(); }
+
+void Ast::clear() {
+  _nodes.clear();
+  _children.clear();
+  _operands.clear();
+  _root = no_node;
+}
+
+} // namespace plzerow
@@ -0,0 +1,229 @@
+#include "benchmark.hpp"
+#include "inputhandler.hpp"
+#include "interner.hpp"
+#include "lexer.hpp"
+#include "parser.hpp"
+#include "scanner.hpp"
+#include "source_buffer.hpp"
+#include "token_pipeline.hpp"
+#include "token_source.hpp"
+#include <algorithm>
+#include <cctype>
+#include <chrono>
+#include <fmt/core.h>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+namespace {
+
+constexpr int runs = 5;
+
+// the best of runs calls of run in seconds
+template <typename Run> double best_time(Run &&run) {
+  auto best = std::chrono::steady_clock::duration::max();
+  for (int i = 0; i < runs; ++i) {
+    const auto start = std::chrono::steady_clock::now();
+    run();
+    best = std::min(best, std::chrono::steady_clock::now() - start);
+  }
+  return std::chrono::duration<double>(best).count();
+}
+
+/*
+ * The scan the lexer did before the kernels, kept as the reference they are
+ * measured against: it went through peek() a byte at a time, bounds checking
+ * every byte and classifying it with <cctype>.
+ */
+
+char peek(const char *p, const char *end) { return p < end ? *p : '\0'; }
+
+plzerow::LineRun skip_whitespace_baseline(const char *begin, const char *end) {
+  plzerow::LineRun run{begin, 0, nullptr};
+  for (;; ++run.end) {
+    switch (peek(run.end, end)) {
+    case ' ':
+    case '\r':
+    case '\t':
+      break;
+    case '\n':
+      ++run.newlines;
+      run.last_newline = run.end;
+      break;
+    default:
+      return run;
+    }
+  }
+}
+
+plzerow::LineRun find_comment_end_baseline(const char *begin,
+                                           const char *end) {
+  plzerow::LineRun run{begin, 0, nullptr};
+  for (; run.end < end && peek(run.end, end) != '}'; ++run.end) {
+    if (peek(run.end, end) == '\n') {
+      ++run.newlines;
+      run.last_newline = run.end;
+    }
+  }
+  return run;
+}
+
+const char *skip_ident_baseline(const char *begin, const char *end) {
+  const char *p = begin;
+  while (std::isalnum(static_cast<unsigned char>(peek(p, end))) != 0 ||
+         peek(p, end) == '_') {
+    ++p;
+  }
+  return p;
+}
+
+const char *skip_number_baseline(const char *begin, const char *end) {
+  const char *p = begin;
+  while (std::isdigit(static_cast<unsigned char>(peek(p, end))) != 0 ||
+         peek(p, end) == '\'') {
+    ++p;
+  }
+  return p;
+}
+
+constexpr plzerow::ScanKernels baseline_kernels{
+    "baseline", skip_whitespace_baseline, find_comment_end_baseline,
+    skip_ident_baseline, skip_number_baseline};
+
+// Classifies every word of the source with keyword_or_ident and with the
+// lookup the lexer used before it, which copied the word into a std::string
+// and searched a std::unordered_map. The copy is counted, since the lookup
+// needed it.
+void bench_keywords(const std::vector<char> &source) {
+  using plzerow::TOKEN;
+  plzerow::Interner symbols;
+  plzerow::Lexer lexer{"", plzerow::SourceBuffer{std::vector<char>{source}},
+                       &symbols};
+  std::vector<std::string_view> words;
+  for (const auto &token : lexer.tokenize()) {
+    const auto literal = token.literal();
+    if (!literal.empty() &&
+        (std::isalpha(static_cast<unsigned char>(literal.front())) != 0 ||
+         literal.front() == '_')) {
+      words.push_back(literal);
+    }
+  }
+  const auto millions = static_cast<double>(words.size()) / 1e6;
+  // the keywords found are printed, so the loops cannot be dropped
+  std::size_t found = 0;
+  const auto report = [&](const char *variant, double seconds) {
+    fmt::print("keywords {:<13} {:10} words {:8} keywords {:8.1f} Mwords/s\n",
+               variant, words.size(), found, millions / seconds);
+  };
+
+  const auto hashed = best_time([&] {
+    found = 0;
+    for (const auto word : words) {
+      found += plzerow::keyword_or_ident(word) != TOKEN::IDENT;
+    }
+  });
+  report("perfect-hash", hashed);
+  std::unordered_map<std::string, TOKEN> map;
+  for (const auto &keyword : plzerow::keywords) {
+    map.emplace(keyword.text, keyword.token);
+  }
+  const auto mapped = best_time([&] {
+    found = 0;
+    for (const auto word : words) {
+      const auto it = map.find(std::string{word});
+      found += it != map.end();
+    }
+  });
+  report("unordered-map", mapped);
+}
+
+} // namespace
+
+namespace plzerow {
+
+// The source is copied for every run, which costs well under a percent of
+// the time the lexer takes over it. Every kernel set is reported against the
+// byte-at-a-time baseline, which runs first.
+void bench_lex(const std::string &filename) {
+  const auto source = InputHandler::read_from_file(filename);
+  const auto megabytes = static_cast<double>(source.size()) / 1e6;
+  std::vector<const ScanKernels *> variants{&baseline_kernels,
+                                            &scalar_scan_kernels()};
+  if (&scan_kernels() != &scalar_scan_kernels()) {
+    variants.push_back(&scan_kernels());
+  }
+  double baseline = 0;
+  for (const auto *kernels : variants) {
+    std::size_t tokens = 0;
+    const auto seconds = best_time([&] {
+      Interner symbols;
+      Lexer lexer{filename, SourceBuffer{std::vector<char>{source}},
+                  &symbols};
+      lexer.set_scan_kernels(*kernels);
+      tokens = lexer.tokenize().size();
+    });
+    if (kernels == &baseline_kernels) {
+      baseline = seconds;
+    }
+    fmt::print("lex {:<8} {:10} tokens {:8.1f} MB/s {:5.2f}x baseline\n",
+               kernels->name, tokens, megabytes / seconds, baseline / seconds);
+  }
+  bench_keywords(source);
+}
+
+// Parser<TokenArray> runs on tokens lexed once up front, Parser<Lexer>
+// pulls them as the compiler does by default, Parser<TokenFunction> pulls
+// them from the same Lexer through std::function as it did before the
+// parser was templated, and Parser<TokenPipeline> pulls them as it does
+// with --pipeline, lexing on a second thread. The source is resident
+// here; the compiler only pipelines sources that are, so --input=stream on a
+// file larger than its window always lexes serially.
+void bench_parse(const std::string &filename) {
+  const auto source = InputHandler::read_from_file(filename);
+  Interner symbols;
+  Lexer lexer{filename, SourceBuffer{std::vector<char>{source}}, &symbols};
+  const auto tokens = lexer.tokenize();
+  const auto millions = static_cast<double>(tokens.size()) / 1e6;
+  const auto report = [&](const char *variant, double seconds) {
+    fmt::print("parse {:<8} {:10} tokens {:8.2f} Mtokens/s\n", variant,
+               tokens.size(), millions / seconds);
+  };
+
+  const auto from_tokens = best_time([&] {
+    TokenArray array{tokens};
+    Parser parser{array};
+    parser.parse();
+  });
+  report("tokens", from_tokens);
+  const auto from_lexer = best_time([&] {
+    Interner names;
+    Lexer pulled{filename, SourceBuffer{std::vector<char>{source}}, &names};
+    Parser parser{pulled};
+    parser.parse();
+  });
+  report("lexer", from_lexer);
+  const auto from_function = best_time([&] {
+    Interner names;
+    Lexer pulled{filename, SourceBuffer{std::vector<char>{source}}, &names};
+    Token token{TOKEN::ENDFILE, 0, 0};
+    TokenFunction function{[&]() -> const Token & {
+      token = pulled.next();
+      return token;
+    }};
+    Parser parser{function};
+    parser.parse();
+  });
+  report("function", from_function);
+  const auto pipelined = best_time([&] {
+    Interner names;
+    Lexer pulled{filename, SourceBuffer{std::vector<char>{source}}, &names};
+    TokenPipeline pipeline{pulled, filename};
+    Parser parser{pipeline};
+    parser.parse();
+  });
+  report("pipeline", pipelined);
+}
+
+} // namespace plzerow
@@ -0,0 +1,258 @@
+#include "bytecode_cache.hpp"
+#include "source_buffer.hpp"
+#include "value.hpp"
+#include <array>
+#include <cstring>
+#include <filesystem>
+#include <fmt/core.h>
+#include <fstream>
+#include <limits>
+#include <memory>
+#include <optional>
+#include <random>
+#include <string_view>
+#include <type_traits>
+#include <utility>
+#include <variant>
+
+#ifndef PLZEROW_VERSION
+#define PLZEROW_VERSION "unknown"
+#endif
+
+namespace {
+
+constexpr std::array<char, 8> magic{'P', 'L', 'Z', 'E', 'R', 'O', 'W', 'B'};
+constexpr std::uint32_t byte_order = 0x01020304;
+
+struct Header {
+  std::array<char, 8> magic;
+  std::uint32_t version;
+  std::uint32_t byte_order;
+  std::uint64_t key;
+  // of everything after the header
+  std::uint64_t checksum;
+  std::uint32_t code_size;
+  std::uint32_t debug_count;
+  std::uint32_t constant_count;
+  std::uint32_t constants_size;
+  // the names, each terminated by a NUL
+  std::uint32_t globals_size;
+  std::uint32_t unused;
+};
+static_assert(std::is_trivially_copyable_v<Header> && sizeof(Header) == 56);
+static_assert(std::is_trivially_copyable_v<plzerow::DebugEntry> &&
+              sizeof(plzerow::DebugEntry) == 12);
+
+// FNV-1a
+std::uint64_t hash(std::string_view bytes,
+                   std::uint64_t seed = 0xcbf29ce484222325) {
+  for (const auto byte : bytes) {
+    seed ^= static_cast<std::uint8_t>(byte);
+    seed *= 0x100000001b3;
+  }
+  return seed;
+}
+
+// the debug table that follows the code stays 4-byte aligned in the mapping
+std::size_t padded(std::size_t code_size) { return (code_size + 3) & ~3uz; }
+
+template <typename T> void append(std::string &out, const T &value) {
+  out.append(reinterpret_cast<const char *>(&value), sizeof value);
+}
+
+// a constant is tagged with the index of its alternative in Value
+void append_constant(std::string &out, const plzerow::Value &value) {
+  out.push_back(static_cast<char>(value.index()));
+  if (const auto *number = std::get_if<double>(&value)) {
+    append(out, *number);
+    return;
+  }
+  const auto number = std::get<std::int32_t>(value);
+  auto zigzag = static_cast<std::uint32_t>(number) << 1 ^
+                static_cast<std::uint32_t>(number >> 31);
+  for (; zigzag >= 0x80; zigzag >>= 7) {
+    out.push_back(static_cast<char>(zigzag | 0x80));
+  }
+  out.push_back(static_cast<char>(zigzag));
+}
+
+// the constant at the start of bytes, advanced past it, nullopt if it is
+// malformed or runs past the end
+std::optional<plzerow::Value> read_constant(std::string_view &bytes) {
+  if (bytes.empty()) {
+    return std::nullopt;
+  }
+  const auto type = bytes.front();
+  bytes.remove_prefix(1);
+  if (type == 0) {
+    double number;
+    if (bytes.size() < sizeof number) {
+      return std::nullopt;
+    }
+    std::memcpy(&number, bytes.data(), sizeof number);
+    bytes.remove_prefix(sizeof number);
+    return plzerow::Value{number};
+  }
+  if (type != 1) {
+    return std::nullopt;
+  }
+  std::uint32_t zigzag = 0;
+  for (unsigned shift = 0;; shift += 7) {
+    if (bytes.empty() || shift > 28) {
+      return std::nullopt;
+    }
+    const auto byte = static_cast<std::uint8_t>(bytes.front());
+    bytes.remove_prefix(1);
+    zigzag |= static_cast<std::uint32_t>(byte & 0x7f) << shift;
+    if ((byte & 0x80) == 0) {
+      break;
+    }
+  }
+  return plzerow::Value{
+      static_cast<std::int32_t>(zigzag >> 1 ^ (0u - (zigzag & 1)))};
+}
+
+} // namespace
+
+namespace plzerow {
+
+bool BytecodeFile::write(const std::string &path, const Chunk &chunk,
+                         std::uint64_t key) {
+  if (chunk.size() > std::numeric_limits<std::uint32_t>::max()) {
+    return false;
+  }
+  std::string payload{reinterpret_cast<const char *>(chunk.cbegin()),
+                      chunk.size()};
+  payload.resize(padded(chunk.size()), '\0');
+  const auto debug_info = chunk.debug_info();
+  payload.append(reinterpret_cast<const char *>(debug_info.data()),
+                 debug_info.size_bytes());
+  const auto constants_start = payload.size();
+  for (const auto &value : chunk._constants.values()) {
+    append_constant(payload, value);
+  }
+  const auto names_start = payload.size();
+  for (const auto &name : chunk.globals()) {
+    payload.append(name);
+    payload.push_back('\0');
+  }
+
+  const Header header{
+      magic,
+      bytecode_version,
+      byte_order,
+      key,
+      hash(payload),
+      static_cast<std::uint32_t>(chunk.size()),
+      static_cast<std::uint32_t>(debug_info.size()),
+      static_cast<std::uint32_t>(chunk.constant_count()),
+      static_cast<std::uint32_t>(names_start - constants_start),
+      static_cast<std::uint32_t>(payload.size() - names_start),
+      0,
+  };
+  std::string contents;
+  append(contents, header);
+  std::ofstream out{path, std::ios::binary};
+  out.write(contents.data(), static_cast<std::streamsize>(contents.size()));
+  out.write(payload.data(), static_cast<std::streamsize>(payload.size()));
+  out.close();
+  return !out.fail();
+}
+
+std::optional<Chunk> BytecodeFile::map(const std::string &path,
+                                       std::uint64_t key) {
+  auto file = SourceBuffer::map(path);
+  if (!file || file->size() < sizeof(Header)) {
+    return std::nullopt;
+  }
+  Header header;
+  std::memcpy(&header, file->data(), sizeof header);
+  if (header.magic != magic || header.version != bytecode_version ||
+      header.byte_order != byte_order || header.key != key) {
+    return std::nullopt;
+  }
+  const auto debug_offset = padded(header.code_size);
+  const auto constants_offset =
+      debug_offset + std::size_t{header.debug_count} * sizeof(DebugEntry);
+  const auto names_offset = constants_offset + header.constants_size;
+  const auto payload_size = names_offset + header.globals_size;
+  if (file->size() != sizeof(Header) + payload_size) {
+    return std::nullopt;
+  }
+  const auto mapping = std::make_shared<const SourceBuffer>(std::move(*file));
+  const auto *payload = mapping->data() + sizeof(Header);
+  if (hash({payload, payload_size}) != header.checksum ||
+      (header.globals_size > 0 && payload[payload_size - 1] != '\0')) {
+    return std::nullopt;
+  }
+
+  Chunk chunk;
+  std::string_view constants{payload + constants_offset, header.constants_size};
+  for (std::size_t i = 0; i < header.constant_count; ++i) {
+    const auto constant = read_constant(constants);
+    // the pool keeps values once, a repeated one would shift the indices
+    if (!constant || chunk.add_constant(*constant) != i) {
+      return std::nullopt;
+    }
+  }
+  if (!constants.empty()) {
+    return std::nullopt;
+  }
+  for (auto offset = names_offset; offset < payload_size;) {
+    const std::string_view name{payload + offset};
+    chunk.add_global(name);
+    offset += name.size() + 1;
+  }
+  chunk._mapped_instructions = {
+      reinterpret_cast<const std::uint8_t *>(payload), header.code_size};
+  chunk._mapped_debug_info = {
+      reinterpret_cast<const DebugEntry *>(payload + debug_offset),
+      header.debug_count};
+  chunk._mapping = mapping;
+  return chunk;
+}
+
+BytecodeCache::BytecodeCache(std::string directory,
+                             const CompilerOptions &options)
+    : _directory{std::move(directory)},
+      _seed{hash(fmt::format("{} {} {} {} {} {}", PLZEROW_VERSION,
+                             bytecode_version,
+                             static_cast<int>(options.engine),
+                             options.opt_level, options.inline_threshold,
+                             options.inline_budget))} {}
+
+std::uint64_t BytecodeCache::key(std::string_view source) const {
+  return hash(source, _seed);
+}
+
+std::optional<Chunk> BytecodeCache::load(std::uint64_t key) const {
+  return BytecodeFile::map(path(key), key);
+}
+
+// Written under a temporary name and renamed into place, so a run that
+// starts meanwhile maps either nothing or the whole file.
+void BytecodeCache::store(std::uint64_t key, const Chunk &chunk) const {
+  std::error_code error;
+  std::filesystem::create_directories(_directory, error);
+  if (error) {
+    return;
+  }
+  const auto target = path(key);
+  const auto temporary =
+      fmt::format("{}.{:08x}.tmp", target, std::random_device{}());
+  if (!BytecodeFile::write(temporary, chunk, key)) {
+    std::filesystem::remove(temporary, error);
+    return;
+  }
+  std::filesystem::rename(temporary, target, error);
+  if (error) {
+    std::filesystem::remove(temporary, error);
+  }
+}
+
+std::string BytecodeCache::path(std::uint64_t key) const {
+  return (std::filesystem::path{_directory} / fmt::format("{:016x}.plzc", key))
+      .string();
+}
+
+} // namespace plzerow
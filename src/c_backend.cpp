@@ -0,0 +1,463 @@
+#include "c_backend.hpp"
+#include "code_generator.hpp"
+#include <algorithm>
+#include <fmt/core.h>
+#include <limits>
+#include <string_view>
+#include <variant>
+
+namespace {
+
+constexpr std::string_view prologue = R"(/* Generated by plzerow. */
+
+#include <inttypes.h>
+#include <setjmp.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+
+/* the stack the program's calls may use, main runs it on a thread of this
+   size and plzerow_run on the caller's thread */
+#ifndef PLZEROW_STACK_SIZE
+#if defined(PLZEROW_NO_MAIN) || !(defined(__unix__) || defined(__APPLE__))
+#define PLZEROW_STACK_SIZE ((size_t)1 << 20)
+#else
+#define PLZEROW_STACK_SIZE ((size_t)1 << 30)
+#endif
+#endif
+)";
+
+constexpr std::string_view runtime = R"(
+static jmp_buf pl0_unwind;
+static size_t pl0_depth;
+
+static _Noreturn void pl0_fail(unsigned long line, const char *message) {
+  fprintf(stderr, "[RUNTIME_ERROR] [line %lu] %s\n", line, message);
+  longjmp(pl0_unwind, 1);
+}
+
+/* PL/0 integers are 32-bit and wrap on overflow */
+static inline int32_t pl0_add(int32_t lhs, int32_t rhs) {
+  return (int32_t)((uint32_t)lhs + (uint32_t)rhs);
+}
+
+static inline int32_t pl0_sub(int32_t lhs, int32_t rhs) {
+  return (int32_t)((uint32_t)lhs - (uint32_t)rhs);
+}
+
+static inline int32_t pl0_mul(int32_t lhs, int32_t rhs) {
+  return (int32_t)((uint32_t)lhs * (uint32_t)rhs);
+}
+
+static inline int32_t pl0_neg(int32_t value) { return pl0_sub(0, value); }
+
+static inline int32_t pl0_div(int32_t lhs, int32_t rhs, unsigned long line) {
+  if (rhs == 0) {
+    pl0_fail(line, "division by zero");
+  }
+  return rhs == -1 ? pl0_neg(lhs) : lhs / rhs;
+}
+
+static inline void pl0_enter(unsigned long line) {
+  if (++pl0_depth > PLZEROW_MAX_DEPTH) {
+    pl0_fail(line, "stack overflow");
+  }
+}
+)";
+
+constexpr std::string_view main_function = R"(
+#ifndef PLZEROW_NO_MAIN
+
+#if defined(__unix__) || defined(__APPLE__)
+#include <pthread.h>
+#endif
+
+static int32_t pl0_globals[sizeof plzerow_global_names /
+                           sizeof plzerow_global_names[0]];
+static int pl0_status;
+
+static void *pl0_thread(void *unused) {
+  pl0_status = plzerow_run(pl0_globals);
+  return unused;
+}
+
+int main(void) {
+  size_t i;
+#if defined(__unix__) || defined(__APPLE__)
+  pthread_attr_t attributes;
+  pthread_t thread;
+  if (pthread_attr_init(&attributes) != 0 ||
+      pthread_attr_setstacksize(&attributes, PLZEROW_STACK_SIZE) != 0 ||
+      pthread_create(&thread, &attributes, pl0_thread, NULL) != 0 ||
+      pthread_join(thread, NULL) != 0) {
+    fputs("unable to start the program\n", stderr);
+    return 1;
+  }
+#else
+  pl0_thread(NULL);
+#endif
+  if (pl0_status != 0) {
+    return 1;
+  }
+  for (i = 0; i < plzerow_global_count; ++i) {
+    printf("%s = %" PRId32 "\n", plzerow_global_names[i], pl0_globals[i]);
+  }
+  return 0;
+}
+
+#endif
+)";
+
+std::string literal(std::int32_t value) {
+  // -2147483648 is the negation of a constant that does not fit an int
+  if (value == std::numeric_limits<std::int32_t>::min()) {
+    return "INT32_MIN";
+  }
+  return fmt::format("{}", value);
+}
+
+std::string_view arithmetic_function(plzerow::TOKEN op) {
+  switch (op) {
+  case plzerow::TOKEN::PLUS:
+    return "pl0_add";
+  case plzerow::TOKEN::MINUS:
+    return "pl0_sub";
+  case plzerow::TOKEN::MULTIPLY:
+    return "pl0_mul";
+  default:
+    return "pl0_div";
+  }
+}
+
+std::string_view comparison_operator(plzerow::TOKEN op) {
+  switch (op) {
+  case plzerow::TOKEN::EQUAL:
+    return "==";
+  case plzerow::TOKEN::HASH:
+    return "!=";
+  case plzerow::TOKEN::LESSTHAN:
+    return "<";
+  default:
+    return ">";
+  }
+}
+
+} // namespace
+
+namespace plzerow {
+
+CBackend::CBackend(const Ast &ast, const SymbolTable &table,
+                   const Interner &symbols)
+    : _ast{ast}, _table{table}, _symbols{symbols} {}
+
+std::string CBackend::translate() {
+  _functions.assign(_table.procedures(), Function{});
+  _declarations.clear();
+  _definitions.clear();
+  _largest_frame = 0;
+
+  const auto main = std::get<Program>(_ast[_ast.root()]._value)._block;
+  collect(main, 0, -1, 0, "main");
+  _declarations += "\n";
+  for (std::size_t i = 1; i < _functions.size(); ++i) {
+    _declarations += signature(_functions[i], i) + ";\n";
+  }
+
+  const auto &program = std::get<Block>(_ast[main]._value);
+  std::string names;
+  std::string resets;
+  std::string stores;
+  std::size_t slot = 0;
+  _declarations += "\n/* the main program's variables */\n";
+  for (const auto v : _ast.children(program._varDecls)) {
+    const auto name = _symbols.name(std::get<VarDecl>(_ast[v]._value)._name);
+    _declarations += fmt::format("static int32_t g_{};\n", name);
+    names += fmt::format("\"{}\", ", name);
+    resets += fmt::format("  g_{} = 0;\n", name);
+    stores += fmt::format("  globals[{}] = g_{};\n", slot++, name);
+  }
+  for (std::size_t i = 0; i < _functions.size(); ++i) {
+    define(_functions[i], i);
+  }
+
+  auto out = std::string{prologue};
+  // bytes of stack per call, generously, from the largest procedure
+  out += fmt::format("#define PLZEROW_MAX_DEPTH (PLZEROW_STACK_SIZE / {})\n",
+                     128 + 8 * _largest_frame);
+  out += runtime;
+  out += _declarations;
+  out += _definitions;
+  out += fmt::format(
+      "\nconst size_t plzerow_global_count = {};\n"
+      "const char *const plzerow_global_names[] = {{{}NULL}};\n"
+      "\n"
+      "/* Runs the program and stores the main program's variables in\n"
+      "   globals, which has room for plzerow_global_count of them. Returns\n"
+      "   0, or 1 after printing a runtime error to stderr. */\n"
+      "int plzerow_run(int32_t *globals) {{\n"
+      "  int status = 0;\n"
+      "{}"
+      "  pl0_depth = 0;\n"
+      "  if (setjmp(pl0_unwind) == 0) {{\n"
+      "    pl0_main();\n"
+      "  }} else {{\n"
+      "    status = 1;\n"
+      "  }}\n"
+      "{}"
+      "  return status;\n"
+      "}}\n",
+      slot, names, resets, slot > 0 ? stores : "  (void)globals;\n");
+  out += main_function;
+  return out;
+}
+
+// Frame structs are declared parent first, as the first member of each
+// points to its parent's frame.
+void CBackend::collect(NodeIndex block, std::int32_t procedure,
+                       std::int32_t parent, std::uint32_t level,
+                       std::string name) {
+  const auto &blk = std::get<Block>(_ast[block]._value);
+  _functions[procedure] = Function{block, std::move(name), level, parent,
+                                     level > 0 && blk._procedures.count > 0};
+  declare(_functions[procedure], procedure);
+  for (const auto p : _ast.children(blk._procedures)) {
+    const auto &proc = std::get<Procedure>(_ast[p]._value);
+    collect(proc._block, _table[p].value, procedure, level + 1,
+            std::string{_symbols.name(proc._name)});
+  }
+}
+
+void CBackend::declare(const Function &function, std::int32_t index) {
+  if (!function.framed) {
+    return;
+  }
+  _declarations += fmt::format("\nstruct f{} {{\n", index);
+  if (function.level > 1) {
+    _declarations += fmt::format("  struct f{} *up;\n", function.parent);
+  } else {
+    // the main program's variables need no link
+    _declarations += "  void *up;\n";
+  }
+  const auto &blk = std::get<Block>(_ast[function.block]._value);
+  for (const auto v : _ast.children(blk._varDecls)) {
+    if (_table.captured(v)) {
+      _declarations += fmt::format(
+          "  int32_t v_{};\n",
+          _symbols.name(std::get<VarDecl>(_ast[v]._value)._name));
+    }
+  }
+  _declarations += "};\n";
+}
+
+std::string CBackend::signature(const Function &function,
+                                std::int32_t index) const {
+  if (index == 0) {
+    return "static void pl0_main(void)";
+  }
+  return fmt::format("static void p{}_{}({})", index, function.name,
+                     function.level > 1
+                         ? fmt::format("struct f{} *up", function.parent)
+                         : "void");
+}
+
+void CBackend::define(const Function &function, std::int32_t index) {
+  const auto &blk = std::get<Block>(_ast[function.block]._value);
+  _level = function.level;
+  _temporary_count = 0;
+  _loc = _ast[function.block]._loc;
+
+  _definitions += "\n" + signature(function, index) + " {\n";
+  _indent = 1;
+  if (function.framed) {
+    line(fmt::format("struct f{} frame = {{{}}};", index,
+                     function.level > 1 ? "up" : "0"));
+  }
+  const auto variables = _ast.children(blk._varDecls);
+  if (function.level > 0) {
+    for (const auto v : variables) {
+      if (!_table.captured(v)) {
+        line(fmt::format(
+            "int32_t v_{} = 0;",
+            _symbols.name(std::get<VarDecl>(_ast[v]._value)._name)));
+      }
+    }
+    line(fmt::format("pl0_enter({});", _loc.linum));
+  }
+  statement(blk._statement);
+  if (function.level > 0) {
+    line("--pl0_depth;");
+  }
+  _definitions += "}\n";
+  _largest_frame =
+      std::max(_largest_frame, variables.size() + _temporary_count);
+}
+
+void CBackend::statement(NodeIndex node) {
+  if (node == no_node) {
+    return;
+  }
+  _loc = _ast[node]._loc;
+  _ast[node].accept(Visitor{
+      [this, node](const Assignment &arg) {
+        const auto value = expression(arg._expression);
+        flush_temporaries();
+        line(fmt::format("{} = {};", variable(node), value));
+      },
+      [this, node](const Call &) {
+        const auto &resolution = _table[node];
+        const auto &callee = _functions[resolution.value];
+        line(fmt::format("p{}_{}({});", resolution.value, callee.name,
+                         callee.level > 1 ? frame(resolution.depth) : ""));
+      },
+      [this](const Begin &arg) {
+        statement(arg._statement);
+        for (const auto s : _ast.children(arg._statements)) {
+          statement(s);
+        }
+      },
+      [this](const If &arg) {
+        const auto test = condition(arg._condition);
+        flush_temporaries();
+        line(fmt::format("if ({}) {{", test));
+        ++_indent;
+        statement(arg._statement);
+        --_indent;
+        line("}");
+      },
+      [this](const While &arg) {
+        const auto test = condition(arg._condition);
+        if (_temporaries.empty()) {
+          line(fmt::format("while ({}) {{", test));
+          ++_indent;
+        } else {
+          // the condition's divisions run before every test
+          line("for (;;) {");
+          ++_indent;
+          flush_temporaries();
+          line(fmt::format("if (!({})) {{", test));
+          line("  break;");
+          line("}");
+        }
+        statement(arg._statement);
+        --_indent;
+        line("}");
+      },
+      [this](const Statement &arg) { statement(arg._statement); },
+      [](const auto &) {},
+  });
+}
+
+std::string CBackend::condition(NodeIndex node) {
+  _loc = _ast[node]._loc;
+  return _ast[node].accept(Visitor{
+      [this](const OddCondition &arg) -> std::string {
+        if (const auto value = fold(_ast, _table, arg._expression)) {
+          return (*value & 1) != 0 ? "1" : "0";
+        }
+        return fmt::format("({} & 1) != 0", expression(arg._expression));
+      },
+      [this](const Condition &arg) -> std::string {
+        const auto lhs = fold(_ast, _table, arg._left);
+        const auto rhs = fold(_ast, _table, arg._right);
+        const auto op = comparison_operator(arg._op);
+        if (lhs && rhs) {
+          return fmt::format("{} {} {}", literal(*lhs), op, literal(*rhs));
+        }
+        const auto left = expression(arg._left);
+        return fmt::format("{} {} {}", left, op, expression(arg._right));
+      },
+      [](const auto &) -> std::string { return "0"; },
+  });
+}
+
+std::string CBackend::expression(NodeIndex node) {
+  if (const auto value = fold(_ast, _table, node)) {
+    return literal(*value);
+  }
+  _loc = _ast[node]._loc;
+  // left to right, like the VM evaluates them
+  auto apply = [this](TOKEN op, const std::string &lhs, NodeIndex rhs_node) {
+    const auto rhs = expression(rhs_node);
+    if (op != TOKEN::DIVIDE) {
+      return fmt::format("{}({}, {})", arithmetic_function(op), lhs, rhs);
+    }
+    const auto quotient = fmt::format("pl0_div({}, {}, {})", lhs, rhs,
+                                      _loc.linum);
+    const auto divisor = fold(_ast, _table, rhs_node);
+    if (divisor && *divisor != 0) {
+      return quotient;
+    }
+    const auto temporary = fmt::format("t{}", _temporary_count++);
+    _temporaries.push_back(
+        fmt::format("const int32_t {} = {};", temporary, quotient));
+    return temporary;
+  };
+  return _ast[node].accept(Visitor{
+      [&](const Expression &arg) {
+        auto value = expression(arg._left);
+        if (arg._op == TOKEN::MINUS) {
+          value = fmt::format("pl0_neg({})", value);
+        }
+        for (const auto &[op, term] : _ast.operands(arg._right)) {
+          value = apply(op, value, term);
+        }
+        return value;
+      },
+      [&](const Term &arg) {
+        auto value = expression(arg._left);
+        for (const auto &[op, factor] : _ast.operands(arg._right)) {
+          value = apply(op, value, factor);
+        }
+        return value;
+      },
+      [this](const Factor &arg) { return expression(arg._right); },
+      [this, node](const Primary &) { return variable(node); },
+      [](const Literal &arg) { return literal(arg._value); },
+      [](const auto &) { return std::string{"0"}; },
+  });
+}
+
+// Variables of the main program are globals, a procedure's own are locals or
+// members of its frame, and any other is reached through the frame links.
+std::string CBackend::variable(NodeIndex node) const {
+  const auto &resolution = _table[node];
+  const auto name =
+      _symbols.name(std::get<VarDecl>(_ast[resolution.decl]._value)._name);
+  if (resolution.depth == _level) {
+    return fmt::format("g_{}", name);
+  }
+  if (resolution.depth > 0) {
+    return fmt::format("{}->v_{}", frame(resolution.depth), name);
+  }
+  if (_table.captured(resolution.decl)) {
+    return fmt::format("frame.v_{}", name);
+  }
+  return fmt::format("v_{}", name);
+}
+
+// the frame of the procedure hops static links out
+std::string CBackend::frame(std::uint8_t hops) const {
+  if (hops == 0) {
+    return "&frame";
+  }
+  std::string link{"up"};
+  for (; hops > 1; --hops) {
+    link += "->up";
+  }
+  return link;
+}
+
+void CBackend::line(const std::string &text) {
+  _definitions.append(2 * _indent, ' ');
+  _definitions += text;
+  _definitions += "\n";
+}
+
+void CBackend::flush_temporaries() {
+  for (const auto &temporary : _temporaries) {
+    line(temporary);
+  }
+  _temporaries.clear();
+}
+
+} // namespace plzerow
@@ -1,67 +1,114 @@
 #include "chunk.hpp"
+#include "opcodes.hpp"
 #include "value.hpp"
+#include <algorithm>
 #include <cstdint>
+#include <iterator>
 
 namespace plzerow {
 
-std::uint8_t Chunk::append(std::uint8_t instruction) {
+void Chunk::append(std::uint8_t instruction) {
   _instructions.push_back(instruction);
-  return _instructions.size();
 }
 
-std::uint8_t Chunk::append(std::uint8_t instruction, std::size_t linum) {
-  add_linum(linum, 1);
-  return append(instruction);
+void Chunk::append(std::uint8_t instruction, SourceLoc loc) {
+  add_location(loc);
+  append(instruction);
 }
 
-std::uint8_t Chunk::append(std::uint8_t instruction, const Value &value,
-                           std::size_t linum) {
-  auto constant_index = _constants.append(value);
-  add_linum(linum, 2);
-  append(instruction);
-  return append(constant_index) - 1;
+bool Chunk::append_constant(const Value &value, SourceLoc loc) {
+  auto index = _constants.find(value);
+  if (!index) {
+    if (constant_count() == max_constants) {
+      return false;
+    }
+    index = _constants.append(value);
+  }
+  add_location(loc);
+  if (*index < short_constants) {
+    append(OP_CONSTANT);
+    append(static_cast<std::uint8_t>(*index));
+  } else {
+    append(OP_CONSTANT_LONG);
+    append(static_cast<std::uint8_t>(*index >> 16));
+    append(static_cast<std::uint8_t>(*index >> 8));
+    append(static_cast<std::uint8_t>(*index));
+  }
+  return true;
 }
 
-void Chunk::add_linum(std::uint16_t linum, std::uint16_t instruction_size) {
-  auto combine = [](std::uint16_t linum, std::uint16_t instruction_size) {
-    std::uint32_t combined = 0 | static_cast<std::uint32_t>(linum);
-    combined |= static_cast<std::uint32_t>(instruction_size << 16);
-    return combined;
-  };
-
-  if (_linums.size() == 0) {
-    std::uint32_t combined = combine(linum, instruction_size);
-    _linums.push_back(combined);
-    return;
+// called before the instruction is appended, so a new entry starts at the
+// current end of the code
+void Chunk::add_location(SourceLoc loc) {
+  if (_debug_info.empty() || _debug_info.back().loc != loc) {
+    _debug_info.push_back(
+        DebugEntry{static_cast<std::uint32_t>(_instructions.size()), loc});
   }
+}
 
-  auto &line_info = _linums.back();
-  auto line_number = static_cast<std::uint16_t>(line_info & 0xFFFF);
-  auto op_count = static_cast<std::uint16_t>((line_info >> 16) & 0xFFFF);
-  if (line_number == linum) {
-    line_info = combine(line_number, op_count + instruction_size);
-  } else {
-    _linums.push_back(combine(linum, instruction_size));
+SourceLoc Chunk::location(std::size_t offset) const {
+  const auto entries = debug_info();
+  // the last entry that starts at or before offset
+  const auto after = std::upper_bound(
+      entries.begin(), entries.end(), offset,
+      [](std::size_t offset, const DebugEntry &entry) {
+        return offset < entry.offset;
+      });
+  if (after == entries.begin() || offset >= size()) {
+    return {0, 0};
   }
+  return std::prev(after)->loc;
 }
 
-std::uint16_t Chunk::linum(std::size_t instruction_index) const {
-  std::size_t index = 0;
-  for (auto line_info : _linums) {
-    auto line_number = static_cast<std::uint16_t>(line_info & 0xFFFF);
-    auto op_count = static_cast<std::uint16_t>((line_info >> 16) & 0xFFFF);
-    index += op_count;
-    if (index > instruction_index) {
-      return line_number;
-    }
+std::uint32_t Chunk::linum(std::size_t offset) const {
+  return location(offset).linum;
+}
+
+SourceLoc DebugCursor::location(std::size_t offset) {
+  while (_next < _entries.size() && _entries[_next].offset <= offset) {
+    _loc = _entries[_next].loc;
+    ++_next;
   }
-  return 0;
+  return _loc;
+}
+
+InstructionPointer Chunk::cbegin() const {
+  return _mapping ? _mapped_instructions.data() : _instructions.data();
 }
 
-InstructionPointer Chunk::cbegin() const { return _instructions.cbegin(); }
+std::size_t Chunk::size() const {
+  return _mapping ? _mapped_instructions.size() : _instructions.size();
+}
+
+void Chunk::patch(std::size_t offset, std::uint8_t byte) {
+  _instructions[offset] = byte;
+}
 
 Value Chunk::constant(std::size_t index) const {
   return _constants.values()[index];
 }
 
+std::size_t Chunk::constant_count() const {
+  return _constants.values().size();
+}
+
+std::size_t Chunk::add_constant(const Value &value) {
+  return _constants.append(value);
+}
+
+Value Chunk::constant_at(std::size_t offset) const {
+  const auto *instruction = cbegin() + offset;
+  return constant(*instruction == OP_CONSTANT_LONG
+                      ? read_long_constant(instruction + 1)
+                      : instruction[1]);
+}
+
+DebugTable Chunk::debug_info() const {
+  return _mapping ? _mapped_debug_info : DebugTable{_debug_info};
+}
+
+void Chunk::add_global(std::string_view name) { _globals.emplace_back(name); }
+
+const std::vector<std::string> &Chunk::globals() const { return _globals; }
+
 } // namespace plzerow
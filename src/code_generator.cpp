@@ -0,0 +1,310 @@
+#include "code_generator.hpp"
+#include "arithmetic.hpp"
+#include "opcodes.hpp"
+#include "value.hpp"
+#include <fmt/core.h>
+#include <limits>
+#include <variant>
+
+namespace {
+
+std::optional<std::int32_t> apply(plzerow::TOKEN op, std::int32_t lhs,
+                                  std::int32_t rhs) {
+  switch (op) {
+  case plzerow::TOKEN::PLUS:
+    return plzerow::wrapping_add(lhs, rhs);
+  case plzerow::TOKEN::MINUS:
+    return plzerow::wrapping_subtract(lhs, rhs);
+  case plzerow::TOKEN::MULTIPLY:
+    return plzerow::wrapping_multiply(lhs, rhs);
+  case plzerow::TOKEN::DIVIDE:
+    // left for the VM to report
+    if (rhs == 0) {
+      return std::nullopt;
+    }
+    return plzerow::wrapping_divide(lhs, rhs);
+  default:
+    return std::nullopt;
+  }
+}
+
+std::uint8_t arithmetic_instruction(plzerow::TOKEN op) {
+  switch (op) {
+  case plzerow::TOKEN::PLUS:
+    return plzerow::OP_ADD;
+  case plzerow::TOKEN::MINUS:
+    return plzerow::OP_SUBTRACT;
+  case plzerow::TOKEN::MULTIPLY:
+    return plzerow::OP_MULTIPLY;
+  default:
+    return plzerow::OP_DIVIDE;
+  }
+}
+
+std::optional<bool> compare(plzerow::TOKEN op, std::int32_t lhs,
+                            std::int32_t rhs) {
+  switch (op) {
+  case plzerow::TOKEN::EQUAL:
+    return lhs == rhs;
+  case plzerow::TOKEN::HASH:
+    return lhs != rhs;
+  case plzerow::TOKEN::LESSTHAN:
+    return lhs < rhs;
+  case plzerow::TOKEN::GREATERTHAN:
+    return lhs > rhs;
+  default:
+    return std::nullopt;
+  }
+}
+
+std::uint8_t comparison_instruction(plzerow::TOKEN op) {
+  switch (op) {
+  case plzerow::TOKEN::EQUAL:
+    return plzerow::OP_EQUAL;
+  case plzerow::TOKEN::HASH:
+    return plzerow::OP_NOT_EQUAL;
+  case plzerow::TOKEN::LESSTHAN:
+    return plzerow::OP_LESS;
+  default:
+    return plzerow::OP_GREATER;
+  }
+}
+
+} // namespace
+
+namespace plzerow {
+
+std::optional<std::int32_t> fold(const Ast &ast, const SymbolTable &table,
+                                 NodeIndex node) {
+  using Result = std::optional<std::int32_t>;
+  return ast[node].accept(Visitor{
+      [&](const Expression &arg) -> Result {
+        auto value = fold(ast, table, arg._left);
+        if (value && arg._op == TOKEN::MINUS) {
+          value = wrapping_negate(*value);
+        }
+        for (const auto &[op, term] : ast.operands(arg._right)) {
+          if (!value) {
+            break;
+          }
+          const auto rhs = fold(ast, table, term);
+          value = rhs ? apply(op, *value, *rhs) : std::nullopt;
+        }
+        return value;
+      },
+      [&](const Term &arg) -> Result {
+        auto value = fold(ast, table, arg._left);
+        for (const auto &[op, factor] : ast.operands(arg._right)) {
+          if (!value) {
+            break;
+          }
+          const auto rhs = fold(ast, table, factor);
+          value = rhs ? apply(op, *value, *rhs) : std::nullopt;
+        }
+        return value;
+      },
+      [&](const Factor &arg) -> Result {
+        return fold(ast, table, arg._right);
+      },
+      [&](const Primary &) -> Result {
+        const auto &resolution = table[node];
+        if (resolution.kind != Resolution::Kind::Constant) {
+          return std::nullopt;
+        }
+        return resolution.value;
+      },
+      [](const Literal &arg) -> Result { return arg._value; },
+      [](const auto &) -> Result { return std::nullopt; },
+  });
+}
+
+CodeGenerator::CodeGenerator(const Ast &ast, const SymbolTable &table)
+    : _ast{ast}, _table{table} {}
+
+Fragment CodeGenerator::generate(NodeIndex block) {
+  const auto &blk = std::get<Block>(_ast[block]._value);
+  _fragment = Fragment{};
+  _loc = _ast[block]._loc;
+
+  emit_bytes(OP_ENTER,
+             static_cast<std::uint8_t>(_ast.children(blk._varDecls).size()));
+  statement(blk._statement);
+  emit_return();
+  return std::move(_fragment);
+}
+
+void CodeGenerator::statement(NodeIndex node) {
+  if (node == no_node) {
+    return;
+  }
+  _loc = _ast[node]._loc;
+  _ast[node].accept(Visitor{
+      [this, node](const Assignment &arg) {
+        expression(arg._expression);
+        store(node);
+      },
+      [this, node](const Call &) { emit_call(_table[node]); },
+      [this](const Begin &arg) {
+        statement(arg._statement);
+        for (const auto s : _ast.children(arg._statements)) {
+          statement(s);
+        }
+      },
+      [this](const If &arg) {
+        condition(arg._condition);
+        const auto skip = emit_jump(OP_JUMP_IF_FALSE);
+        statement(arg._statement);
+        patch_jump(skip);
+      },
+      [this](const While &arg) {
+        const auto loop_start = _fragment.code.size();
+        condition(arg._condition);
+        const auto exit = emit_jump(OP_JUMP_IF_FALSE);
+        statement(arg._statement);
+        emit_loop(loop_start);
+        patch_jump(exit);
+      },
+      [this](const Statement &arg) { statement(arg._statement); },
+      [](const auto &) {},
+  });
+}
+
+void CodeGenerator::condition(NodeIndex node) {
+  _loc = _ast[node]._loc;
+  _ast[node].accept(Visitor{
+      [this](const OddCondition &arg) {
+        if (const auto value = fold(arg._expression)) {
+          emit_constant((*value & 1) != 0);
+          return;
+        }
+        expression(arg._expression);
+        emit_byte(OP_ODD);
+      },
+      [this](const Condition &arg) {
+        const auto lhs = fold(arg._left);
+        const auto rhs = fold(arg._right);
+        if (lhs && rhs) {
+          emit_constant(*compare(arg._op, *lhs, *rhs));
+          return;
+        }
+        expression(arg._left);
+        expression(arg._right);
+        emit_byte(comparison_instruction(arg._op));
+      },
+      [](const auto &) {},
+  });
+}
+
+void CodeGenerator::expression(NodeIndex node) {
+  if (const auto value = fold(node)) {
+    emit_constant(*value);
+    return;
+  }
+  _loc = _ast[node]._loc;
+  _ast[node].accept(Visitor{
+      [this](const Expression &arg) {
+        expression(arg._left);
+        if (arg._op == TOKEN::MINUS) {
+          emit_byte(OP_NEGATE);
+        }
+        for (const auto &[op, term] : _ast.operands(arg._right)) {
+          expression(term);
+          emit_byte(arithmetic_instruction(op));
+        }
+      },
+      [this](const Term &arg) {
+        expression(arg._left);
+        for (const auto &[op, factor] : _ast.operands(arg._right)) {
+          expression(factor);
+          emit_byte(arithmetic_instruction(op));
+        }
+      },
+      [this](const Factor &arg) { expression(arg._right); },
+      [this, node](const Primary &) { load(node); },
+      [this](const Literal &arg) { emit_constant(arg._value); },
+      [](const auto &) {},
+  });
+}
+
+std::optional<std::int32_t> CodeGenerator::fold(NodeIndex node) const {
+  return plzerow::fold(_ast, _table, node);
+}
+
+void CodeGenerator::load(NodeIndex node) {
+  const auto &resolution = _table[node];
+  if (resolution.kind == Resolution::Kind::Constant) {
+    emit_constant(resolution.value);
+  } else if (resolution.depth == 0) {
+    emit_bytes(OP_GET_LOCAL, resolution.value);
+  } else {
+    emit_byte(OP_GET_VAR);
+    emit_bytes(resolution.depth, resolution.value);
+  }
+}
+
+void CodeGenerator::store(NodeIndex node) {
+  const auto &resolution = _table[node];
+  if (resolution.depth == 0) {
+    emit_bytes(OP_SET_LOCAL, resolution.value);
+  } else {
+    emit_byte(OP_SET_VAR);
+    emit_bytes(resolution.depth, resolution.value);
+  }
+}
+
+void CodeGenerator::emit_byte(std::uint8_t byte) {
+  _fragment.code.append(byte, _loc);
+}
+
+void CodeGenerator::emit_bytes(std::uint8_t byte1, std::uint8_t byte2) {
+  emit_byte(byte1);
+  emit_byte(byte2);
+}
+
+void CodeGenerator::emit_return() { emit_byte(OP_RETURN); }
+
+void CodeGenerator::emit_constant(std::int32_t value) {
+  if (!_fragment.code.append_constant(Value{value}, _loc)) {
+    error("too many constants in one chunk");
+  }
+}
+
+// jumps take a 16-bit offset from the end of the instruction
+std::size_t CodeGenerator::emit_jump(std::uint8_t instruction) {
+  emit_byte(instruction);
+  emit_bytes(0xff, 0xff);
+  return _fragment.code.size() - 2;
+}
+
+void CodeGenerator::patch_jump(std::size_t offset) {
+  const auto jump = _fragment.code.size() - offset - 2;
+  if (jump > std::numeric_limits<std::uint16_t>::max()) {
+    error("too much code to jump over");
+  }
+  _fragment.code.patch(offset, (jump >> 8) & 0xff);
+  _fragment.code.patch(offset + 1, jump & 0xff);
+}
+
+void CodeGenerator::emit_loop(std::size_t loop_start) {
+  emit_byte(OP_LOOP);
+  const auto offset = _fragment.code.size() - loop_start + 2;
+  if (offset > std::numeric_limits<std::uint16_t>::max()) {
+    error("loop body too large");
+  }
+  emit_bytes((offset >> 8) & 0xff, offset & 0xff);
+}
+
+// CALL <static link hops> <32-bit address>
+void CodeGenerator::emit_call(const Resolution &procedure) {
+  emit_bytes(OP_CALL, procedure.depth);
+  _fragment.calls.emplace_back(_fragment.code.size(), procedure.value);
+  emit_bytes(0, 0);
+  emit_bytes(0, 0);
+}
+
+void CodeGenerator::error(const std::string &message) {
+  _fragment.errors.push_back(fmt::format("[COMPILE_ERROR] [{}:{}] {}",
+                                         _loc.linum, _loc.column, message));
+}
+
+} // namespace plzerow
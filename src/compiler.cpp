@@ -1,47 +1,144 @@
 #include "compiler.hpp"
+#include "c_backend.hpp"
 #include "chunk.hpp"
+#include "code_generator.hpp"
+#include "ir.hpp"
+#include "ir_builder.hpp"
+#include "ir_lowering.hpp"
+#include "ir_optimize.hpp"
+#include "opcodes.hpp"
+#include "parallel_lexer.hpp"
 #include "parser.hpp"
+#include "peephole.hpp"
+#include "register_lowering.hpp"
+#include "relocations.hpp"
+#include "thread_pool.hpp"
+#include "token_pipeline.hpp"
+#include "token_source.hpp"
 #include "value.hpp"
+#include "virtual_machine.hpp"
+#include <algorithm>
 #include <cstdint>
-#include <memory>
+#include <future>
+#include <iostream>
+#include <limits>
+#include <optional>
 #include <utility>
+#include <variant>
+
+#ifdef PLZEROW_TRACE
+#include "debugger.hpp"
+#endif
+
+namespace {
+
+template <plzerow::TokenSource Source>
+std::optional<plzerow::Ast> parse(Source &source) {
+  plzerow::Parser parser{source};
+  auto ast = parser.parse();
+  if (parser.had_error()) {
+    return std::nullopt;
+  }
+  return ast;
+}
+
+} // namespace
 
 namespace plzerow {
 
 CompilerResult Compiler::compile(std::vector<char> &&source_code) {
-  _lexer = Lexer(std::forward<std::vector<char>>(source_code));
-  _parser = Parser([this]() { return _lexer.next(); });
-  _ast = _parser.parse();
-  print(_ast);
-  return CompilerResult::OK;
+  return compile("repl", SourceBuffer{std::move(source_code)});
+}
+
+CompilerResult Compiler::compile(const std::string &filename,
+                                 SourceBuffer &&source) {
+  _symbols = Interner{};
+  std::optional<Ast> ast;
+  if (_options.lex_threads > 1 && source.exhausted()) {
+    // the parallel lexer needs the whole program resident, streamed
+    // sources that did not fit a single window use the serial lexer
+    _source = std::move(source);
+    _tokens = ParallelLexer(filename, {_source.data(), _source.size()},
+                            _symbols, _options.lex_threads)
+                  .tokenize();
+    TokenArray tokens{_tokens};
+    ast = parse(tokens);
+  } else if (_options.pipeline && source.exhausted()) {
+    _lexer = Lexer(filename, std::move(source), &_symbols);
+    TokenPipeline pipeline{_lexer, filename};
+    ast = parse(pipeline);
+  } else {
+    _lexer = Lexer(filename, std::move(source), &_symbols);
+    ast = parse(_lexer);
+  }
+  if (!ast) {
+    return CompilerResult::ParseError;
+  }
+  _ast = std::move(*ast);
+#ifdef PLZEROW_TRACE
+  print(_ast.root());
+#endif
+
+  auto result = generate();
+  if (result == CompilerResult::OK) {
+    if (_options.opt_level > 0) {
+      optimize();
+    }
+    if (_options.engine == Engine::Register) {
+      result = lower();
+    } else {
+      _chunk = peephole(_chunk);
+    }
+  }
+#ifdef PLZEROW_TRACE
+  if (result == CompilerResult::OK) {
+    if (_options.engine == Engine::Register) {
+      Debugger::disassemble_registers(filename, _chunk);
+    } else {
+      Debugger::disassemble(filename, _chunk);
+    }
+  }
+#endif
+  return result;
 }
 
-void Compiler::print(const std::unique_ptr<ASTNode> &node) const {
+Chunk Compiler::take_chunk() { return std::move(_chunk); }
+
+std::string Compiler::c_source() const {
+  return CBackend{_ast, _table, _symbols}.translate();
+}
+
+void Compiler::print(NodeIndex node) const {
+  if (node == no_node) {
+    return;
+  }
   static const Visitor printVisitor{
       [this](const Block &arg) -> void {
         // std::cout << "size = " << arg._varDecls.size() << "\n";
-        for (const auto &c : arg._constDecls) {
+        for (const auto c : _ast.children(arg._constDecls)) {
           print(c);
         }
-        for (const auto &v : arg._varDecls) {
+        for (const auto v : _ast.children(arg._varDecls)) {
           print(v);
         }
-        for (const auto &p : arg._procedures) {
+        for (const auto p : _ast.children(arg._procedures)) {
           print(p);
         }
         print(arg._statement);
       },
       [this](const ConstDecl &arg) -> void {
-        std::cout << arg._name << " " << arg._value << "\n";
+        std::cout << _symbols.name(arg._name) << " " << arg._value << "\n";
+      },
+      [this](const VarDecl &arg) -> void {
+        std::cout << _symbols.name(arg._name) << "\n";
       },
-      [this](const VarDecl &arg) -> void { std::cout << arg._name << "\n"; },
       [this](const Procedure &arg) -> void { std::cout << "Procedure\n"; },
       [this](const Statement &arg) -> void { print(arg._statement); },
       [this](const Assignment &arg) -> void { std::cout << "Assignment\n"; },
       [this](const Call &arg) -> void { std::cout << "Call\n"; },
       [this](const Begin &arg) -> void {
         print(arg._statement);
-        for (const auto &s : arg._statements) {
+        for (const auto s : _ast.children(arg._statements)) {
           print(s);
         }
       },
@@ -58,11 +155,183 @@ void Compiler::print(const std::unique_ptr<ASTNode> &node) const {
       [this](const Unary &arg) -> void { std::cout << "Unary\n"; },
       [this](const Factor &arg) -> void { std::cout << "Factor\n"; },
       [this](const Primary &arg) -> void { std::cout << "Primary\n"; },
+      [this](const Literal &arg) -> void { std::cout << "Literal\n"; },
       [this](const Program &arg) -> void { print(arg._block); },
   };
-  node->accept(printVisitor);
+  _ast[node].accept(printVisitor);
+}
+
+CompilerResult Compiler::generate() {
+  _chunk = Chunk{};
+  _had_error = false;
+
+  auto table = Resolver{_ast, _symbols}.resolve();
+  if (!table) {
+    return CompilerResult::SemanticError;
+  }
+  _table = std::move(*table);
+
+  const auto main = std::get<Program>(_ast[_ast.root()]._value)._block;
+  std::vector<std::pair<NodeIndex, std::int32_t>> blocks;
+  layout(main, 0, blocks);
+
+  std::vector<Fragment> fragments(blocks.size());
+  auto generate = [&](std::size_t i) {
+    fragments[i] = CodeGenerator{_ast, _table}.generate(blocks[i].first);
+  };
+  if (_options.codegen_threads > 1 && blocks.size() > 1) {
+    ThreadPool pool{
+        std::min<unsigned>(_options.codegen_threads, blocks.size())};
+    std::vector<std::future<void>> pending;
+    pending.reserve(blocks.size());
+    for (std::size_t i = 0; i < blocks.size(); ++i) {
+      pending.push_back(pool.submit([&generate, i]() { generate(i); }));
+    }
+    for (auto &task : pending) {
+      task.get();
+    }
+  } else {
+    for (std::size_t i = 0; i < blocks.size(); ++i) {
+      generate(i);
+    }
+  }
+
+  const auto &program = std::get<Block>(_ast[main]._value);
+  for (const auto v : _ast.children(program._varDecls)) {
+    const auto &decl = std::get<VarDecl>(_ast[v]._value);
+    _chunk.add_global(_symbols.name(decl._name));
+  }
+  link(blocks, fragments);
+  return _had_error ? CompilerResult::SemanticError : CompilerResult::OK;
+}
+
+// Rebuilds the program from its SSA form. The generated code already
+// passed every check, so a program the optimized code does not fit keeps
+// it instead of failing.
+void Compiler::optimize() {
+  auto module = ir::build(_ast, _symbols, _table);
+  ir::optimize(module, _options.opt_level,
+               {_options.inline_threshold, _options.inline_budget});
+  if (_options.dump_ir) {
+    ir::print(std::cout, module);
+  }
+  if (auto chunk = ir::lower(std::move(module))) {
+    _chunk = std::move(*chunk);
+  }
+}
+
+// The register engine runs the stack code translated instruction by
+// instruction, so both engines share the code generator.
+CompilerResult Compiler::lower() {
+  auto registers = lower_to_registers(_chunk);
+  if (!registers) {
+    _loc = {0, 0};
+    compile_error("program too large for the register engine");
+    return CompilerResult::SemanticError;
+  }
+  _chunk = std::move(*registers);
+  return CompilerResult::OK;
+}
+
+// Every block is followed by its nested procedures', so the main program
+// starts at address 0 and nothing has to jump over a procedure.
+void Compiler::layout(
+    NodeIndex block, std::int32_t procedure,
+    std::vector<std::pair<NodeIndex, std::int32_t>> &order) const {
+  order.emplace_back(block, procedure);
+  const auto &blk = std::get<Block>(_ast[block]._value);
+  for (const auto p : _ast.children(blk._procedures)) {
+    layout(std::get<Procedure>(_ast[p]._value)._block, _table[p].value,
+           order);
+  }
 }
 
-// void Compiler::emit_byte(std::uint8_t byte);
+/*
+ * Concatenates the fragments in layout order; a procedure's address is that
+ * of its fragment's ENTER. The constant pools are merged with every distinct
+ * value kept once and CONSTANT operands renumbered, which can move them
+ * between the short and the long form, so the jumps within a fragment are
+ * relocated. Calls are patched once every fragment is placed. Errors found
+ * while generating are printed here, in program order, so neither the code
+ * nor the diagnostics depend on how many threads generated them.
+ */
+void Compiler::link(
+    const std::vector<std::pair<NodeIndex, std::int32_t>> &blocks,
+    const std::vector<Fragment> &fragments) {
+  std::vector<std::uint32_t> addresses(_table.procedures(), 0);
+  std::vector<std::pair<std::size_t, std::int32_t>> calls;
+
+  for (std::size_t i = 0; i < fragments.size(); ++i) {
+    const auto &fragment = fragments[i];
+    for (const auto &message : fragment.errors) {
+      _had_error = true;
+      std::cerr << message << "\n";
+    }
+    addresses[blocks[i].second] = static_cast<std::uint32_t>(_chunk.size());
+    _loc = _ast[blocks[i].first]._loc;
+
+    const auto &code = fragment.code;
+    const auto bytes = code.cbegin();
+    DebugCursor locations{code.debug_info()};
+    Relocations relocations{code.size()};
+    auto call = fragment.calls.begin();
+    for (std::size_t offset = 0; offset < code.size();) {
+      relocations.move(offset, _chunk.size());
+      const auto loc = locations.location(offset);
+      const auto instruction = bytes[offset];
+      const auto next = offset + instruction_size(instruction);
+      switch (instruction) {
+      case OP_CONSTANT:
+      case OP_CONSTANT_LONG:
+        if (!_chunk.append_constant(code.constant_at(offset), loc)) {
+          compile_error("too many constants in one chunk");
+        }
+        break;
+      case OP_JUMP:
+      case OP_JUMP_IF_FALSE:
+      case OP_LOOP: {
+        const auto jump = static_cast<std::size_t>(bytes[offset + 1] << 8 |
+                                                   bytes[offset + 2]);
+        _chunk.append(instruction, loc);
+        relocations.add(_chunk.size(),
+                        instruction == OP_LOOP ? next - jump : next + jump,
+                        instruction == OP_LOOP ? Relocations::Kind::Backward
+                                               : Relocations::Kind::Forward);
+        _chunk.append(0, loc);
+        _chunk.append(0, loc);
+        break;
+      }
+      default:
+        // calls are in code order
+        if (instruction == OP_CALL) {
+          calls.emplace_back(_chunk.size() + 2, call->second);
+          ++call;
+        }
+        for (auto byte = offset; byte < next; ++byte) {
+          _chunk.append(bytes[byte], loc);
+        }
+      }
+      offset = next;
+    }
+    relocations.move(code.size(), _chunk.size());
+    // a fragment whose jumps did not fit has said so already
+    if (!relocations.apply(_chunk) && fragment.errors.empty()) {
+      compile_error("too much code to jump over");
+    }
+  }
+
+  for (const auto &[offset, procedure] : calls) {
+    const auto address = addresses[procedure];
+    for (std::size_t i = 0; i < 4; ++i) {
+      _chunk.patch(offset + i, (address >> (24 - 8 * i)) & 0xff);
+    }
+  }
+}
+
+void Compiler::compile_error(const std::string &err) {
+  _had_error = true;
+  std::cerr << "[COMPILE_ERROR] [" << _loc.linum << ":" << _loc.column << "] "
+            << err << "\n";
+}
 
 } // namespace plzerow
@@ -1,20 +1,17 @@
 #include "debugger.hpp"
+#include "opcodes.hpp"
 #include "value.hpp"
-#include "virtual_machine.hpp"
 #include <fmt/core.h>
 #include <iostream>
 
 namespace {
 
-std::size_t constant_instruction_helper(const std::string &name,
-                                        std::size_t offset,
-                                        const plzerow::Chunk &chunk) {
-  auto constant_index = chunk.cbegin()[offset + 1];
+void print_constant(const std::string &name, std::uint32_t constant_index,
+                    const plzerow::Chunk &chunk) {
   auto result = fmt::format("{:<16} {:4} '", name, constant_index);
   std::cout << result;
   chunk.visit_constant(constant_index, plzerow::PrintVisitor);
   std::cout << "\n";
-  return offset + 2;
 }
 
 std::size_t simple_instruction(const std::string &name, std::size_t offset) {
@@ -24,13 +21,145 @@ std::size_t simple_instruction(const std::string &name, std::size_t offset) {
 
 std::size_t constant_instruction(const std::string &name, std::size_t offset,
                                  const plzerow::Chunk &chunk) {
-  return constant_instruction_helper(name, offset, chunk);
+  print_constant(name, chunk.cbegin()[offset + 1], chunk);
+  return offset + 2;
 }
 
 std::size_t constant_long_instruction(const std::string &name,
                                       std::size_t offset,
                                       const plzerow::Chunk &chunk) {
-  return constant_instruction_helper(name, offset, chunk);
+  print_constant(name,
+                 plzerow::read_long_constant(chunk.cbegin() + offset + 1),
+                 chunk);
+  return offset + 4;
+}
+
+std::size_t byte_instruction(const std::string &name, std::size_t offset,
+                             const plzerow::Chunk &chunk) {
+  std::cout << fmt::format("{:<16} {:4}\n", name, chunk.cbegin()[offset + 1]);
+  return offset + 2;
+}
+
+std::size_t variable_instruction(const std::string &name, std::size_t offset,
+                                 const plzerow::Chunk &chunk) {
+  std::cout << fmt::format("{:<16} {:4} {:4}\n", name,
+                           chunk.cbegin()[offset + 1],
+                           chunk.cbegin()[offset + 2]);
+  return offset + 3;
+}
+
+std::size_t jump_instruction(const std::string &name, int sign,
+                             std::size_t offset, const plzerow::Chunk &chunk) {
+  const auto jump = static_cast<std::uint16_t>(chunk.cbegin()[offset + 1] << 8 |
+                                               chunk.cbegin()[offset + 2]);
+  std::cout << fmt::format("{:<16} {:4} -> {}\n", name, offset,
+                           static_cast<long>(offset + 3) + sign * jump);
+  return offset + 3;
+}
+
+std::size_t call_instruction(const std::string &name, std::size_t offset,
+                             const plzerow::Chunk &chunk) {
+  std::uint32_t address = 0;
+  for (std::size_t i = 0; i < 4; ++i) {
+    address = address << 8 | chunk.cbegin()[offset + 2 + i];
+  }
+  std::cout << fmt::format("{:<16} {:4} -> {}\n", name,
+                           chunk.cbegin()[offset + 1], address);
+  return offset + 6;
+}
+
+// register operands
+std::size_t register_instruction(const std::string &name, std::size_t offset,
+                                 std::size_t operands,
+                                 const plzerow::Chunk &chunk) {
+  std::cout << fmt::format("{:<16}", name);
+  for (std::size_t i = 1; i <= operands; ++i) {
+    std::cout << fmt::format(" {:4}", chunk.cbegin()[offset + i]);
+  }
+  std::cout << "\n";
+  return offset + 1 + operands;
+}
+
+// a register or variable slot followed by a constant
+std::size_t slot_constant_instruction(const std::string &name,
+                                      std::size_t offset,
+                                      const plzerow::Chunk &chunk) {
+  auto constant_index = chunk.cbegin()[offset + 2];
+  std::cout << fmt::format("{:<16} {:4} {:4} '", name,
+                           chunk.cbegin()[offset + 1], constant_index);
+  chunk.visit_constant(constant_index, plzerow::PrintVisitor);
+  std::cout << "\n";
+  return offset + 3;
+}
+
+std::size_t slot_constant_long_instruction(const std::string &name,
+                                           std::size_t offset,
+                                           const plzerow::Chunk &chunk) {
+  const auto constant_index =
+      plzerow::read_long_constant(chunk.cbegin() + offset + 2);
+  std::cout << fmt::format("{:<16} {:4} {:4} '", name,
+                           chunk.cbegin()[offset + 1], constant_index);
+  chunk.visit_constant(constant_index, plzerow::PrintVisitor);
+  std::cout << "\n";
+  return offset + 5;
+}
+
+std::size_t conditional_jump_instruction(const std::string &name,
+                                         std::size_t offset,
+                                         const plzerow::Chunk &chunk) {
+  const auto jump = static_cast<std::uint16_t>(chunk.cbegin()[offset + 2] << 8 |
+                                               chunk.cbegin()[offset + 3]);
+  std::cout << fmt::format("{:<16} {:4} {:4} -> {}\n", name,
+                           chunk.cbegin()[offset + 1], offset,
+                           offset + 4 + jump);
+  return offset + 4;
+}
+
+// the offset, then the line and column unless the previous instruction
+// came from the same place
+void line_prefix(std::size_t offset, const plzerow::Chunk &chunk) {
+  std::cout << fmt::format("{:04} ", offset);
+  const auto loc = chunk.location(offset);
+  if (offset > 0 && loc == chunk.location(offset - 1))
+    std::cout << "       | ";
+  else
+    std::cout << fmt::format("{:04}:{:<3} ", loc.linum, loc.column);
+}
+
+// prints an instruction with operands laid out as layout
+std::size_t operands_instruction(const std::string &name,
+                                 plzerow::Operands layout, std::size_t offset,
+                                 const plzerow::Chunk &chunk) {
+  using plzerow::Operands;
+  switch (layout) {
+  case Operands::None:
+    return simple_instruction(name, offset);
+  case Operands::Constant:
+    return constant_instruction(name, offset, chunk);
+  case Operands::LongConstant:
+    return constant_long_instruction(name, offset, chunk);
+  case Operands::Byte:
+    return byte_instruction(name, offset, chunk);
+  case Operands::Variable:
+    return variable_instruction(name, offset, chunk);
+  case Operands::Forward:
+    return jump_instruction(name, 1, offset, chunk);
+  case Operands::Backward:
+    return jump_instruction(name, -1, offset, chunk);
+  case Operands::Call:
+    return call_instruction(name, offset, chunk);
+  case Operands::SlotConstant:
+    return slot_constant_instruction(name, offset, chunk);
+  case Operands::SlotLongConstant:
+    return slot_constant_long_instruction(name, offset, chunk);
+  case Operands::SlotForward:
+    return conditional_jump_instruction(name, offset, chunk);
+  case Operands::RegisterPair:
+    return register_instruction(name, offset, 2, chunk);
+  case Operands::RegisterTriple:
+    return register_instruction(name, offset, 3, chunk);
+  }
+  return offset + 1;
 }
 
 } // namespace
@@ -39,46 +168,53 @@ namespace plzerow {
 
 std::size_t Debugger::disassemble_instruction(std::size_t offset,
                                               const Chunk &chunk) {
-  std::cout << fmt::format("{:04} ", offset);
-  if (offset > 0 && chunk.linum(offset) == chunk.linum(offset - 1))
-    std::cout << "   | ";
-  else
-    std::cout << fmt::format("{:04} ", chunk.linum(offset));
-
-  auto instruction = chunk.cbegin()[offset];
-  switch (chunk.cbegin()[offset]) {
-  case OP_DIVIDE:
-    return simple_instruction("OP_DIVIDE", offset);
-  case OP_SUBTRACT:
-    return simple_instruction("OP_SUBTRACT", offset);
-  case OP_MULTIPLY:
-    return simple_instruction("OP_MULTIPLY", offset);
-  case OP_ADD:
-    return simple_instruction("OP_ADD", offset);
-  case OP_NEGATE:
-    return simple_instruction("OP_NEGATE", offset);
-  case OP_RETURN:
-    return simple_instruction("OP_RETURN", offset);
-  case OP_CONSTANT:
-    return constant_instruction("OP_CONSTANT", offset, chunk);
-  case OP_CONSTANT_LONG:
-    return constant_long_instruction("OP_CONSTANT_LONG", offset, chunk);
-  default:
+  line_prefix(offset, chunk);
+
+  const auto instruction = chunk.cbegin()[offset];
+  if (instruction >= opcode_count) {
     std::cout << "unknown opcode " << instruction << "\n";
     return offset + 1;
   }
+  return operands_instruction(opcode_names[instruction],
+                              operands(instruction), offset, chunk);
 }
 
 std::size_t Debugger::disassemble(const std::string &name, const Chunk &chunk) {
   std::cout << "constants = " << chunk._constants.values().size()
-            << " instructions = " << chunk._instructions.size()
-            << " linums = " << chunk._linums.size() << "\n";
+            << " instructions = " << chunk.size()
+            << " debug entries = " << chunk.debug_info().size() << "\n";
 
   std::cout << "== " << name << " ==\n";
-  for (std::size_t offset = 0; offset < chunk._instructions.size();) {
+  for (std::size_t offset = 0; offset < chunk.size();) {
     offset = disassemble_instruction(offset, chunk);
   }
   return 0;
 }
 
+std::size_t Debugger::disassemble_register_instruction(std::size_t offset,
+                                                       const Chunk &chunk) {
+  line_prefix(offset, chunk);
+
+  const auto instruction = chunk.cbegin()[offset];
+  if (instruction >= register_opcode_count) {
+    std::cout << "unknown opcode " << instruction << "\n";
+    return offset + 1;
+  }
+  return operands_instruction(register_opcode_names[instruction],
+                              register_operands(instruction), offset, chunk);
+}
+
+std::size_t Debugger::disassemble_registers(const std::string &name,
+                                            const Chunk &chunk) {
+  std::cout << "constants = " << chunk._constants.values().size()
+            << " instructions = " << chunk.size()
+            << " debug entries = " << chunk.debug_info().size() << "\n";
+
+  std::cout << "== " << name << " ==\n";
+  for (std::size_t offset = 0; offset < chunk.size();) {
+    offset = disassemble_register_instruction(offset, chunk);
+  }
+  return 0;
+}
+
 } // namespace plzerow
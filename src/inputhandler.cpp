@@ -2,6 +2,8 @@
 #include <fstream>
 #include <iostream>
 #include <istream>
+#include <optional>
+#include <utility>
 
 namespace plzerow {
 
@@ -35,6 +37,30 @@ std::vector<char> InputHandler::read_from_file(const std::string &filename) {
   return buffer;
 }
 
+SourceBuffer InputHandler::open_file(const std::string &filename,
+                                     InputMode mode) {
+  std::optional<SourceBuffer> source;
+  switch (mode) {
+  case InputMode::Read:
+    return SourceBuffer{read_from_file(filename)};
+  case InputMode::Map:
+    source = SourceBuffer::map(filename);
+    break;
+  case InputMode::Stream:
+    source = SourceBuffer::stream(filename);
+    break;
+  }
+
+  if (!source) {
+    std::cerr << "unable to open source file: " << filename << "\n";
+    exit(1);
+  }
+
+  std::cout << "Filename: " << filename << "\n";
+
+  return std::move(*source);
+}
+
 std::vector<char> InputHandler::read_from_repl(std::istream &is) {
   std::string current_line;
   std::getline(is, current_line);
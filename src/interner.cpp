@@ -0,0 +1,44 @@
+#include "interner.hpp"
+#include <algorithm>
+
+namespace plzerow {
+
+SymbolId Interner::intern(std::string_view name) {
+  if (auto it = _ids.find(name); it != _ids.end()) {
+    return it->second;
+  }
+  const auto symbol = static_cast<SymbolId>(_names.size());
+  const auto stored = store(name);
+  _names.push_back(stored);
+  _ids.emplace(stored, symbol);
+  return symbol;
+}
+
+std::string_view Interner::name(SymbolId symbol) const {
+  return _names[symbol];
+}
+
+std::size_t Interner::size() const { return _names.size(); }
+
+std::string_view Interner::store(std::string_view name) {
+  if (name.size() > block_size) {
+    // oversized names get a block of their own, the current one stays open
+    auto &block = _blocks.emplace_back(std::make_unique<char[]>(name.size()));
+    std::copy(name.begin(), name.end(), block.get());
+    const std::string_view stored{block.get(), name.size()};
+    if (_blocks.size() > 1) {
+      std::swap(_blocks.back(), _blocks[_blocks.size() - 2]);
+    }
+    return stored;
+  }
+  if (name.size() > block_size - _block_used) {
+    _blocks.push_back(std::make_unique<char[]>(block_size));
+    _block_used = 0;
+  }
+  char *destination = _blocks.back().get() + _block_used;
+  std::copy(name.begin(), name.end(), destination);
+  _block_used += name.size();
+  return {destination, name.size()};
+}
+
+} // namespace plzerow
@@ -0,0 +1,364 @@
+#include "ir.hpp"
+#include <algorithm>
+#include <fmt/core.h>
+
+namespace plzerow::ir {
+
+namespace {
+
+const char *name(Op op) {
+  switch (op) {
+  case Op::Const:
+    return "const";
+  case Op::Load:
+    return "load";
+  case Op::Store:
+    return "store";
+  case Op::Negate:
+    return "negate";
+  case Op::Odd:
+    return "odd";
+  case Op::Add:
+    return "add";
+  case Op::Subtract:
+    return "subtract";
+  case Op::Multiply:
+    return "multiply";
+  case Op::Divide:
+    return "divide";
+  case Op::Equal:
+    return "equal";
+  case Op::NotEqual:
+    return "not_equal";
+  case Op::Less:
+    return "less";
+  case Op::Greater:
+    return "greater";
+  case Op::Call:
+    return "call";
+  case Op::Phi:
+    return "phi";
+  case Op::Jump:
+    return "jump";
+  case Op::Branch:
+    return "branch";
+  case Op::Return:
+    return "return";
+  }
+  return "?";
+}
+
+bool has_value(Op op) {
+  return op != Op::Store && op != Op::Call && !is_terminator(op);
+}
+
+} // namespace
+
+BlockId Function::add_block() {
+  blocks.emplace_back();
+  return static_cast<BlockId>(blocks.size() - 1);
+}
+
+ValueId Function::add(BlockId block, Instruction instruction) {
+  const auto value = static_cast<ValueId>(values.size());
+  instruction.block = block;
+  auto &list = blocks[block].instructions;
+  if (instruction.op == Op::Phi) {
+    auto position = std::find_if(list.begin(), list.end(), [&](ValueId v) {
+      return values[v].op != Op::Phi;
+    });
+    list.insert(position, value);
+  } else {
+    list.push_back(value);
+  }
+  values.push_back(std::move(instruction));
+  return value;
+}
+
+ValueId Function::terminator(BlockId block) const {
+  const auto &list = blocks[block].instructions;
+  if (list.empty() || !is_terminator(values[list.back()].op)) {
+    return no_value;
+  }
+  return list.back();
+}
+
+void Function::add_edge(BlockId from, BlockId to) {
+  blocks[from].successors.push_back(to);
+  blocks[to].predecessors.push_back(from);
+}
+
+void Function::remove_edge(BlockId from, BlockId to) {
+  auto &successors = blocks[from].successors;
+  successors.erase(std::find(successors.begin(), successors.end(), to));
+
+  auto &predecessors = blocks[to].predecessors;
+  const auto index =
+      std::find(predecessors.begin(), predecessors.end(), from) -
+      predecessors.begin();
+  predecessors.erase(predecessors.begin() + index);
+  for (const auto value : blocks[to].instructions) {
+    if (values[value].op != Op::Phi) {
+      break;
+    }
+    auto &operands = values[value].operands;
+    operands.erase(operands.begin() + index);
+  }
+}
+
+void Function::replace_uses(ValueId value, ValueId replacement) {
+  for (auto &instruction : values) {
+    std::replace(instruction.operands.begin(), instruction.operands.end(),
+                 value, replacement);
+  }
+}
+
+void Function::remove(ValueId value) {
+  auto &list = blocks[values[value].block].instructions;
+  list.erase(std::find(list.begin(), list.end(), value));
+  values[value].removed = true;
+}
+
+bool is_terminator(Op op) {
+  return op == Op::Jump || op == Op::Branch || op == Op::Return;
+}
+
+bool is_commutative(Op op) {
+  return op == Op::Add || op == Op::Multiply || op == Op::Equal ||
+         op == Op::NotEqual;
+}
+
+bool has_side_effects(const Function &function,
+                      const Instruction &instruction) {
+  switch (instruction.op) {
+  case Op::Store:
+  case Op::Call:
+  case Op::Jump:
+  case Op::Branch:
+  case Op::Return:
+    return true;
+  case Op::Divide: {
+    const auto &divisor = function.values[instruction.operands[1]];
+    return divisor.op != Op::Const || divisor.constant == 0;
+  }
+  default:
+    return false;
+  }
+}
+
+std::vector<BlockId> reverse_postorder(const Function &function) {
+  std::vector<BlockId> order;
+  std::vector<bool> visited(function.blocks.size(), false);
+  // (block, successors still to visit)
+  std::vector<std::pair<BlockId, std::size_t>> stack{{0, 0}};
+  visited[0] = true;
+  while (!stack.empty()) {
+    auto &[block, next] = stack.back();
+    const auto &successors = function.blocks[block].successors;
+    if (next == successors.size()) {
+      order.push_back(block);
+      stack.pop_back();
+      continue;
+    }
+    const auto successor = successors[successors.size() - 1 - next++];
+    if (!visited[successor]) {
+      visited[successor] = true;
+      stack.emplace_back(successor, 0);
+    }
+  }
+  std::reverse(order.begin(), order.end());
+  return order;
+}
+
+// Cooper, Harvey and Kennedy, "A Simple, Fast Dominance Algorithm"
+std::vector<BlockId> dominators(const Function &function,
+                                const std::vector<BlockId> &order) {
+  constexpr auto none = std::numeric_limits<BlockId>::max();
+  std::vector<std::size_t> position(function.blocks.size(), 0);
+  for (std::size_t i = 0; i < order.size(); ++i) {
+    position[order[i]] = i;
+  }
+  std::vector<BlockId> idom(function.blocks.size(), none);
+  idom[order.front()] = order.front();
+
+  auto intersect = [&](BlockId a, BlockId b) {
+    while (a != b) {
+      while (position[a] > position[b]) {
+        a = idom[a];
+      }
+      while (position[b] > position[a]) {
+        b = idom[b];
+      }
+    }
+    return a;
+  };
+
+  for (bool changed = true; changed;) {
+    changed = false;
+    for (std::size_t i = 1; i < order.size(); ++i) {
+      const auto block = order[i];
+      auto dominator = none;
+      for (const auto predecessor : function.blocks[block].predecessors) {
+        if (idom[predecessor] == none) {
+          continue;
+        }
+        dominator = dominator == none ? predecessor
+                                      : intersect(predecessor, dominator);
+      }
+      if (idom[block] != dominator) {
+        idom[block] = dominator;
+        changed = true;
+      }
+    }
+  }
+  return idom;
+}
+
+bool dominates(const std::vector<BlockId> &idom, BlockId a, BlockId b) {
+  for (;;) {
+    if (a == b) {
+      return true;
+    }
+    if (idom[b] == b || idom[b] == std::numeric_limits<BlockId>::max()) {
+      return false;
+    }
+    b = idom[b];
+  }
+}
+
+std::vector<std::vector<ValueId>> users(const Function &function) {
+  std::vector<std::vector<ValueId>> result(function.values.size());
+  for (ValueId value = 0; value < function.values.size(); ++value) {
+    const auto &instruction = function.values[value];
+    if (instruction.removed) {
+      continue;
+    }
+    for (const auto operand : instruction.operands) {
+      result[operand].push_back(value);
+    }
+  }
+  return result;
+}
+
+void remove_trivial_phis(Function &function) {
+  std::vector<ValueId> forward(function.values.size(), no_value);
+  auto resolve = [&](ValueId value) {
+    while (forward[value] != no_value) {
+      value = forward[value];
+    }
+    return value;
+  };
+
+  for (bool changed = true; changed;) {
+    changed = false;
+    for (ValueId value = 0; value < function.values.size(); ++value) {
+      const auto &phi = function.values[value];
+      if (phi.removed || phi.op != Op::Phi) {
+        continue;
+      }
+      auto same = no_value;
+      bool trivial = true;
+      for (auto operand : phi.operands) {
+        operand = resolve(operand);
+        if (operand == value || operand == same) {
+          continue;
+        }
+        if (same != no_value) {
+          trivial = false;
+          break;
+        }
+        same = operand;
+      }
+      if (trivial && same != no_value) {
+        forward[value] = same;
+        function.remove(value);
+        changed = true;
+      }
+    }
+  }
+
+  for (auto &instruction : function.values) {
+    for (auto &operand : instruction.operands) {
+      operand = resolve(operand);
+    }
+  }
+}
+
+std::vector<bool> called_functions(const Module &module) {
+  std::vector<bool> called(module.functions.size(), false);
+  std::vector<std::size_t> work{0};
+  called[0] = true;
+  while (!work.empty()) {
+    const auto &function = module.functions[work.back()];
+    work.pop_back();
+    for (const auto &block : function.blocks) {
+      if (block.removed) {
+        continue;
+      }
+      for (const auto value : block.instructions) {
+        const auto &instruction = function.values[value];
+        if (instruction.op == Op::Call && !called[instruction.constant]) {
+          called[instruction.constant] = true;
+          work.push_back(instruction.constant);
+        }
+      }
+    }
+  }
+  return called;
+}
+
+void print(std::ostream &out, const Module &module) {
+  const auto called = called_functions(module);
+  for (std::size_t index = 0; index < module.functions.size(); ++index) {
+    const auto &function = module.functions[index];
+    if (!called[index]) {
+      continue;
+    }
+    out << fmt::format("function f{} {} (level {}, {} slots)\n", index,
+                       function.name, function.level, function.slots);
+    for (const auto block : reverse_postorder(function)) {
+      out << fmt::format("b{}:", block);
+      if (!function.blocks[block].predecessors.empty()) {
+        out << " ; preds";
+        for (const auto predecessor : function.blocks[block].predecessors) {
+          out << fmt::format(" b{}", predecessor);
+        }
+      }
+      out << "\n";
+      for (const auto value : function.blocks[block].instructions) {
+        const auto &instruction = function.values[value];
+        out << "  ";
+        if (has_value(instruction.op)) {
+          out << fmt::format("v{} = ", value);
+        }
+        out << name(instruction.op);
+        switch (instruction.op) {
+        case Op::Const:
+          out << " " << instruction.constant;
+          break;
+        case Op::Load:
+        case Op::Store:
+          out << fmt::format(" [{}:{}]", instruction.hops, instruction.slot);
+          break;
+        case Op::Call:
+          out << fmt::format(" f{} hops {}", instruction.constant,
+                             instruction.hops);
+          break;
+        default:
+          break;
+        }
+        for (const auto operand : instruction.operands) {
+          out << fmt::format(" v{}", operand);
+        }
+        for (const auto successor : function.blocks[block].successors) {
+          if (is_terminator(instruction.op) && instruction.op != Op::Return) {
+            out << fmt::format(" b{}", successor);
+          }
+        }
+        out << "\n";
+      }
+    }
+  }
+}
+
+} // namespace plzerow::ir
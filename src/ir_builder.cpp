@@ -0,0 +1,360 @@
+#include "ir_builder.hpp"
+#include "ast_nodes.hpp"
+#include "token_type.hpp"
+#include "value.hpp"
+#include <cstdint>
+#include <string>
+#include <utility>
+#include <variant>
+#include <vector>
+
+namespace plzerow::ir {
+
+namespace {
+
+Op arithmetic(TOKEN op) {
+  switch (op) {
+  case TOKEN::PLUS:
+    return Op::Add;
+  case TOKEN::MINUS:
+    return Op::Subtract;
+  case TOKEN::MULTIPLY:
+    return Op::Multiply;
+  default:
+    return Op::Divide;
+  }
+}
+
+Op comparison(TOKEN op) {
+  switch (op) {
+  case TOKEN::EQUAL:
+    return Op::Equal;
+  case TOKEN::HASH:
+    return Op::NotEqual;
+  case TOKEN::LESSTHAN:
+    return Op::Less;
+  default:
+    return Op::Greater;
+  }
+}
+
+class Builder {
+public:
+  Builder(const Ast &ast, const Interner &symbols, const SymbolTable &table)
+      : _ast{ast}, _symbols{symbols}, _table{table} {}
+
+  Module run();
+
+private:
+  // the SSA construction state of the function being built
+  struct FunctionState {
+    Function function;
+    std::vector<bool> promoted;
+    // the current definition of every promoted slot in every block
+    std::vector<std::vector<ValueId>> defs;
+    std::vector<bool> sealed;
+    std::vector<std::vector<std::pair<std::uint8_t, ValueId>>> incomplete;
+    BlockId current = 0;
+  };
+
+  void function(NodeIndex node, std::size_t index, std::uint32_t level,
+                std::string name);
+  void statement(NodeIndex node);
+  ValueId condition(NodeIndex node);
+  ValueId expression(NodeIndex node);
+
+  BlockId add_block();
+  ValueId emit(Instruction instruction);
+  ValueId emit(Op op, std::vector<ValueId> operands = {});
+  void jump(BlockId target);
+  void seal(BlockId block);
+  void write_variable(std::uint8_t slot, BlockId block, ValueId value);
+  ValueId read_variable(std::uint8_t slot, BlockId block);
+  void add_phi_operands(std::uint8_t slot, ValueId phi);
+  bool promoted(const Resolution &resolution) const;
+
+  const Ast &_ast;
+  const Interner &_symbols;
+  const SymbolTable &_table;
+  Module _module;
+
+  FunctionState *_state = nullptr;
+  SourceLoc _loc{0, 0};
+};
+
+Module Builder::run() {
+  const auto root = std::get<Program>(_ast[_ast.root()]._value)._block;
+  _module.functions.resize(_table.procedures());
+  const auto &block = std::get<plzerow::Block>(_ast[root]._value);
+  for (const auto v : _ast.children(block._varDecls)) {
+    _module.globals.emplace_back(
+        _symbols.name(std::get<VarDecl>(_ast[v]._value)._name));
+  }
+  function(root, 0, 0, "main");
+  return std::move(_module);
+}
+
+bool Builder::promoted(const Resolution &resolution) const {
+  return resolution.kind == Resolution::Kind::Variable &&
+         resolution.depth == 0 && !_table.captured(resolution.decl);
+}
+
+/*
+ * Every function starts with a block that defines each promoted variable as
+ * zero, which is what ENTER initialises frames with. A procedure is built
+ * into the function its resolved index names.
+ */
+void Builder::function(NodeIndex node, std::size_t index, std::uint32_t level,
+                       std::string name) {
+  const auto &block = std::get<plzerow::Block>(_ast[node]._value);
+  _loc = _ast[node]._loc;
+
+  FunctionState state;
+  _state = &state;
+  state.function.name = std::move(name);
+  state.function.level = level;
+  const auto slots = _ast.children(block._varDecls);
+  state.function.slots = static_cast<std::uint8_t>(slots.size());
+  for (const auto v : slots) {
+    state.promoted.push_back(!_table.captured(v));
+  }
+
+  state.current = add_block();
+  seal(state.current);
+  const auto zero = emit(Instruction{.op = Op::Const});
+  for (std::size_t slot = 0; slot < slots.size(); ++slot) {
+    state.defs[state.current][slot] = zero;
+  }
+
+  statement(block._statement);
+
+  // the main program's variables are printed when it halts
+  if (level == 0) {
+    for (std::size_t slot = 0; slot < slots.size(); ++slot) {
+      if (state.promoted[slot]) {
+        emit(Instruction{
+            .op = Op::Store,
+            .slot = static_cast<std::uint8_t>(slot),
+            .operands = {read_variable(slot, state.current)},
+        });
+      }
+    }
+  }
+  emit(Op::Return);
+  remove_trivial_phis(state.function);
+  _module.functions[index] = std::move(state.function);
+  _state = nullptr;
+
+  for (const auto p : _ast.children(block._procedures)) {
+    const auto &decl = std::get<Procedure>(_ast[p]._value);
+    function(decl._block, _table[p].value, level + 1,
+             std::string{_symbols.name(decl._name)});
+  }
+}
+
+void Builder::statement(NodeIndex node) {
+  if (node == no_node) {
+    return;
+  }
+  _loc = _ast[node]._loc;
+  auto &state = *_state;
+  _ast[node].accept(Visitor{
+      [&](const Assignment &arg) {
+        const auto value = expression(arg._expression);
+        const auto &resolution = _table[node];
+        if (promoted(resolution)) {
+          write_variable(resolution.value, state.current, value);
+          return;
+        }
+        emit(Instruction{
+            .op = Op::Store,
+            .hops = resolution.depth,
+            .slot = static_cast<std::uint8_t>(resolution.value),
+            .operands = {value},
+        });
+      },
+      [&](const plzerow::Call &) {
+        const auto &resolution = _table[node];
+        emit(Instruction{
+            .op = Op::Call,
+            .constant = resolution.value,
+            .hops = resolution.depth,
+        });
+      },
+      [&](const Begin &arg) {
+        statement(arg._statement);
+        for (const auto s : _ast.children(arg._statements)) {
+          statement(s);
+        }
+      },
+      [&](const If &arg) {
+        const auto cond = condition(arg._condition);
+        const auto then = add_block();
+        const auto join = add_block();
+        emit(Op::Branch, {cond});
+        state.function.add_edge(state.current, then);
+        state.function.add_edge(state.current, join);
+        seal(then);
+        state.current = then;
+        statement(arg._statement);
+        jump(join);
+        seal(join);
+        state.current = join;
+      },
+      [&](const While &arg) {
+        const auto header = add_block();
+        jump(header);
+        state.current = header;
+        const auto cond = condition(arg._condition);
+        const auto body = add_block();
+        const auto exit = add_block();
+        emit(Op::Branch, {cond});
+        state.function.add_edge(header, body);
+        state.function.add_edge(header, exit);
+        seal(body);
+        state.current = body;
+        statement(arg._statement);
+        jump(header);
+        seal(header);
+        seal(exit);
+        state.current = exit;
+      },
+      [&](const Statement &arg) { statement(arg._statement); },
+      [](const auto &) {},
+  });
+}
+
+ValueId Builder::condition(NodeIndex node) {
+  _loc = _ast[node]._loc;
+  return _ast[node].accept(Visitor{
+      [&](const OddCondition &arg) {
+        return emit(Op::Odd, {expression(arg._expression)});
+      },
+      [&](const Condition &arg) {
+        const auto lhs = expression(arg._left);
+        const auto rhs = expression(arg._right);
+        return emit(comparison(arg._op), {lhs, rhs});
+      },
+      [](const auto &) { return no_value; },
+  });
+}
+
+ValueId Builder::expression(NodeIndex node) {
+  _loc = _ast[node]._loc;
+  return _ast[node].accept(Visitor{
+      [&](const Expression &arg) {
+        auto value = expression(arg._left);
+        if (arg._op == TOKEN::MINUS) {
+          value = emit(Op::Negate, {value});
+        }
+        for (const auto &[op, term] : _ast.operands(arg._right)) {
+          value = emit(arithmetic(op), {value, expression(term)});
+        }
+        return value;
+      },
+      [&](const Term &arg) {
+        auto value = expression(arg._left);
+        for (const auto &[op, factor] : _ast.operands(arg._right)) {
+          value = emit(arithmetic(op), {value, expression(factor)});
+        }
+        return value;
+      },
+      [&](const Factor &arg) { return expression(arg._right); },
+      [&](const Primary &) {
+        const auto &resolution = _table[node];
+        if (resolution.kind == Resolution::Kind::Constant) {
+          return emit(
+              Instruction{.op = Op::Const, .constant = resolution.value});
+        }
+        if (promoted(resolution)) {
+          return read_variable(resolution.value, _state->current);
+        }
+        return emit(Instruction{
+            .op = Op::Load,
+            .hops = resolution.depth,
+            .slot = static_cast<std::uint8_t>(resolution.value),
+        });
+      },
+      [&](const Literal &arg) {
+        return emit(Instruction{.op = Op::Const, .constant = arg._value});
+      },
+      [](const auto &) { return no_value; },
+  });
+}
+
+BlockId Builder::add_block() {
+  auto &state = *_state;
+  state.defs.emplace_back(state.function.slots, no_value);
+  state.sealed.push_back(false);
+  state.incomplete.emplace_back();
+  return state.function.add_block();
+}
+
+ValueId Builder::emit(Instruction instruction) {
+  instruction.loc = _loc;
+  return _state->function.add(_state->current, std::move(instruction));
+}
+
+ValueId Builder::emit(Op op, std::vector<ValueId> operands) {
+  return emit(Instruction{.op = op, .operands = std::move(operands)});
+}
+
+void Builder::jump(BlockId target) {
+  emit(Op::Jump);
+  _state->function.add_edge(_state->current, target);
+}
+
+// a block is sealed once all of its predecessors are known, phis created
+// for reads before that get their operands here
+void Builder::seal(BlockId block) {
+  auto &state = *_state;
+  for (const auto &[slot, phi] : state.incomplete[block]) {
+    add_phi_operands(slot, phi);
+  }
+  state.incomplete[block].clear();
+  state.sealed[block] = true;
+}
+
+void Builder::write_variable(std::uint8_t slot, BlockId block, ValueId value) {
+  _state->defs[block][slot] = value;
+}
+
+ValueId Builder::read_variable(std::uint8_t slot, BlockId block) {
+  auto &state = *_state;
+  if (state.defs[block][slot] != no_value) {
+    return state.defs[block][slot];
+  }
+  const auto &predecessors = state.function.blocks[block].predecessors;
+  ValueId value;
+  if (!state.sealed[block]) {
+    value = state.function.add(block, {.op = Op::Phi, .loc = _loc});
+    state.incomplete[block].emplace_back(slot, value);
+  } else if (predecessors.size() == 1) {
+    value = read_variable(slot, predecessors.front());
+  } else {
+    value = state.function.add(block, {.op = Op::Phi, .loc = _loc});
+    write_variable(slot, block, value);
+    add_phi_operands(slot, value);
+  }
+  write_variable(slot, block, value);
+  return value;
+}
+
+void Builder::add_phi_operands(std::uint8_t slot, ValueId phi) {
+  auto &function = _state->function;
+  const auto predecessors = function.blocks[function.values[phi].block]
+                                .predecessors;
+  for (const auto predecessor : predecessors) {
+    const auto operand = read_variable(slot, predecessor);
+    function.values[phi].operands.push_back(operand);
+  }
+}
+
+} // namespace
+
+Module build(const Ast &ast, const Interner &symbols,
+             const SymbolTable &table) {
+  return Builder{ast, symbols, table}.run();
+}
+
+} // namespace plzerow::ir
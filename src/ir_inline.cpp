@@ -0,0 +1,218 @@
+#include "ir_inline.hpp"
+#include <algorithm>
+#include <cstdint>
+#include <limits>
+#include <vector>
+
+namespace plzerow::ir {
+
+namespace {
+
+constexpr auto none = std::numeric_limits<BlockId>::max();
+
+std::vector<ValueId> calls(const Function &function) {
+  std::vector<ValueId> result;
+  for (const auto &block : function.blocks) {
+    if (block.removed) {
+      continue;
+    }
+    for (const auto value : block.instructions) {
+      if (function.values[value].op == Op::Call) {
+        result.push_back(value);
+      }
+    }
+  }
+  return result;
+}
+
+std::size_t size(const Function &function) {
+  std::size_t result = 0;
+  for (const auto &block : function.blocks) {
+    if (!block.removed) {
+      result += block.instructions.size();
+    }
+  }
+  return result;
+}
+
+// Whether the function's body can run in the frame of a caller that is
+// hops static links below its parent: every frame it touches must belong to
+// an enclosing procedure, and stay in reach of a one byte hop count.
+bool inlinable(const Function &function, std::uint8_t hops) {
+  for (const auto &block : function.blocks) {
+    if (block.removed) {
+      continue;
+    }
+    for (const auto value : block.instructions) {
+      const auto &instruction = function.values[value];
+      if (instruction.op != Op::Load && instruction.op != Op::Store &&
+          instruction.op != Op::Call) {
+        continue;
+      }
+      if (instruction.hops == 0 ||
+          instruction.hops - 1 + hops >
+              std::numeric_limits<std::uint8_t>::max()) {
+        return false;
+      }
+    }
+  }
+  return true;
+}
+
+class CallGraph {
+public:
+  explicit CallGraph(const Module &module)
+      : _callees(module.functions.size()) {
+    for (std::size_t caller = 0; caller < module.functions.size(); ++caller) {
+      const auto &function = module.functions[caller];
+      for (const auto call : calls(function)) {
+        _callees[caller].push_back(function.values[call].constant);
+      }
+    }
+  }
+
+  bool recursive(std::size_t function) const {
+    std::vector<bool> seen(_callees.size(), false);
+    std::vector<std::size_t> work{_callees[function]};
+    while (!work.empty()) {
+      const auto next = work.back();
+      work.pop_back();
+      if (next == function) {
+        return true;
+      }
+      if (!seen[next]) {
+        seen[next] = true;
+        work.insert(work.end(), _callees[next].begin(), _callees[next].end());
+      }
+    }
+    return false;
+  }
+
+  // callees before their callers, from the main program's point of view
+  std::vector<std::size_t> bottom_up() const {
+    std::vector<std::size_t> order;
+    std::vector<bool> seen(_callees.size(), false);
+    visit(0, seen, order);
+    return order;
+  }
+
+private:
+  void visit(std::size_t function, std::vector<bool> &seen,
+             std::vector<std::size_t> &order) const {
+    seen[function] = true;
+    for (const auto callee : _callees[function]) {
+      if (!seen[callee]) {
+        visit(callee, seen, order);
+      }
+    }
+    order.push_back(function);
+  }
+
+  std::vector<std::vector<std::size_t>> _callees;
+};
+
+/*
+ * The block holding the call is split after it and jumps into a copy of the
+ * callee's blocks, whose returns jump to the rest of the block:
+ *
+ *   b: ... call f ...  =>  b: ...  jump e'   e': <body of f>  jump r   r: ...
+ */
+void inline_call(Function &caller, ValueId call, const Function &callee) {
+  const auto site = caller.values[call];
+  const auto rest = caller.add_block();
+  auto &instructions = caller.blocks[site.block].instructions;
+  const auto at = std::find(instructions.begin(), instructions.end(), call);
+  for (auto it = at + 1; it != instructions.end(); ++it) {
+    caller.values[*it].block = rest;
+    caller.blocks[rest].instructions.push_back(*it);
+  }
+  instructions.erase(at, instructions.end());
+  caller.values[call].removed = true;
+  caller.blocks[rest].successors =
+      std::move(caller.blocks[site.block].successors);
+  caller.blocks[site.block].successors.clear();
+  for (const auto successor : caller.blocks[rest].successors) {
+    auto &predecessors = caller.blocks[successor].predecessors;
+    std::replace(predecessors.begin(), predecessors.end(), site.block, rest);
+  }
+
+  std::vector<BlockId> blocks(callee.blocks.size(), none);
+  for (BlockId block = 0; block < callee.blocks.size(); ++block) {
+    if (!callee.blocks[block].removed) {
+      blocks[block] = caller.add_block();
+    }
+  }
+  // edges keep their order, phi operands follow the predecessors'
+  auto map_blocks = [&](const std::vector<BlockId> &from) {
+    std::vector<BlockId> to;
+    for (const auto block : from) {
+      to.push_back(blocks[block]);
+    }
+    return to;
+  };
+  std::vector<ValueId> values(callee.values.size(), no_value);
+  for (BlockId block = 0; block < callee.blocks.size(); ++block) {
+    if (blocks[block] == none) {
+      continue;
+    }
+    auto &copy = caller.blocks[blocks[block]];
+    copy.predecessors = map_blocks(callee.blocks[block].predecessors);
+    copy.successors = map_blocks(callee.blocks[block].successors);
+    for (const auto value : callee.blocks[block].instructions) {
+      auto instruction = callee.values[value];
+      instruction.block = blocks[block];
+      if (instruction.op == Op::Load || instruction.op == Op::Store ||
+          instruction.op == Op::Call) {
+        instruction.hops =
+            static_cast<std::uint8_t>(instruction.hops - 1 + site.hops);
+      } else if (instruction.op == Op::Return) {
+        instruction.op = Op::Jump;
+        copy.successors.push_back(rest);
+        caller.blocks[rest].predecessors.push_back(blocks[block]);
+      }
+      values[value] = static_cast<ValueId>(caller.values.size());
+      caller.values.push_back(std::move(instruction));
+      copy.instructions.push_back(values[value]);
+    }
+  }
+  for (BlockId block = 0; block < callee.blocks.size(); ++block) {
+    if (blocks[block] == none) {
+      continue;
+    }
+    for (const auto value : callee.blocks[block].instructions) {
+      for (auto &operand : caller.values[values[value]].operands) {
+        operand = values[operand];
+      }
+    }
+  }
+
+  caller.add(site.block, {.op = Op::Jump, .loc = site.loc});
+  caller.add_edge(site.block, blocks[0]);
+}
+
+} // namespace
+
+void inline_calls(Module &module, const InlineLimits &limits) {
+  if (limits.threshold == 0) {
+    return;
+  }
+  const CallGraph graph{module};
+  for (const auto index : graph.bottom_up()) {
+    auto &caller = module.functions[index];
+    std::size_t growth = 0;
+    for (const auto call : calls(caller)) {
+      const auto target = caller.values[call].constant;
+      const auto &callee = module.functions[target];
+      const auto cost = size(callee);
+      if (cost > limits.threshold || growth + cost > limits.budget ||
+          graph.recursive(target) ||
+          !inlinable(callee, caller.values[call].hops)) {
+        continue;
+      }
+      inline_call(caller, call, callee);
+      growth += cost;
+    }
+  }
+}
+
+} // namespace plzerow::ir
@@ -0,0 +1,634 @@
+#include "ir_lowering.hpp"
+#include "opcodes.hpp"
+#include "value.hpp"
+#include <algorithm>
+#include <cstdint>
+#include <limits>
+#include <utility>
+#include <vector>
+
+namespace plzerow::ir {
+
+namespace {
+
+constexpr std::size_t max_slots = std::numeric_limits<std::uint8_t>::max();
+constexpr auto no_color = std::numeric_limits<std::size_t>::max();
+
+std::uint8_t opcode(Op op) {
+  switch (op) {
+  case Op::Negate:
+    return OP_NEGATE;
+  case Op::Odd:
+    return OP_ODD;
+  case Op::Add:
+    return OP_ADD;
+  case Op::Subtract:
+    return OP_SUBTRACT;
+  case Op::Multiply:
+    return OP_MULTIPLY;
+  case Op::Divide:
+    return OP_DIVIDE;
+  case Op::Equal:
+    return OP_EQUAL;
+  case Op::NotEqual:
+    return OP_NOT_EQUAL;
+  case Op::Less:
+    return OP_LESS;
+  default:
+    return OP_GREATER;
+  }
+}
+
+// instructions that push a value computed from their operands
+bool computes(Op op) {
+  return op == Op::Load || (op >= Op::Negate && op <= Op::Greater);
+}
+
+class Lowering {
+public:
+  explicit Lowering(Module &module) : _module{module} {}
+
+  std::optional<Chunk> run();
+
+private:
+  void split_critical_edges();
+  void analyse();
+  void decide_inlining(BlockId block);
+  bool reorders(ValueId value, ValueId root) const;
+  void leaves(ValueId value, std::vector<ValueId> &out) const;
+  bool homed(ValueId value) const;
+  void compute_liveness();
+  void color(BlockId block);
+  std::size_t pick_color(std::vector<bool> &busy, std::size_t hint);
+
+  void lower_function(std::size_t index);
+  void place(BlockId block);
+  void emit(std::uint8_t byte);
+  void emit_value(ValueId value);
+  void emit_computation(ValueId value);
+  void emit_constant(std::int32_t value);
+  void emit_copies(BlockId from, BlockId to);
+  void emit_goto(BlockId target, bool fall_through);
+  void emit_forward(std::uint8_t instruction, BlockId target);
+  void emit_branch(BlockId block, ValueId condition);
+
+  Module &_module;
+  Chunk _chunk;
+  bool _failed = false;
+  std::vector<std::uint32_t> _addresses;
+  std::vector<std::pair<std::size_t, std::size_t>> _calls;
+
+  // the function being lowered
+  Function *_function = nullptr;
+  std::vector<BlockId> _order;
+  std::vector<std::size_t> _position;
+  std::vector<BlockId> _idom;
+  std::vector<std::size_t> _uses;
+  std::vector<ValueId> _user;
+  std::vector<std::size_t> _index;
+  // values computed on the stack at the instruction that uses them, the
+  // root is the first enclosing instruction that is not
+  std::vector<bool> _inline;
+  std::vector<ValueId> _root;
+  std::vector<std::vector<bool>> _live_in;
+  std::vector<std::vector<bool>> _live_out;
+  // the phi a value flows into, so they can share a slot
+  std::vector<ValueId> _phi_of;
+  std::vector<std::size_t> _color;
+  std::size_t _frame_size = 0;
+  std::vector<std::vector<std::size_t>> _pending;
+  std::vector<std::size_t> _offset;
+  SourceLoc _loc{0, 0};
+};
+
+// A phi's copies go at the end of each predecessor. A predecessor that
+// branches gets a block of its own on that edge, so the copies run only
+// when the edge is taken.
+void Lowering::split_critical_edges() {
+  auto &function = *_function;
+  for (BlockId block = 0; block < function.blocks.size(); ++block) {
+    const auto &instructions = function.blocks[block].instructions;
+    if (function.blocks[block].removed || instructions.empty() ||
+        function.values[instructions.front()].op != Op::Phi ||
+        function.blocks[block].predecessors.size() < 2) {
+      continue;
+    }
+    for (std::size_t i = 0; i < function.blocks[block].predecessors.size();
+         ++i) {
+      const auto predecessor = function.blocks[block].predecessors[i];
+      if (function.blocks[predecessor].successors.size() < 2) {
+        continue;
+      }
+      const auto middle = function.add_block();
+      auto &successors = function.blocks[predecessor].successors;
+      std::replace(successors.begin(), successors.end(), block, middle);
+      function.blocks[block].predecessors[i] = middle;
+      function.blocks[middle].predecessors.push_back(predecessor);
+      function.blocks[middle].successors.push_back(block);
+      const auto loc = function.values[function.terminator(predecessor)].loc;
+      function.add(middle, {.op = Op::Jump, .loc = loc});
+    }
+  }
+}
+
+bool Lowering::homed(ValueId value) const {
+  const auto op = _function->values[value].op;
+  return !_inline[value] && (op == Op::Phi || computes(op));
+}
+
+void Lowering::leaves(ValueId value, std::vector<ValueId> &out) const {
+  for (const auto operand : _function->values[value].operands) {
+    const auto &instruction = _function->values[operand];
+    if (instruction.op == Op::Const) {
+      continue;
+    }
+    if (_inline[operand]) {
+      leaves(operand, out);
+    } else {
+      out.push_back(operand);
+    }
+  }
+}
+
+// whether computing value at root instead would move it across a store,
+// a call or a division that may fail, which all have to stay in order
+// with loads and failing divisions
+bool Lowering::reorders(ValueId value, ValueId root) const {
+  const auto &function = *_function;
+  const auto &instruction = function.values[value];
+  if (instruction.op != Op::Load && !has_side_effects(function, instruction)) {
+    return false;
+  }
+  const auto &instructions = function.blocks[instruction.block].instructions;
+  for (auto i = _index[value] + 1; i < _index[root]; ++i) {
+    const auto &between = function.values[instructions[i]];
+    if (between.op == Op::Store || between.op == Op::Call ||
+        (between.op == Op::Divide && has_side_effects(function, between))) {
+      return true;
+    }
+  }
+  return false;
+}
+
+void Lowering::decide_inlining(BlockId block) {
+  const auto &function = *_function;
+  const auto &instructions = function.blocks[block].instructions;
+  for (auto i = instructions.size(); i-- > 0;) {
+    const auto value = instructions[i];
+    _root[value] = value;
+    if (!computes(function.values[value].op) || _uses[value] != 1) {
+      continue;
+    }
+    const auto user = _user[value];
+    if (function.values[user].block != block ||
+        function.values[user].op == Op::Phi) {
+      continue;
+    }
+    const auto root = _root[user];
+    if (reorders(value, root)) {
+      continue;
+    }
+    _inline[value] = true;
+    _root[value] = root;
+  }
+}
+
+void Lowering::analyse() {
+  auto &function = *_function;
+  const auto values = function.values.size();
+  const auto blocks = function.blocks.size();
+  _order = reverse_postorder(function);
+  _idom = dominators(function, _order);
+  _position.assign(blocks, std::numeric_limits<std::size_t>::max());
+  for (std::size_t i = 0; i < _order.size(); ++i) {
+    _position[_order[i]] = i;
+  }
+
+  _uses.assign(values, 0);
+  _user.assign(values, no_value);
+  _index.assign(values, 0);
+  _phi_of.assign(values, no_value);
+  for (const auto block : _order) {
+    const auto &instructions = function.blocks[block].instructions;
+    for (std::size_t i = 0; i < instructions.size(); ++i) {
+      const auto value = instructions[i];
+      _index[value] = i;
+      for (const auto operand : function.values[value].operands) {
+        ++_uses[operand];
+        _user[operand] = value;
+        if (function.values[value].op == Op::Phi) {
+          _phi_of[operand] = value;
+        }
+      }
+    }
+  }
+
+  _inline.assign(values, false);
+  _root.assign(values, no_value);
+  for (const auto block : _order) {
+    decide_inlining(block);
+  }
+  compute_liveness();
+}
+
+void Lowering::compute_liveness() {
+  const auto &function = *_function;
+  const auto values = function.values.size();
+  const auto blocks = function.blocks.size();
+  std::vector<std::vector<bool>> upward(blocks), defined(blocks);
+  std::vector<ValueId> used;
+  for (const auto block : _order) {
+    upward[block].assign(values, false);
+    defined[block].assign(values, false);
+    for (const auto value : function.blocks[block].instructions) {
+      const auto &instruction = function.values[value];
+      if (instruction.op != Op::Phi && !_inline[value]) {
+        used.clear();
+        leaves(value, used);
+        for (const auto operand : used) {
+          if (function.values[operand].block != block) {
+            upward[block][operand] = true;
+          }
+        }
+      }
+      if (homed(value)) {
+        defined[block][value] = true;
+      }
+    }
+  }
+
+  _live_in.assign(blocks, {});
+  _live_out.assign(blocks, {});
+  for (const auto block : _order) {
+    _live_in[block] = upward[block];
+    _live_out[block].assign(values, false);
+  }
+  for (bool changed = true; changed;) {
+    changed = false;
+    for (auto it = _order.rbegin(); it != _order.rend(); ++it) {
+      const auto block = *it;
+      auto out = std::vector<bool>(values, false);
+      for (const auto successor : function.blocks[block].successors) {
+        const auto &in = _live_in[successor];
+        for (ValueId value = 0; value < values; ++value) {
+          out[value] = out[value] || in[value];
+        }
+        const auto &predecessors = function.blocks[successor].predecessors;
+        const auto edge =
+            std::find(predecessors.begin(), predecessors.end(), block) -
+            predecessors.begin();
+        for (const auto phi : function.blocks[successor].instructions) {
+          if (function.values[phi].op != Op::Phi) {
+            break;
+          }
+          const auto operand = function.values[phi].operands[edge];
+          if (homed(operand)) {
+            out[operand] = true;
+          }
+        }
+      }
+      auto in = upward[block];
+      for (ValueId value = 0; value < values; ++value) {
+        in[value] = in[value] || (out[value] && !defined[block][value]);
+      }
+      if (in != _live_in[block] || out != _live_out[block]) {
+        _live_in[block] = std::move(in);
+        _live_out[block] = std::move(out);
+        changed = true;
+      }
+    }
+  }
+}
+
+std::size_t Lowering::pick_color(std::vector<bool> &busy, std::size_t hint) {
+  auto color = hint;
+  if (color == no_color || busy[color]) {
+    color = _function->slots;
+    while (color < busy.size() && busy[color]) {
+      ++color;
+    }
+  }
+  if (color >= max_slots) {
+    _failed = true;
+    return 0;
+  }
+  busy[color] = true;
+  _frame_size = std::max(_frame_size, color + 1);
+  return color;
+}
+
+// Colors the values defined in the block, then the blocks it dominates.
+// Every value live here was defined in a dominating block and is already
+// colored, and two values that are live at the same time never share one.
+void Lowering::color(BlockId block) {
+  const auto &function = *_function;
+  const auto &instructions = function.blocks[block].instructions;
+  std::vector<bool> busy(max_slots, false);
+  const auto &live_in = _live_in[block];
+  for (ValueId value = 0; value < live_in.size(); ++value) {
+    if (live_in[value]) {
+      busy[_color[value]] = true;
+    }
+  }
+
+  // the values whose last use is each instruction
+  std::vector<std::vector<ValueId>> dies(instructions.size());
+  auto live = _live_out[block];
+  std::vector<ValueId> used;
+  for (auto i = instructions.size(); i-- > 0;) {
+    const auto value = instructions[i];
+    if (function.values[value].op == Op::Phi || _inline[value]) {
+      continue;
+    }
+    used.clear();
+    leaves(value, used);
+    for (const auto operand : used) {
+      if (!live[operand]) {
+        live[operand] = true;
+        dies[i].push_back(operand);
+      }
+    }
+  }
+
+  std::vector<ValueId> dead_phis;
+  for (std::size_t i = 0; i < instructions.size(); ++i) {
+    const auto value = instructions[i];
+    const auto &instruction = function.values[value];
+    if (instruction.op == Op::Phi) {
+      auto hint = no_color;
+      for (const auto operand : instruction.operands) {
+        if (_color[operand] != no_color && !busy[_color[operand]]) {
+          hint = _color[operand];
+        }
+      }
+      _color[value] = pick_color(busy, hint);
+      if (!live[value]) {
+        dead_phis.push_back(value);
+      }
+      continue;
+    }
+    for (const auto phi : dead_phis) {
+      busy[_color[phi]] = false;
+    }
+    dead_phis.clear();
+    for (const auto operand : dies[i]) {
+      busy[_color[operand]] = false;
+    }
+    if (!homed(value)) {
+      continue;
+    }
+    const auto phi = _phi_of[value];
+    _color[value] =
+        pick_color(busy, phi != no_value ? _color[phi] : no_color);
+    if (_uses[value] == 0) {
+      busy[_color[value]] = false;
+    }
+  }
+}
+
+void Lowering::emit(std::uint8_t byte) { _chunk.append(byte, _loc); }
+
+void Lowering::emit_constant(std::int32_t value) {
+  if (!_chunk.append_constant(Value{value}, _loc)) {
+    _failed = true;
+  }
+}
+
+void Lowering::emit_value(ValueId value) {
+  const auto &instruction = _function->values[value];
+  if (instruction.op == Op::Const) {
+    emit_constant(instruction.constant);
+  } else if (_inline[value]) {
+    emit_computation(value);
+  } else {
+    emit(OP_GET_LOCAL);
+    emit(static_cast<std::uint8_t>(_color[value]));
+  }
+}
+
+void Lowering::emit_computation(ValueId value) {
+  const auto &instruction = _function->values[value];
+  for (const auto operand : instruction.operands) {
+    emit_value(operand);
+  }
+  _loc = instruction.loc;
+  if (instruction.op != Op::Load) {
+    emit(opcode(instruction.op));
+  } else if (instruction.hops == 0) {
+    emit(OP_GET_LOCAL);
+    emit(instruction.slot);
+  } else {
+    emit(OP_GET_VAR);
+    emit(instruction.hops);
+    emit(instruction.slot);
+  }
+}
+
+// a parallel copy through the stack: every source is pushed before the
+// first phi is written
+void Lowering::emit_copies(BlockId from, BlockId to) {
+  const auto &function = *_function;
+  const auto &predecessors = function.blocks[to].predecessors;
+  const auto edge =
+      std::find(predecessors.begin(), predecessors.end(), from) -
+      predecessors.begin();
+  std::vector<ValueId> targets;
+  for (const auto phi : function.blocks[to].instructions) {
+    if (function.values[phi].op != Op::Phi) {
+      break;
+    }
+    const auto source = function.values[phi].operands[edge];
+    if (function.values[source].op != Op::Const &&
+        _color[source] == _color[phi]) {
+      continue;
+    }
+    emit_value(source);
+    targets.push_back(phi);
+  }
+  for (auto it = targets.rbegin(); it != targets.rend(); ++it) {
+    emit(OP_SET_LOCAL);
+    emit(static_cast<std::uint8_t>(_color[*it]));
+  }
+}
+
+void Lowering::emit_forward(std::uint8_t instruction, BlockId target) {
+  emit(instruction);
+  _pending[target].push_back(_chunk.size());
+  emit(0xff);
+  emit(0xff);
+}
+
+void Lowering::emit_goto(BlockId target, bool fall_through) {
+  if (fall_through) {
+    return;
+  }
+  if (_offset[target] == no_color) {
+    emit_forward(OP_JUMP, target);
+    return;
+  }
+  emit(OP_LOOP);
+  const auto offset = _chunk.size() + 2 - _offset[target];
+  if (offset > std::numeric_limits<std::uint16_t>::max()) {
+    _failed = true;
+  }
+  emit((offset >> 8) & 0xff);
+  emit(offset & 0xff);
+}
+
+// JUMP_IF_FALSE only jumps forward, a false successor that is already
+// placed is reached through a LOOP the true path jumps over
+void Lowering::emit_branch(BlockId block, ValueId condition) {
+  const auto &successors = _function->blocks[block].successors;
+  const auto on_true = successors[0];
+  const auto on_false = successors[1];
+  const auto next = _position[block] + 1;
+  const auto falls_to = [&](BlockId target) {
+    return next < _order.size() && _order[next] == target;
+  };
+
+  emit_value(condition);
+  if (_offset[on_false] == no_color) {
+    emit_forward(OP_JUMP_IF_FALSE, on_false);
+    emit_goto(on_true, falls_to(on_true));
+    return;
+  }
+  emit(OP_JUMP_IF_FALSE);
+  const auto skip = _chunk.size();
+  emit(0xff);
+  emit(0xff);
+  emit_goto(on_true, false);
+  const auto jump = _chunk.size() - skip - 2;
+  _chunk.patch(skip, (jump >> 8) & 0xff);
+  _chunk.patch(skip + 1, jump & 0xff);
+  emit_goto(on_false, false);
+}
+
+void Lowering::place(BlockId block) {
+  _offset[block] = _chunk.size();
+  for (const auto operand : _pending[block]) {
+    const auto jump = _chunk.size() - operand - 2;
+    if (jump > std::numeric_limits<std::uint16_t>::max()) {
+      _failed = true;
+    }
+    _chunk.patch(operand, (jump >> 8) & 0xff);
+    _chunk.patch(operand + 1, jump & 0xff);
+  }
+}
+
+void Lowering::lower_function(std::size_t index) {
+  _function = &_module.functions[index];
+  auto &function = *_function;
+  split_critical_edges();
+  analyse();
+
+  _color.assign(function.values.size(), no_color);
+  _frame_size = function.slots;
+  std::vector<std::vector<BlockId>> children(function.blocks.size());
+  for (const auto block : _order) {
+    if (_idom[block] != block) {
+      children[_idom[block]].push_back(block);
+    }
+  }
+  std::vector<BlockId> work{_order.front()};
+  while (!work.empty() && !_failed) {
+    const auto block = work.back();
+    work.pop_back();
+    color(block);
+    work.insert(work.end(), children[block].rbegin(), children[block].rend());
+  }
+  if (_failed) {
+    return;
+  }
+
+  _addresses[index] = static_cast<std::uint32_t>(_chunk.size());
+  _pending.assign(function.blocks.size(), {});
+  _offset.assign(function.blocks.size(), no_color);
+  _loc = function.values[function.blocks[_order.front()].instructions.front()]
+             .loc;
+  emit(OP_ENTER);
+  emit(static_cast<std::uint8_t>(_frame_size));
+
+  for (std::size_t position = 0; position < _order.size(); ++position) {
+    const auto block = _order[position];
+    place(block);
+    for (const auto value : function.blocks[block].instructions) {
+      const auto &instruction = function.values[value];
+      if (instruction.op == Op::Phi || instruction.op == Op::Const ||
+          _inline[value]) {
+        continue;
+      }
+      _loc = instruction.loc;
+      switch (instruction.op) {
+      case Op::Store:
+        emit_value(instruction.operands[0]);
+        _loc = instruction.loc;
+        if (instruction.hops == 0) {
+          emit(OP_SET_LOCAL);
+        } else {
+          emit(OP_SET_VAR);
+          emit(instruction.hops);
+        }
+        emit(instruction.slot);
+        break;
+      case Op::Call:
+        emit(OP_CALL);
+        emit(instruction.hops);
+        _calls.emplace_back(_chunk.size(), instruction.constant);
+        for (int i = 0; i < 4; ++i) {
+          emit(0);
+        }
+        break;
+      case Op::Jump: {
+        const auto target = function.blocks[block].successors[0];
+        emit_copies(block, target);
+        _loc = instruction.loc;
+        emit_goto(target, position + 1 < _order.size() &&
+                              _order[position + 1] == target);
+        break;
+      }
+      case Op::Branch:
+        emit_branch(block, instruction.operands[0]);
+        break;
+      case Op::Return:
+        emit(OP_RETURN);
+        break;
+      default:
+        emit_computation(value);
+        emit(OP_SET_LOCAL);
+        emit(static_cast<std::uint8_t>(_color[value]));
+        break;
+      }
+    }
+  }
+}
+
+std::optional<Chunk> Lowering::run() {
+  for (const auto &name : _module.globals) {
+    _chunk.add_global(name);
+  }
+  _addresses.assign(_module.functions.size(), 0);
+  // procedures whose every call was inlined are left out
+  const auto called = called_functions(_module);
+  for (std::size_t index = 0; index < _module.functions.size(); ++index) {
+    if (!called[index]) {
+      continue;
+    }
+    lower_function(index);
+    if (_failed) {
+      return std::nullopt;
+    }
+  }
+  for (const auto &[operand, callee] : _calls) {
+    const auto address = _addresses[callee];
+    for (std::size_t i = 0; i < 4; ++i) {
+      _chunk.patch(operand + i, (address >> (24 - 8 * i)) & 0xff);
+    }
+  }
+  return std::move(_chunk);
+}
+
+} // namespace
+
+std::optional<Chunk> lower(Module module) { return Lowering{module}.run(); }
+
+} // namespace plzerow::ir
@@ -0,0 +1,1279 @@
+#include "ir_optimize.hpp"
+#include "arithmetic.hpp"
+#include <algorithm>
+#include <cstdint>
+#include <limits>
+#include <map>
+#include <optional>
+#include <utility>
+#include <vector>
+
+namespace plzerow::ir {
+
+namespace {
+
+constexpr auto none = std::numeric_limits<BlockId>::max();
+
+// the result of an instruction on constant operands, nullopt for a
+// division by zero, which is left to fail at run time
+std::optional<std::int32_t> evaluate(Op op, std::int32_t lhs,
+                                     std::int32_t rhs) {
+  switch (op) {
+  case Op::Negate:
+    return wrapping_negate(lhs);
+  case Op::Odd:
+    return (lhs & 1) != 0;
+  case Op::Add:
+    return wrapping_add(lhs, rhs);
+  case Op::Subtract:
+    return wrapping_subtract(lhs, rhs);
+  case Op::Multiply:
+    return wrapping_multiply(lhs, rhs);
+  case Op::Divide:
+    if (rhs == 0) {
+      return std::nullopt;
+    }
+    return wrapping_divide(lhs, rhs);
+  case Op::Equal:
+    return lhs == rhs;
+  case Op::NotEqual:
+    return lhs != rhs;
+  case Op::Less:
+    return lhs < rhs;
+  case Op::Greater:
+    return lhs > rhs;
+  default:
+    return std::nullopt;
+  }
+}
+
+bool is_arithmetic(Op op) { return op >= Op::Negate && op <= Op::Greater; }
+
+struct Cell {
+  enum class State : std::uint8_t { Top, Constant, Bottom };
+  State state = State::Top;
+  std::int32_t value = 0;
+
+  bool operator==(const Cell &) const = default;
+};
+
+Cell meet(Cell lhs, Cell rhs) {
+  if (lhs.state == Cell::State::Top) {
+    return rhs;
+  }
+  if (rhs.state == Cell::State::Top) {
+    return lhs;
+  }
+  if (lhs == rhs) {
+    return lhs;
+  }
+  return {Cell::State::Bottom};
+}
+
+class ConstantPropagation {
+public:
+  explicit ConstantPropagation(Function &function)
+      : _function{function}, _users{users(function)},
+        _cells(function.values.size()),
+        _executable(function.blocks.size(), false),
+        _edges(function.blocks.size()) {
+    for (BlockId block = 0; block < function.blocks.size(); ++block) {
+      _edges[block].assign(function.blocks[block].predecessors.size(), false);
+    }
+  }
+
+  void run();
+
+private:
+  void flow(BlockId from, BlockId to);
+  void visit(ValueId value);
+  Cell evaluate(const Instruction &instruction) const;
+  void rewrite();
+
+  Function &_function;
+  std::vector<std::vector<ValueId>> _users;
+  std::vector<Cell> _cells;
+  std::vector<bool> _executable;
+  // per block, whether the edge from each predecessor can be taken
+  std::vector<std::vector<bool>> _edges;
+  std::vector<std::pair<BlockId, BlockId>> _flow_work;
+  std::vector<ValueId> _ssa_work;
+};
+
+void ConstantPropagation::flow(BlockId from, BlockId to) {
+  if (from != none) {
+    const auto &predecessors = _function.blocks[to].predecessors;
+    for (std::size_t i = 0; i < predecessors.size(); ++i) {
+      if (predecessors[i] == from) {
+        if (_edges[to][i]) {
+          return;
+        }
+        _edges[to][i] = true;
+      }
+    }
+  }
+  if (!_executable[to]) {
+    _executable[to] = true;
+    for (const auto value : _function.blocks[to].instructions) {
+      visit(value);
+    }
+    return;
+  }
+  for (const auto value : _function.blocks[to].instructions) {
+    if (_function.values[value].op != Op::Phi) {
+      break;
+    }
+    visit(value);
+  }
+}
+
+Cell ConstantPropagation::evaluate(const Instruction &instruction) const {
+  using State = Cell::State;
+  switch (instruction.op) {
+  case Op::Const:
+    return {State::Constant, instruction.constant};
+  case Op::Phi: {
+    Cell result;
+    const auto &edges = _edges[instruction.block];
+    for (std::size_t i = 0; i < instruction.operands.size(); ++i) {
+      if (edges[i]) {
+        result = meet(result, _cells[instruction.operands[i]]);
+      }
+    }
+    return result;
+  }
+  default:
+    break;
+  }
+  if (!is_arithmetic(instruction.op)) {
+    return {State::Bottom};
+  }
+  std::int32_t operands[2] = {0, 0};
+  for (std::size_t i = 0; i < instruction.operands.size(); ++i) {
+    const auto &cell = _cells[instruction.operands[i]];
+    if (cell.state != State::Constant) {
+      return cell;
+    }
+    operands[i] = cell.value;
+  }
+  const auto value =
+      plzerow::ir::evaluate(instruction.op, operands[0], operands[1]);
+  if (!value) {
+    return {State::Bottom};
+  }
+  return {State::Constant, *value};
+}
+
+void ConstantPropagation::visit(ValueId value) {
+  const auto &instruction = _function.values[value];
+  const auto block = instruction.block;
+  const auto &successors = _function.blocks[block].successors;
+  switch (instruction.op) {
+  case Op::Jump:
+    _flow_work.emplace_back(block, successors[0]);
+    return;
+  case Op::Branch: {
+    const auto &cell = _cells[instruction.operands[0]];
+    if (cell.state == Cell::State::Bottom) {
+      _flow_work.emplace_back(block, successors[0]);
+      _flow_work.emplace_back(block, successors[1]);
+    } else if (cell.state == Cell::State::Constant) {
+      _flow_work.emplace_back(block, successors[cell.value != 0 ? 0 : 1]);
+    }
+    return;
+  }
+  default:
+    break;
+  }
+  const auto cell = evaluate(instruction);
+  if (cell != _cells[value]) {
+    _cells[value] = cell;
+    _ssa_work.insert(_ssa_work.end(), _users[value].begin(),
+                     _users[value].end());
+  }
+}
+
+void ConstantPropagation::run() {
+  flow(none, 0);
+  while (!_flow_work.empty() || !_ssa_work.empty()) {
+    if (!_flow_work.empty()) {
+      const auto [from, to] = _flow_work.back();
+      _flow_work.pop_back();
+      flow(from, to);
+      continue;
+    }
+    const auto value = _ssa_work.back();
+    _ssa_work.pop_back();
+    if (_executable[_function.values[value].block]) {
+      visit(value);
+    }
+  }
+  rewrite();
+}
+
+void ConstantPropagation::rewrite() {
+  for (BlockId block = 0; block < _function.blocks.size(); ++block) {
+    if (_executable[block] || _function.blocks[block].removed) {
+      continue;
+    }
+    const auto successors = _function.blocks[block].successors;
+    for (const auto successor : successors) {
+      _function.remove_edge(block, successor);
+    }
+    for (const auto value : _function.blocks[block].instructions) {
+      _function.values[value].removed = true;
+    }
+    _function.blocks[block].instructions.clear();
+    _function.blocks[block].removed = true;
+  }
+
+  for (BlockId block = 0; block < _function.blocks.size(); ++block) {
+    if (!_executable[block]) {
+      continue;
+    }
+    auto &instructions = _function.blocks[block].instructions;
+    for (const auto value : instructions) {
+      auto &instruction = _function.values[value];
+      const auto &cell = _cells[value];
+      if (instruction.op == Op::Branch) {
+        const auto &condition = _cells[instruction.operands[0]];
+        if (condition.state == Cell::State::Constant) {
+          const auto &successors = _function.blocks[block].successors;
+          _function.remove_edge(block, successors[condition.value != 0]);
+          instruction.op = Op::Jump;
+          instruction.operands.clear();
+        }
+      } else if (cell.state == Cell::State::Constant &&
+                 instruction.op != Op::Const) {
+        instruction.op = Op::Const;
+        instruction.constant = cell.value;
+        instruction.operands.clear();
+      }
+    }
+    // folded phis join the block's other instructions
+    std::stable_partition(
+        instructions.begin(), instructions.end(),
+        [&](ValueId value) { return _function.values[value].op == Op::Phi; });
+  }
+  remove_trivial_phis(_function);
+}
+
+// A value number: instructions with equal keys compute the same value.
+struct Key {
+  Op op;
+  std::int32_t constant;
+  std::uint8_t hops;
+  std::uint8_t slot;
+  // phis are only equal within a block, loads between the same stores
+  std::uint64_t scope;
+  std::vector<ValueId> operands;
+
+  auto operator<=>(const Key &) const = default;
+};
+
+class ValueNumbering {
+public:
+  explicit ValueNumbering(Function &function)
+      : _function{function}, _forward(function.values.size(), no_value) {}
+
+  void run();
+
+private:
+  ValueId resolve(ValueId value) const {
+    while (_forward[value] != no_value) {
+      value = _forward[value];
+    }
+    return value;
+  }
+  void visit(BlockId block);
+
+  Function &_function;
+  std::vector<std::vector<BlockId>> _children;
+  std::vector<ValueId> _forward;
+  std::map<Key, ValueId> _available;
+  std::uint64_t _scope = 0;
+};
+
+void ValueNumbering::visit(BlockId block) {
+  std::vector<std::map<Key, ValueId>::iterator> added;
+  auto memory = ++_scope;
+  for (const auto value : std::vector{_function.blocks[block].instructions}) {
+    auto &instruction = _function.values[value];
+    for (auto &operand : instruction.operands) {
+      operand = resolve(operand);
+    }
+    if (instruction.op == Op::Store || instruction.op == Op::Call) {
+      memory = ++_scope;
+      continue;
+    }
+    if (instruction.op != Op::Const && instruction.op != Op::Load &&
+        instruction.op != Op::Phi && !is_arithmetic(instruction.op)) {
+      continue;
+    }
+    Key key{instruction.op, instruction.constant, instruction.hops,
+            instruction.slot, 0, instruction.operands};
+    if (instruction.op == Op::Phi) {
+      key.scope = block;
+    } else if (instruction.op == Op::Load) {
+      key.scope = memory;
+    }
+    if (is_commutative(instruction.op)) {
+      std::sort(key.operands.begin(), key.operands.end());
+    }
+    const auto [it, inserted] = _available.try_emplace(std::move(key), value);
+    if (inserted) {
+      added.push_back(it);
+    } else {
+      _forward[value] = it->second;
+      _function.remove(value);
+    }
+  }
+  for (const auto child : _children[block]) {
+    visit(child);
+  }
+  for (const auto it : added) {
+    _available.erase(it);
+  }
+}
+
+void ValueNumbering::run() {
+  const auto order = reverse_postorder(_function);
+  const auto idom = dominators(_function, order);
+  _children.resize(_function.blocks.size());
+  for (const auto block : order) {
+    if (idom[block] != block) {
+      _children[idom[block]].push_back(block);
+    }
+  }
+  visit(order.front());
+  for (auto &instruction : _function.values) {
+    for (auto &operand : instruction.operands) {
+      operand = resolve(operand);
+    }
+  }
+  remove_trivial_phis(_function);
+}
+
+struct Loop {
+  BlockId header;
+  std::vector<bool> body;
+  std::size_t size = 0;
+};
+
+// the block every entry into the loop passes through, created if the
+// header has several predecessors outside the loop or one that branches
+BlockId preheader(Function &function, Loop &loop) {
+  std::vector<std::size_t> outside;
+  {
+    const auto &predecessors = function.blocks[loop.header].predecessors;
+    for (std::size_t i = 0; i < predecessors.size(); ++i) {
+      if (!loop.body[predecessors[i]]) {
+        outside.push_back(i);
+      }
+    }
+    if (outside.size() == 1 &&
+        function.blocks[predecessors[outside.front()]].successors.size() ==
+            1) {
+      return predecessors[outside.front()];
+    }
+  }
+
+  const auto block = function.add_block();
+  const auto loc =
+      function.values[function.blocks[loop.header].instructions.front()].loc;
+  // the header's phis take what flows in from outside from the new block
+  for (const auto value :
+       std::vector{function.blocks[loop.header].instructions}) {
+    if (function.values[value].op != Op::Phi) {
+      break;
+    }
+    std::vector<ValueId> incoming;
+    for (const auto i : outside) {
+      incoming.push_back(function.values[value].operands[i]);
+    }
+    auto merged = incoming.front();
+    if (std::any_of(incoming.begin(), incoming.end(),
+                    [&](ValueId v) { return v != merged; })) {
+      merged = function.add(
+          block, {.op = Op::Phi, .loc = loc, .operands = incoming});
+    }
+    auto &operands = function.values[value].operands;
+    for (auto i = outside.rbegin(); i != outside.rend(); ++i) {
+      operands.erase(operands.begin() + *i);
+    }
+    operands.push_back(merged);
+  }
+
+  auto &predecessors = function.blocks[loop.header].predecessors;
+  std::vector<BlockId> entering;
+  for (auto i = outside.rbegin(); i != outside.rend(); ++i) {
+    entering.insert(entering.begin(), predecessors[*i]);
+    predecessors.erase(predecessors.begin() + *i);
+  }
+  predecessors.push_back(block);
+  for (const auto predecessor : entering) {
+    auto &successors = function.blocks[predecessor].successors;
+    std::replace(successors.begin(), successors.end(), loop.header, block);
+    function.blocks[block].predecessors.push_back(predecessor);
+  }
+  function.blocks[block].successors.push_back(loop.header);
+  function.add(block, {.op = Op::Jump, .loc = loc});
+  return block;
+}
+
+// A back edge goes to a block that dominates its source, the loop is
+// everything that reaches the source without passing the header. Inner
+// loops come first.
+std::vector<Loop> find_loops(const Function &function) {
+  const auto order = reverse_postorder(function);
+  const auto idom = dominators(function, order);
+  std::vector<Loop> loops;
+  std::map<BlockId, std::size_t> by_header;
+  for (const auto block : order) {
+    for (const auto successor : function.blocks[block].successors) {
+      if (!dominates(idom, successor, block)) {
+        continue;
+      }
+      const auto [it, inserted] =
+          by_header.try_emplace(successor, loops.size());
+      if (inserted) {
+        loops.push_back(
+            {successor, std::vector<bool>(function.blocks.size(), false)});
+        loops.back().body[successor] = true;
+      }
+      auto &loop = loops[it->second];
+      std::vector<BlockId> work{block};
+      while (!work.empty()) {
+        const auto member = work.back();
+        work.pop_back();
+        if (loop.body[member]) {
+          continue;
+        }
+        loop.body[member] = true;
+        const auto &predecessors = function.blocks[member].predecessors;
+        work.insert(work.end(), predecessors.begin(), predecessors.end());
+      }
+    }
+  }
+  for (auto &loop : loops) {
+    loop.size = std::count(loop.body.begin(), loop.body.end(), true);
+  }
+  std::sort(loops.begin(), loops.end(), [](const Loop &a, const Loop &b) {
+    return a.size < b.size;
+  });
+  return loops;
+}
+
+// the loop's preheader, a new one belongs to every loop around it
+BlockId preheader(Function &function, std::vector<Loop> &loops, Loop &loop) {
+  const auto blocks = function.blocks.size();
+  const auto target = preheader(function, loop);
+  if (function.blocks.size() != blocks) {
+    for (auto &other : loops) {
+      other.body.resize(function.blocks.size(), false);
+      if (other.header != loop.header && other.body[loop.header]) {
+        other.body[target] = true;
+      }
+    }
+  }
+  return target;
+}
+
+bool loop_invariant(const Function &function, const Instruction &instruction,
+                    bool writes) {
+  if (instruction.op == Op::Const) {
+    return true;
+  }
+  if (instruction.op == Op::Load) {
+    return !writes;
+  }
+  return is_arithmetic(instruction.op) &&
+         !has_side_effects(function, instruction);
+}
+
+// A loop as the builder makes them from while statements: the header
+// tests the condition and branches into the body or out of the loop, and
+// is entered from the preheader and a single latch.
+struct WhileLoop {
+  BlockId header;
+  BlockId preheader;
+  BlockId latch;
+  BlockId exit;
+  // the header's phi operands flowing in from the preheader and the latch
+  std::size_t entry;
+  std::size_t back;
+};
+
+std::optional<WhileLoop> while_loop(const Function &function, const Loop &loop,
+                                    BlockId preheader) {
+  const auto &header = function.blocks[loop.header];
+  const auto terminator = function.terminator(loop.header);
+  if (header.predecessors.size() != 2 || terminator == no_value ||
+      function.values[terminator].op != Op::Branch) {
+    return std::nullopt;
+  }
+  const std::size_t entry = header.predecessors[0] == preheader ? 0 : 1;
+  const auto latch = header.predecessors[1 - entry];
+  const auto inside = loop.body[header.successors[0]];
+  if (header.predecessors[entry] != preheader || !loop.body[latch] ||
+      inside == loop.body[header.successors[1]]) {
+    return std::nullopt;
+  }
+  return WhileLoop{loop.header, preheader, latch,
+                   header.successors[inside ? 1 : 0], entry, 1 - entry};
+}
+
+// puts the instruction in front of the block's terminator
+ValueId insert_before_terminator(Function &function, BlockId block,
+                                 Instruction instruction) {
+  const auto value = function.add(block, std::move(instruction));
+  auto &instructions = function.blocks[block].instructions;
+  std::rotate(instructions.end() - 2, instructions.end() - 1,
+              instructions.end());
+  return value;
+}
+
+bool used_outside(const Function &function, const Loop &loop,
+                  const std::vector<ValueId> &users) {
+  return std::any_of(users.begin(), users.end(), [&](ValueId user) {
+    return !loop.body[function.values[user].block];
+  });
+}
+
+// sends the preheader straight to the exit and deletes the loop, whose
+// values must no longer be used after it
+void remove_loop(Function &function, const Loop &loop,
+                 const WhileLoop &shape) {
+  auto &successors = function.blocks[shape.preheader].successors;
+  std::replace(successors.begin(), successors.end(), shape.header,
+               shape.exit);
+  auto &predecessors = function.blocks[shape.exit].predecessors;
+  std::replace(predecessors.begin(), predecessors.end(), shape.header,
+               shape.preheader);
+  for (BlockId block = 0; block < function.blocks.size(); ++block) {
+    if (!loop.body[block]) {
+      continue;
+    }
+    auto &dead = function.blocks[block];
+    for (const auto value : dead.instructions) {
+      function.values[value].removed = true;
+    }
+    dead = Block{};
+    dead.removed = true;
+  }
+}
+
+bool invariant(const Function &function, const Loop &loop, ValueId value) {
+  return !loop.body[function.values[value].block];
+}
+
+std::optional<std::int32_t> constant_of(const Function &function,
+                                        ValueId value) {
+  const auto &instruction = function.values[value];
+  if (instruction.op != Op::Const) {
+    return std::nullopt;
+  }
+  return instruction.constant;
+}
+
+// a header phi that moves by a loop-invariant step every iteration
+struct Induction {
+  ValueId phi;
+  ValueId step;
+  bool down;
+};
+
+std::vector<Induction> basic_inductions(const Function &function,
+                                        const Loop &loop,
+                                        const WhileLoop &shape) {
+  auto invariant = [&](ValueId value) {
+    return ir::invariant(function, loop, value);
+  };
+  std::vector<Induction> inductions;
+  for (const auto value : function.blocks[shape.header].instructions) {
+    const auto &phi = function.values[value];
+    if (phi.op != Op::Phi) {
+      break;
+    }
+    const auto &next = function.values[phi.operands[shape.back]];
+    if (next.op == Op::Add && next.operands[0] == value &&
+        invariant(next.operands[1])) {
+      inductions.push_back({value, next.operands[1], false});
+    } else if (next.op == Op::Add && next.operands[1] == value &&
+               invariant(next.operands[0])) {
+      inductions.push_back({value, next.operands[0], false});
+    } else if (next.op == Op::Subtract && next.operands[0] == value &&
+               invariant(next.operands[1])) {
+      inductions.push_back({value, next.operands[1], true});
+    }
+  }
+  return inductions;
+}
+
+// the induction variable the value moves with, plus invariants
+const Induction *moves_with(const Function &function, const Loop &loop,
+                            const std::vector<Induction> &inductions,
+                            ValueId value) {
+  auto invariant = [&](ValueId value) {
+    return ir::invariant(function, loop, value);
+  };
+  while (true) {
+    for (const auto &candidate : inductions) {
+      if (candidate.phi == value) {
+        return &candidate;
+      }
+    }
+    const auto &instruction = function.values[value];
+    if (invariant(value) ||
+        (instruction.op != Op::Add && instruction.op != Op::Subtract)) {
+      return nullptr;
+    }
+    const auto lhs = instruction.operands[0];
+    const auto rhs = instruction.operands[1];
+    if (invariant(rhs)) {
+      value = lhs;
+    } else if (instruction.op == Op::Add && invariant(lhs)) {
+      value = rhs;
+    } else {
+      return nullptr;
+    }
+  }
+}
+
+// the value on the first iteration of one that moves with the variable,
+// built in the preheader
+ValueId first_value(Function &function, const Loop &loop,
+                    const WhileLoop &shape, ValueId value,
+                    const Induction &variable) {
+  if (value == variable.phi) {
+    return function.values[value].operands[shape.entry];
+  }
+  auto instruction = function.values[value];
+  for (auto &operand : instruction.operands) {
+    if (!invariant(function, loop, operand)) {
+      operand = first_value(function, loop, shape, operand, variable);
+    }
+  }
+  return insert_before_terminator(function, shape.preheader,
+                                  std::move(instruction));
+}
+
+// how often the body of a loop runs, and the value its induction variable
+// has when the header's test ends it
+struct TripCount {
+  const Induction *variable;
+  std::int64_t trips;
+  std::int64_t step;
+  std::int32_t last;
+};
+
+// how many steps a variable takes from start until the comparison with
+// bound no longer keeps it in the loop, nullopt if it would wrap around or
+// never get there
+std::optional<std::int64_t> iterations(Op op, bool stays, std::int64_t start,
+                                       std::int64_t step,
+                                       std::int64_t bound) {
+  // the values the loop exits on: from the threshold up, from it down, the
+  // threshold itself or all others
+  enum class Exit : std::uint8_t { Up, Down, At, Off };
+  auto exit = Exit::At;
+  auto threshold = bound;
+  switch (op) {
+  case Op::Less:
+    exit = stays ? Exit::Up : Exit::Down;
+    threshold = stays ? bound : bound - 1;
+    break;
+  case Op::Greater:
+    exit = stays ? Exit::Down : Exit::Up;
+    threshold = stays ? bound : bound + 1;
+    break;
+  case Op::NotEqual:
+    exit = stays ? Exit::At : Exit::Off;
+    break;
+  case Op::Equal:
+    exit = stays ? Exit::Off : Exit::At;
+    break;
+  default:
+    return std::nullopt;
+  }
+
+  std::int64_t trips = 0;
+  switch (exit) {
+  case Exit::Up:
+    if (start < threshold) {
+      if (step <= 0) {
+        return std::nullopt;
+      }
+      trips = (threshold - start + step - 1) / step;
+    }
+    break;
+  case Exit::Down:
+    if (start > threshold) {
+      if (step >= 0) {
+        return std::nullopt;
+      }
+      trips = (start - threshold - step - 1) / -step;
+    }
+    break;
+  case Exit::At:
+    if (start != threshold) {
+      if (step == 0 || (threshold - start) % step != 0 ||
+          (threshold - start) / step < 0) {
+        return std::nullopt;
+      }
+      trips = (threshold - start) / step;
+    }
+    break;
+  case Exit::Off:
+    if (start == threshold) {
+      if (step == 0) {
+        return std::nullopt;
+      }
+      trips = 1;
+    }
+    break;
+  }
+  // the variable moves one way, if its last value fits none before wrapped
+  const auto last = start + trips * step;
+  if (last < std::numeric_limits<std::int32_t>::min() ||
+      last > std::numeric_limits<std::int32_t>::max()) {
+    return std::nullopt;
+  }
+  return trips;
+}
+
+// the trip count of a loop whose header compares a basic induction
+// variable with a constant start and step against a constant
+std::optional<TripCount> trip_count(const Function &function,
+                                    const Loop &loop, const WhileLoop &shape,
+                                    const std::vector<Induction> &inductions) {
+  const auto &branch = function.values[function.terminator(shape.header)];
+  const auto &test = function.values[branch.operands[0]];
+  if (test.operands.size() != 2) {
+    return std::nullopt;
+  }
+  const auto stays = loop.body[function.blocks[shape.header].successors[0]];
+  for (const auto &variable : inductions) {
+    auto op = test.op;
+    std::optional<std::int32_t> bound;
+    if (test.operands[0] == variable.phi) {
+      bound = constant_of(function, test.operands[1]);
+    } else if (test.operands[1] == variable.phi) {
+      bound = constant_of(function, test.operands[0]);
+      if (op == Op::Less || op == Op::Greater) {
+        op = op == Op::Less ? Op::Greater : Op::Less;
+      }
+    } else {
+      continue;
+    }
+    const auto start = constant_of(
+        function, function.values[variable.phi].operands[shape.entry]);
+    const auto step = constant_of(function, variable.step);
+    if (!bound || !start || !step) {
+      continue;
+    }
+    const auto signed_step =
+        variable.down ? -std::int64_t{*step} : std::int64_t{*step};
+    const auto trips = iterations(op, stays, *start, signed_step, *bound);
+    if (trips) {
+      return TripCount{&variable, *trips, signed_step,
+                       static_cast<std::int32_t>(*start +
+                                                 *trips * signed_step)};
+    }
+  }
+  return std::nullopt;
+}
+
+/*
+ * Replaces a loop that runs a known number of times n with the values it
+ * leaves behind, when every header value used after it follows from the
+ * variables that step by an invariant x, which end at start + n * x, and
+ * those that add a value moving by d from x0, which end at
+ * start + n * x0 + d * n * (n - 1) / 2. Both are exact in wrapping
+ * arithmetic, so a loop that overflows ends the same way.
+ */
+bool close_loop(Function &function, const std::vector<Loop> &loops,
+                const Loop &loop, const WhileLoop &shape,
+                const std::vector<Induction> &inductions,
+                const TripCount &count) {
+  // an inner loop might not end
+  for (const auto &other : loops) {
+    if (other.header != loop.header && loop.body[other.header] &&
+        !function.blocks[other.header].removed) {
+      return false;
+    }
+  }
+  const auto uses = users(function);
+  for (BlockId block = 0; block < function.blocks.size(); ++block) {
+    if (!loop.body[block] || function.blocks[block].removed) {
+      continue;
+    }
+    for (const auto value : function.blocks[block].instructions) {
+      const auto &instruction = function.values[value];
+      if ((instruction.op != Op::Jump && instruction.op != Op::Branch &&
+           has_side_effects(function, instruction)) ||
+          (block != shape.header &&
+           used_outside(function, loop, uses[value]))) {
+        return false;
+      }
+    }
+  }
+
+  // the header values needed after the loop and how the phis among them
+  // move: by an invariant or by a value moving with an induction variable
+  struct Update {
+    ValueId value;
+    ValueId addend;
+    const Induction *variable;
+    bool subtract;
+  };
+  const auto &header = function.blocks[shape.header].instructions;
+  std::vector<bool> needed(function.values.size(), false);
+  for (auto value = header.rbegin(); value != header.rend(); ++value) {
+    if (function.values[*value].op == Op::Branch ||
+        (!needed[*value] && !used_outside(function, loop, uses[*value]))) {
+      continue;
+    }
+    needed[*value] = true;
+    for (const auto operand : function.values[*value].operands) {
+      if (function.values[operand].block == shape.header) {
+        needed[operand] = true;
+      }
+    }
+  }
+  std::vector<Update> updates;
+  for (const auto value : header) {
+    const auto &phi = function.values[value];
+    if (phi.op != Op::Phi) {
+      break;
+    }
+    if (!needed[value]) {
+      continue;
+    }
+    const auto &next = function.values[phi.operands[shape.back]];
+    if (next.op != Op::Add && next.op != Op::Subtract) {
+      return false;
+    }
+    auto addend = next.operands[1];
+    if (next.operands[0] != value) {
+      if (next.op == Op::Subtract || next.operands[1] != value) {
+        return false;
+      }
+      addend = next.operands[0];
+    }
+    const Induction *variable = nullptr;
+    if (!invariant(function, loop, addend)) {
+      variable = moves_with(function, loop, inductions, addend);
+      if (variable == nullptr) {
+        return false;
+      }
+    }
+    updates.push_back({value, addend, variable, next.op == Op::Subtract});
+  }
+
+  const auto loc = function.values[function.terminator(shape.header)].loc;
+  auto emit = [&](Op op, std::vector<ValueId> operands) {
+    return insert_before_terminator(
+        function, shape.preheader,
+        {.op = op, .loc = loc, .operands = std::move(operands)});
+  };
+  auto number = [&](std::uint64_t value) {
+    return insert_before_terminator(
+        function, shape.preheader,
+        {.op = Op::Const,
+         .loc = loc,
+         .constant = static_cast<std::int32_t>(
+             static_cast<std::uint32_t>(value))});
+  };
+  // n * (n - 1) is below 2^64 for any n a 32-bit variable can count to
+  const auto trips = static_cast<std::uint64_t>(count.trips);
+  const auto pairs = trips * (trips == 0 ? 0 : trips - 1) / 2;
+  std::vector<ValueId> last(function.values.size(), no_value);
+  for (const auto &update : updates) {
+    auto total = emit(Op::Multiply, {number(trips), update.addend});
+    if (update.variable != nullptr) {
+      const auto *variable = update.variable;
+      const auto first =
+          first_value(function, loop, shape, update.addend, *variable);
+      total = emit(variable->down ? Op::Subtract : Op::Add,
+                   {emit(Op::Multiply, {number(trips), first}),
+                    emit(Op::Multiply, {variable->step, number(pairs)})});
+    }
+    const auto start = function.values[update.value].operands[shape.entry];
+    last[update.value] =
+        emit(update.subtract ? Op::Subtract : Op::Add, {start, total});
+  }
+  for (const auto value : header) {
+    auto instruction = function.values[value];
+    if (!needed[value] || instruction.op == Op::Phi) {
+      continue;
+    }
+    for (auto &operand : instruction.operands) {
+      if (last[operand] != no_value) {
+        operand = last[operand];
+      }
+    }
+    last[value] = insert_before_terminator(function, shape.preheader,
+                                           std::move(instruction));
+  }
+  for (const auto value : std::vector{header}) {
+    if (needed[value]) {
+      function.replace_uses(value, last[value]);
+    }
+  }
+  remove_loop(function, loop, shape);
+  return true;
+}
+
+/*
+ * Tests a loop that runs a known number of times by comparing its
+ * induction variable with the value it exits at, so that a # or = test
+ * becomes the < or > the peephole pass fuses with the branch into
+ * JUMP_IF_NOT_LESS or JUMP_IF_NOT_GREATER.
+ */
+void count_loop(Function &function, const Loop &loop, const WhileLoop &shape,
+                const TripCount &count) {
+  const auto branch = function.terminator(shape.header);
+  const auto &test = function.values[function.values[branch].operands[0]];
+  if (count.trips == 0 || test.op == Op::Less || test.op == Op::Greater) {
+    return;
+  }
+  const auto loc = test.loc;
+  const auto last = insert_before_terminator(
+      function, shape.preheader,
+      {.op = Op::Const, .loc = loc, .constant = count.last});
+  const auto compare = insert_before_terminator(
+      function, shape.header,
+      {.op = count.step > 0 ? Op::Less : Op::Greater,
+       .loc = loc,
+       .operands = {count.variable->phi, last}});
+  function.values[branch].operands[0] = compare;
+  auto &successors = function.blocks[shape.header].successors;
+  if (!loop.body[successors[0]]) {
+    std::swap(successors[0], successors[1]);
+  }
+}
+
+// instructions run at compile time before giving up on a loop
+constexpr std::size_t evaluation_budget = 100'000;
+
+/*
+ * Loops whose every value follows from constants but have no closed form,
+ * such as a product, are run at compile time and replaced by the values
+ * they leave behind. The loop runs on the same wrapping arithmetic as the
+ * VM, so a loop that overflows ends the same way; one that divides by zero
+ * or runs past the budget is left alone.
+ */
+bool evaluate_loop(Function &function, const Loop &loop,
+                   const WhileLoop &shape) {
+  const auto uses = users(function);
+  for (BlockId block = 0; block < function.blocks.size(); ++block) {
+    if (!loop.body[block] || function.blocks[block].removed) {
+      continue;
+    }
+    for (const auto value : function.blocks[block].instructions) {
+      const auto &instruction = function.values[value];
+      if (instruction.op != Op::Const && instruction.op != Op::Phi &&
+          instruction.op != Op::Jump && instruction.op != Op::Branch &&
+          !is_arithmetic(instruction.op)) {
+        return false;
+      }
+      for (const auto operand : instruction.operands) {
+        if (!loop.body[function.values[operand].block] &&
+            function.values[operand].op != Op::Const) {
+          return false;
+        }
+      }
+      // only values of the last test can be seen after the loop
+      for (const auto user : uses[value]) {
+        if (!loop.body[function.values[user].block] &&
+            block != shape.header) {
+          return false;
+        }
+      }
+    }
+  }
+
+  std::vector<std::int32_t> values(function.values.size(), 0);
+  auto read = [&](ValueId value) {
+    const auto &instruction = function.values[value];
+    return instruction.op == Op::Const ? instruction.constant : values[value];
+  };
+  std::vector<std::pair<ValueId, std::int32_t>> incoming;
+  std::size_t steps = 0;
+  auto from = shape.preheader;
+  auto block = shape.header;
+  while (loop.body[block]) {
+    const auto &current = function.blocks[block];
+    const auto edge = std::find(current.predecessors.begin(),
+                                current.predecessors.end(), from) -
+                      current.predecessors.begin();
+    // phis take their values all at once
+    incoming.clear();
+    for (const auto value : current.instructions) {
+      const auto &instruction = function.values[value];
+      if (instruction.op != Op::Phi) {
+        break;
+      }
+      incoming.emplace_back(value, read(instruction.operands[edge]));
+    }
+    for (const auto &[phi, result] : incoming) {
+      values[phi] = result;
+    }
+    auto next = block;
+    for (const auto value : current.instructions) {
+      const auto &instruction = function.values[value];
+      if (++steps > evaluation_budget) {
+        return false;
+      }
+      switch (instruction.op) {
+      case Op::Phi:
+      case Op::Const:
+        break;
+      case Op::Jump:
+        next = current.successors[0];
+        break;
+      case Op::Branch:
+        next = current.successors[read(instruction.operands[0]) != 0 ? 0 : 1];
+        break;
+      default: {
+        const auto &operands = instruction.operands;
+        const auto result =
+            evaluate(instruction.op, read(operands[0]),
+                     operands.size() > 1 ? read(operands[1]) : 0);
+        if (!result) {
+          return false;
+        }
+        values[value] = *result;
+        break;
+      }
+      }
+    }
+    from = block;
+    block = next;
+  }
+  if (from != shape.header) {
+    return false;
+  }
+
+  for (const auto value : function.blocks[shape.header].instructions) {
+    const auto &instruction = function.values[value];
+    if (instruction.op == Op::Branch ||
+        !used_outside(function, loop, uses[value])) {
+      continue;
+    }
+    const auto loc = instruction.loc;
+    const auto constant = insert_before_terminator(
+        function, shape.preheader,
+        {.op = Op::Const, .loc = loc, .constant = values[value]});
+    function.replace_uses(value, constant);
+  }
+
+  remove_loop(function, loop, shape);
+  return true;
+}
+
+/*
+ * Replaces products of an induction variable and a loop-invariant factor
+ * with a phi of their own that moves by step * factor. The induction
+ * variable may be offset by invariants first, as in (i + 1) * k. Wrapping
+ * multiplication distributes over wrapping addition, so the sums are
+ * exactly the products even when they overflow.
+ */
+void reduce_strength(Function &function, const Loop &loop,
+                     const WhileLoop &shape,
+                     const std::vector<Induction> &inductions) {
+  auto invariant = [&](ValueId value) {
+    return ir::invariant(function, loop, value);
+  };
+
+  for (BlockId block = 0; block < function.blocks.size(); ++block) {
+    if (!loop.body[block] || function.blocks[block].removed) {
+      continue;
+    }
+    const auto instructions = function.blocks[block].instructions;
+    for (const auto product : instructions) {
+      const auto &instruction = function.values[product];
+      if (instruction.op != Op::Multiply) {
+        continue;
+      }
+      auto operand = instruction.operands[0];
+      auto factor = instruction.operands[1];
+      if (!invariant(factor)) {
+        std::swap(operand, factor);
+      }
+      const auto *variable =
+          invariant(factor) ? moves_with(function, loop, inductions, operand)
+                            : nullptr;
+      if (variable == nullptr) {
+        continue;
+      }
+      const auto loc = instruction.loc;
+      const auto start = insert_before_terminator(
+          function, shape.preheader,
+          {.op = Op::Multiply,
+           .loc = loc,
+           .operands = {first_value(function, loop, shape, operand,
+                                    *variable),
+                        factor}});
+      const auto step = insert_before_terminator(
+          function, shape.preheader,
+          {.op = Op::Multiply,
+           .loc = loc,
+           .operands = {variable->step, factor}});
+      const auto phi =
+          function.add(shape.header, {.op = Op::Phi, .loc = loc});
+      const auto next = insert_before_terminator(
+          function, shape.latch,
+          {.op = variable->down ? Op::Subtract : Op::Add,
+           .loc = loc,
+           .operands = {phi, step}});
+      auto &operands = function.values[phi].operands;
+      operands.resize(2);
+      operands[shape.entry] = start;
+      operands[shape.back] = next;
+      function.replace_uses(product, phi);
+      function.remove(product);
+    }
+  }
+}
+
+} // namespace
+
+void propagate_constants(Function &function) {
+  ConstantPropagation{function}.run();
+}
+
+void eliminate_dead_code(Function &function) {
+  std::vector<bool> live(function.values.size(), false);
+  std::vector<ValueId> work;
+  for (const auto &block : function.blocks) {
+    for (const auto value : block.instructions) {
+      if (has_side_effects(function, function.values[value])) {
+        live[value] = true;
+        work.push_back(value);
+      }
+    }
+  }
+  while (!work.empty()) {
+    const auto value = work.back();
+    work.pop_back();
+    for (const auto operand : function.values[value].operands) {
+      if (!live[operand]) {
+        live[operand] = true;
+        work.push_back(operand);
+      }
+    }
+  }
+  for (auto &block : function.blocks) {
+    std::erase_if(block.instructions, [&](ValueId value) {
+      function.values[value].removed = !live[value];
+      return !live[value];
+    });
+  }
+}
+
+void number_values(Function &function) { ValueNumbering{function}.run(); }
+
+void hoist_loop_invariants(Function &function) {
+  auto loops = find_loops(function);
+  for (auto &loop : loops) {
+    const auto target = preheader(function, loops, loop);
+
+    bool writes = false;
+    for (BlockId block = 0; block < function.blocks.size(); ++block) {
+      if (!loop.body[block]) {
+        continue;
+      }
+      for (const auto value : function.blocks[block].instructions) {
+        const auto op = function.values[value].op;
+        writes = writes || op == Op::Store || op == Op::Call;
+      }
+    }
+
+    // inner preheaders are part of the loop too, what was hoisted into
+    // them can move further out
+    for (bool changed = true; changed;) {
+      changed = false;
+      for (BlockId block = 0; block < function.blocks.size(); ++block) {
+        if (!loop.body[block]) {
+          continue;
+        }
+        const auto instructions = function.blocks[block].instructions;
+        for (const auto value : instructions) {
+          auto &instruction = function.values[value];
+          if (!loop_invariant(function, instruction, writes) ||
+              std::any_of(instruction.operands.begin(),
+                          instruction.operands.end(), [&](ValueId operand) {
+                            return loop.body[function.values[operand].block];
+                          })) {
+            continue;
+          }
+          auto &from = function.blocks[block].instructions;
+          from.erase(std::find(from.begin(), from.end(), value));
+          auto &to = function.blocks[target].instructions;
+          to.insert(to.end() - 1, value);
+          instruction.block = target;
+          changed = true;
+        }
+      }
+    }
+  }
+}
+
+void optimize_loops(Function &function) {
+  auto loops = find_loops(function);
+  for (auto &loop : loops) {
+    if (function.blocks[loop.header].removed) {
+      continue;
+    }
+    const auto target = preheader(function, loops, loop);
+    const auto shape = while_loop(function, loop, target);
+    if (!shape) {
+      continue;
+    }
+    const auto inductions = basic_inductions(function, loop, *shape);
+    const auto count = trip_count(function, loop, *shape, inductions);
+    if (count &&
+        close_loop(function, loops, loop, *shape, inductions, *count)) {
+      continue;
+    }
+    if (evaluate_loop(function, loop, *shape)) {
+      continue;
+    }
+    if (count) {
+      count_loop(function, loop, *shape, *count);
+    }
+    reduce_strength(function, loop, *shape, inductions);
+  }
+}
+
+void optimize(Module &module, unsigned level, const InlineLimits &limits) {
+  if (level == 0) {
+    return;
+  }
+  for (auto &function : module.functions) {
+    propagate_constants(function);
+    eliminate_dead_code(function);
+  }
+  if (level < 2) {
+    return;
+  }
+  // callees are measured after their own cleanup, and inlined bodies see
+  // the caller's constants on the second round
+  inline_calls(module, limits);
+  for (auto &function : module.functions) {
+    propagate_constants(function);
+    eliminate_dead_code(function);
+    // hoisting first puts copies from sibling blocks in one preheader,
+    // where numbering merges them
+    hoist_loop_invariants(function);
+    number_values(function);
+    eliminate_dead_code(function);
+    optimize_loops(function);
+    propagate_constants(function);
+    eliminate_dead_code(function);
+  }
+}
+
+} // namespace plzerow::ir
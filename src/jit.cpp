@@ -0,0 +1,946 @@
+#include "jit.hpp"
+#include "arithmetic.hpp"
+#include "opcodes.hpp"
+#include "value.hpp"
+#include <algorithm>
+#include <array>
+#include <cstddef>
+#include <cstring>
+#include <initializer_list>
+#include <limits>
+#include <utility>
+#include <variant>
+
+#if defined(__x86_64__) && (defined(__unix__) || defined(__APPLE__))
+#include <sys/mman.h>
+#define PLZEROW_HAS_JIT 1
+#endif
+
+namespace {
+
+using plzerow::JitCode;
+
+// what the generated code reads and writes through r15
+struct JitState {
+  void *saved_rsp;
+  void *stack_top;
+  // the lowest rsp a procedure may be entered with
+  void *stack_limit;
+  std::int32_t *frames;
+  std::int32_t *frames_end;
+  std::int32_t *spills;
+  JitCode::Status status;
+  std::uint32_t offset;
+};
+
+// the runtime side of every slow path
+void record_error(JitState *state, JitCode::Status status,
+                  std::uint32_t offset) {
+  state->status = status;
+  state->offset = offset;
+}
+
+constexpr std::size_t native_stack_size = 64 << 20;
+constexpr std::size_t frame_area_size = 256 << 20;
+// left below stack_limit for the call into record_error
+constexpr std::size_t stack_reserve = 64 << 10;
+
+enum Reg : std::uint8_t {
+  RAX,
+  RCX,
+  RDX,
+  RBX,
+  RSP,
+  RBP,
+  RSI,
+  RDI,
+  R8,
+  R9,
+  R10,
+  R11,
+  R12,
+  R13,
+  R14,
+  R15,
+};
+
+enum Cond : std::uint8_t {
+  EQ = 0x4,
+  NE = 0x5,
+  BELOW = 0x2,
+  ABOVE = 0x7,
+  LT = 0xc,
+  GE = 0xd,
+  LE = 0xe,
+  GT = 0xf,
+};
+
+// the /digit of the 0x81 group, also the row of the r/m forms
+enum class Alu : std::uint8_t { Add = 0, And = 4, Sub = 5, Cmp = 7 };
+
+// a register, [base + displacement] or an immediate
+struct Operand {
+  enum class Kind : std::uint8_t { Register, Memory, Immediate };
+  Kind kind;
+  Reg reg;
+  std::int32_t value;
+};
+
+constexpr Operand reg(Reg r) { return {Operand::Kind::Register, r, 0}; }
+constexpr Operand mem(Reg base, std::int32_t displacement) {
+  return {Operand::Kind::Memory, base, displacement};
+}
+constexpr Operand imm(std::int32_t value) {
+  return {Operand::Kind::Immediate, RAX, value};
+}
+
+// a JitState member, by offsetof
+constexpr Operand state(std::size_t offset) {
+  return mem(R15, static_cast<std::int32_t>(offset));
+}
+
+// Encodes the handful of instructions the translator needs. 32-bit forms
+// unless `wide`, memory operands always take a 32-bit displacement.
+class Assembler {
+public:
+  std::size_t position() const { return _code.size(); }
+  std::vector<std::uint8_t> &code() { return _code; }
+
+  void mov(Reg dst, Operand src, bool wide = false) {
+    if (src.kind == Operand::Kind::Immediate) {
+      if (dst >= R8) {
+        byte(0x41);
+      }
+      byte(0xb8 + (dst & 7));
+      dword(src.value);
+    } else {
+      instruction({0x8b}, dst, src, wide);
+    }
+  }
+  void mov(Operand dst, Reg src, bool wide = false) {
+    instruction({0x89}, src, dst, wide);
+  }
+  void mov(Operand dst, std::int32_t value, bool wide = false) {
+    instruction({0xc7}, 0, dst, wide);
+    dword(value);
+  }
+  void mov64(Reg dst, std::uint64_t value) {
+    byte(0x48 | (dst >= R8 ? 1 : 0));
+    byte(0xb8 + (dst & 7));
+    for (int i = 0; i < 8; ++i) {
+      byte(static_cast<std::uint8_t>(value >> (8 * i)));
+    }
+  }
+  void lea(Reg dst, Operand src) { instruction({0x8d}, dst, src, true); }
+
+  void alu(Alu op, Reg dst, Operand src, bool wide = false) {
+    if (src.kind == Operand::Kind::Immediate) {
+      alu(op, reg(dst), src.value, wide);
+    } else {
+      instruction({static_cast<std::uint8_t>(static_cast<int>(op) * 8 + 3)},
+                  dst, src, wide);
+    }
+  }
+  void alu(Alu op, Operand dst, std::int32_t value, bool wide = false) {
+    instruction({0x81}, static_cast<std::uint8_t>(op), dst, wide);
+    dword(value);
+  }
+  void imul(Reg dst, Operand src) {
+    if (src.kind == Operand::Kind::Immediate) {
+      instruction({0x69}, dst, reg(dst), false);
+      dword(src.value);
+    } else {
+      instruction({0x0f, 0xaf}, dst, src, false);
+    }
+  }
+  void neg(Operand operand) { instruction({0xf7}, 3, operand, false); }
+  void idiv(Operand divisor) { instruction({0xf7}, 7, divisor, false); }
+  void cdq() { byte(0x99); }
+  void test(Reg a, Reg b) { instruction({0x85}, b, reg(a), false); }
+  // eax = condition ? 1 : 0
+  void set(Cond cond) {
+    instruction({0x0f, static_cast<std::uint8_t>(0x90 | cond)}, 0, reg(RAX),
+                false);
+    instruction({0x0f, 0xb6}, RAX, reg(RAX), false);
+  }
+  void rep_stosq() {
+    byte(0xf3);
+    byte(0x48);
+    byte(0xab);
+  }
+
+  void push(Reg r) {
+    if (r >= R8) {
+      byte(0x41);
+    }
+    byte(0x50 + (r & 7));
+  }
+  void pop(Reg r) {
+    if (r >= R8) {
+      byte(0x41);
+    }
+    byte(0x58 + (r & 7));
+  }
+  void ret() { byte(0xc3); }
+  void call(Reg target) { instruction({0xff}, 2, reg(target), false); }
+
+  // rel32 branches, the returned position is patched by bind()
+  std::size_t jump() {
+    byte(0xe9);
+    return placeholder();
+  }
+  std::size_t jump(Cond cond) {
+    byte(0x0f);
+    byte(0x80 | cond);
+    return placeholder();
+  }
+  std::size_t call() {
+    byte(0xe8);
+    return placeholder();
+  }
+  void bind(std::size_t fixup, std::size_t target) {
+    const auto relative = static_cast<std::int32_t>(
+        static_cast<std::int64_t>(target) -
+        static_cast<std::int64_t>(fixup + 4));
+    std::memcpy(_code.data() + fixup, &relative, sizeof relative);
+  }
+  void bind(std::size_t fixup) { bind(fixup, position()); }
+
+private:
+  void byte(std::uint8_t value) { _code.push_back(value); }
+  void dword(std::int32_t value) {
+    for (int i = 0; i < 4; ++i) {
+      byte(static_cast<std::uint8_t>(static_cast<std::uint32_t>(value) >>
+                                     (8 * i)));
+    }
+  }
+  std::size_t placeholder() {
+    dword(0);
+    return position() - 4;
+  }
+
+  // [REX] opcode ModRM [SIB] [disp32], `field` is the ModRM reg field
+  void instruction(std::initializer_list<std::uint8_t> opcode,
+                   std::uint8_t field, Operand rm, bool wide) {
+    const std::uint8_t rex = (wide ? 8 : 0) | (field & 8 ? 4 : 0) |
+                             (rm.reg & 8 ? 1 : 0);
+    if (rex != 0) {
+      byte(0x40 | rex);
+    }
+    for (const auto value : opcode) {
+      byte(value);
+    }
+    if (rm.kind == Operand::Kind::Register) {
+      byte(0xc0 | (field & 7) << 3 | (rm.reg & 7));
+      return;
+    }
+    byte(0x80 | (field & 7) << 3 | (rm.reg & 7));
+    if ((rm.reg & 7) == RSP) {
+      byte(0x24);
+    }
+    dword(rm.value);
+  }
+
+  std::vector<std::uint8_t> _code;
+};
+
+// hold the operand stack, all caller-saved since the stack is empty at every
+// call; rax and rdx are scratch and r13 holds constant divisors
+constexpr std::array stack_registers{RCX, RSI, RDI, R8, R9, R10, R11};
+
+/*
+ * Registers while translated code runs:
+ *
+ *   rbx  the current frame: its static link, then its variables
+ *   r12  the first free byte of the frame area
+ *   r14  the operand stack entries that do not fit in registers
+ *   r15  the JitState
+ *   rax  the static link passed to a procedure
+ */
+class Translator {
+public:
+  explicit Translator(const plzerow::Chunk &chunk)
+      : _chunk{chunk}, _code{chunk.cbegin()}, _starts(chunk.size() + 1, false),
+        _targets(chunk.size() + 1, false), _labels(chunk.size() + 1, none) {}
+
+  bool run();
+  std::vector<std::uint8_t> &code() { return _asm.code(); }
+  std::size_t spills() const {
+    return _depth > stack_registers.size() ? _depth - stack_registers.size()
+                                           : 0;
+  }
+
+private:
+  static constexpr auto none = std::numeric_limits<std::size_t>::max();
+
+  // an operand stack entry, constants stay out of registers until an
+  // instruction needs them
+  struct Entry {
+    bool constant;
+    std::int32_t value;
+  };
+
+  bool scan();
+  void entry_code();
+  bool translate(std::size_t offset);
+  void enter(std::size_t offset, std::uint8_t variables);
+  void arithmetic(std::uint8_t instruction);
+  void divide(std::size_t offset);
+  void compare(std::size_t left);
+  void comparison(std::uint8_t instruction);
+  bool branch_unless(std::uint8_t instruction, std::size_t target);
+  void static_link(std::uint8_t hops);
+  void fail(JitCode::Status status, std::size_t offset);
+
+  Operand location(std::size_t depth) const;
+  Operand operand(std::size_t depth) const;
+  void push_constant(std::int32_t value);
+  // copies source to the next free entry
+  void push(Operand source);
+  void store(Operand destination, Operand source);
+  void load(Reg destination, Operand source);
+  Operand variable(std::uint8_t slot, Reg frame) const {
+    return mem(frame, 8 + 4 * slot);
+  }
+
+  std::uint8_t byte(std::size_t offset) const { return _code[offset]; }
+  std::uint16_t read_short(std::size_t offset) const {
+    return static_cast<std::uint16_t>(byte(offset) << 8 | byte(offset + 1));
+  }
+  std::int32_t constant(std::size_t index) const {
+    return std::get<std::int32_t>(_chunk.constant(index));
+  }
+  void jump_to(std::size_t fixup, std::size_t target) {
+    _fixups.emplace_back(fixup, target);
+  }
+
+  const plzerow::Chunk &_chunk;
+  const std::uint8_t *_code;
+  Assembler _asm;
+  std::vector<Entry> _stack;
+  std::size_t _depth = 0;
+  // instruction starts, and jump targets and procedure entries, by offset
+  std::vector<bool> _starts;
+  std::vector<bool> _targets;
+  // native position of every jump target and entry
+  std::vector<std::size_t> _labels;
+  std::vector<std::pair<std::size_t, std::size_t>> _fixups;
+  std::size_t _error = 0;
+};
+
+bool Translator::run() {
+  if (!scan()) {
+    return false;
+  }
+  entry_code();
+  for (std::size_t offset = 0; offset < _chunk.size();
+       offset += plzerow::instruction_size(byte(offset))) {
+    if (_targets[offset]) {
+      if (!_stack.empty()) {
+        return false;
+      }
+      _labels[offset] = _asm.position();
+    }
+    if (!translate(offset)) {
+      return false;
+    }
+  }
+  for (const auto &[fixup, target] : _fixups) {
+    if (_labels[target] == none) {
+      return false;
+    }
+    _asm.bind(fixup, _labels[target]);
+  }
+  return true;
+}
+
+// Every instruction must be one the VM runs, fit in the chunk and refer to
+// instruction starts and integer constants, and every call an ENTER. Each
+// ENTER starts a procedure, called or not.
+bool Translator::scan() {
+  std::vector<std::size_t> jumps;
+  std::vector<std::size_t> calls{0};
+  for (std::size_t offset = 0; offset < _chunk.size();) {
+    const auto instruction = byte(offset);
+    if (instruction >= plzerow::opcode_count) {
+      return false;
+    }
+    const auto size = plzerow::instruction_size(instruction);
+    if (offset + size > _chunk.size()) {
+      return false;
+    }
+    _starts[offset] = true;
+    switch (instruction) {
+    case plzerow::OP_CONSTANT:
+    case plzerow::OP_CONSTANT_LONG:
+    case plzerow::OP_ADD_CONST:
+    case plzerow::OP_SUBTRACT_CONST:
+    case plzerow::OP_INC_LOCAL: {
+      const std::size_t index =
+          instruction == plzerow::OP_CONSTANT_LONG
+              ? plzerow::read_long_constant(_code + offset + 1)
+              : byte(offset + size - 1);
+      if (index >= _chunk.constant_count() ||
+          !std::holds_alternative<std::int32_t>(_chunk.constant(index))) {
+        return false;
+      }
+      break;
+    }
+    case plzerow::OP_JUMP:
+    case plzerow::OP_JUMP_IF_FALSE:
+    case plzerow::OP_JUMP_IF_NOT_LESS:
+    case plzerow::OP_JUMP_IF_NOT_GREATER:
+      jumps.push_back(offset + 3 + read_short(offset + 1));
+      break;
+    case plzerow::OP_LOOP:
+      if (read_short(offset + 1) > offset + 3) {
+        return false;
+      }
+      jumps.push_back(offset + 3 - read_short(offset + 1));
+      break;
+    case plzerow::OP_CALL: {
+      std::size_t address = 0;
+      for (std::size_t i = 0; i < 4; ++i) {
+        address = address << 8 | byte(offset + 2 + i);
+      }
+      calls.push_back(address);
+      break;
+    }
+    case plzerow::OP_ENTER:
+      _targets[offset] = true;
+      break;
+    }
+    offset += size;
+  }
+  for (const auto target : jumps) {
+    if (target >= _chunk.size() || !_starts[target]) {
+      return false;
+    }
+    _targets[target] = true;
+  }
+  for (const auto address : calls) {
+    if (address >= _chunk.size() || byte(address) != plzerow::OP_ENTER) {
+      return false;
+    }
+  }
+  return true;
+}
+
+/*
+ * run() calls the code at position 0 with the JitState:
+ *
+ *   save the callee-saved registers and rsp, switch to the native stack,
+ *   call the main program, restore rsp and the registers, return
+ *
+ * followed by the error exit, which the slow paths jump to with the status
+ * in esi and the offset in edx. It calls record_error on the original
+ * stack and leaves through the same epilogue, dropping every native frame.
+ */
+void Translator::entry_code() {
+  for (const auto r : {RBP, RBX, R12, R13, R14, R15}) {
+    _asm.push(r);
+  }
+  _asm.mov(R15, reg(RDI), true);
+  _asm.mov(state(offsetof(JitState, saved_rsp)), RSP, true);
+  _asm.mov(RSP, state(offsetof(JitState, stack_top)), true);
+  _asm.mov(R12, state(offsetof(JitState, frames)), true);
+  _asm.mov(R14, state(offsetof(JitState, spills)), true);
+  _asm.mov(RAX, imm(0));
+  jump_to(_asm.call(), 0);
+  const auto epilogue = _asm.position();
+  _asm.mov(RSP, state(offsetof(JitState, saved_rsp)), true);
+  for (const auto r : {R15, R14, R13, R12, RBX, RBP}) {
+    _asm.pop(r);
+  }
+  _asm.ret();
+
+  _error = _asm.position();
+  _asm.mov(RSP, state(offsetof(JitState, saved_rsp)), true);
+  // six pushes after the return address leave rsp 8 off 16-byte alignment
+  _asm.alu(Alu::Sub, reg(RSP), 8, true);
+  _asm.mov(RDI, reg(R15), true);
+  _asm.mov64(RAX, reinterpret_cast<std::uint64_t>(&record_error));
+  _asm.call(RAX);
+  _asm.bind(_asm.jump(), epilogue);
+}
+
+void Translator::fail(JitCode::Status status, std::size_t offset) {
+  _asm.mov(RSI, imm(static_cast<std::int32_t>(status)));
+  _asm.mov(RDX, imm(static_cast<std::int32_t>(offset)));
+  _asm.bind(_asm.jump(), _error);
+}
+
+Operand Translator::location(std::size_t depth) const {
+  if (depth < stack_registers.size()) {
+    return reg(stack_registers[depth]);
+  }
+  return mem(R14, static_cast<std::int32_t>(
+                      4 * (depth - stack_registers.size())));
+}
+
+Operand Translator::operand(std::size_t depth) const {
+  return _stack[depth].constant ? imm(_stack[depth].value) : location(depth);
+}
+
+void Translator::push_constant(std::int32_t value) {
+  _stack.push_back({true, value});
+  _depth = std::max(_depth, _stack.size());
+}
+
+void Translator::push(Operand source) {
+  store(location(_stack.size()), source);
+  _stack.push_back({false, 0});
+  _depth = std::max(_depth, _stack.size());
+}
+
+void Translator::load(Reg destination, Operand source) {
+  if (source.kind != Operand::Kind::Register || source.reg != destination) {
+    _asm.mov(destination, source);
+  }
+}
+
+void Translator::store(Operand destination, Operand source) {
+  if (destination.kind == Operand::Kind::Register) {
+    load(destination.reg, source);
+  } else if (source.kind == Operand::Kind::Immediate) {
+    _asm.mov(destination, source.value);
+  } else if (source.kind == Operand::Kind::Register) {
+    _asm.mov(destination, source.reg);
+  } else {
+    _asm.mov(RDX, source);
+    _asm.mov(destination, RDX);
+  }
+}
+
+// the frame of the procedure hops static links out, in rax
+void Translator::static_link(std::uint8_t hops) {
+  if (hops == 0) {
+    _asm.mov(RAX, reg(RBX), true);
+    return;
+  }
+  _asm.mov(RAX, mem(RBX, 0), true);
+  for (; hops > 1; --hops) {
+    _asm.mov(RAX, mem(RAX, 0), true);
+  }
+}
+
+// Pushes rbx, checks both stacks for room, opens the frame with the static
+// link from rax and zeroes its variables.
+void Translator::enter(std::size_t offset, std::uint8_t variables) {
+  const auto size = (8 + 4 * std::size_t{variables} + 7) & ~std::size_t{7};
+  _asm.push(RBX);
+  _asm.alu(Alu::Cmp, RSP, state(offsetof(JitState, stack_limit)), true);
+  const auto below = _asm.jump(BELOW);
+  _asm.mov(RBX, reg(R12), true);
+  _asm.mov(mem(RBX, 0), RAX, true);
+  _asm.alu(Alu::Add, reg(R12), static_cast<std::int32_t>(size), true);
+  _asm.alu(Alu::Cmp, R12, state(offsetof(JitState, frames_end)), true);
+  const auto above = _asm.jump(ABOVE);
+  const auto words = (size - 8) / 8;
+  if (words <= 8) {
+    for (std::size_t i = 0; i < words; ++i) {
+      _asm.mov(mem(RBX, static_cast<std::int32_t>(8 + 8 * i)), 0, true);
+    }
+  } else {
+    _asm.lea(RDI, mem(RBX, 8));
+    _asm.mov(RCX, imm(static_cast<std::int32_t>(words)));
+    _asm.mov(RAX, imm(0));
+    _asm.rep_stosq();
+  }
+  const auto done = _asm.jump();
+  _asm.bind(below);
+  _asm.bind(above);
+  fail(JitCode::Status::StackOverflow, offset);
+  _asm.bind(done);
+}
+
+std::int32_t fold(std::uint8_t instruction, std::int32_t lhs,
+                  std::int32_t rhs) {
+  switch (instruction) {
+  case plzerow::OP_ADD:
+    return plzerow::wrapping_add(lhs, rhs);
+  case plzerow::OP_SUBTRACT:
+    return plzerow::wrapping_subtract(lhs, rhs);
+  case plzerow::OP_MULTIPLY:
+    return plzerow::wrapping_multiply(lhs, rhs);
+  case plzerow::OP_DIVIDE:
+    return plzerow::wrapping_divide(lhs, rhs);
+  case plzerow::OP_EQUAL:
+    return lhs == rhs;
+  case plzerow::OP_NOT_EQUAL:
+    return lhs != rhs;
+  case plzerow::OP_LESS:
+    return lhs < rhs;
+  default:
+    return lhs > rhs;
+  }
+}
+
+Cond condition(std::uint8_t instruction) {
+  switch (instruction) {
+  case plzerow::OP_EQUAL:
+    return EQ;
+  case plzerow::OP_NOT_EQUAL:
+    return NE;
+  case plzerow::OP_LESS:
+    return LT;
+  default:
+    return GT;
+  }
+}
+
+// ADD, SUBTRACT and MULTIPLY work in the left operand's register, or in eax
+// when it was spilled
+void Translator::arithmetic(std::uint8_t instruction) {
+  const auto right = _stack.size() - 1;
+  const auto left = right - 1;
+  if (_stack[left].constant && _stack[right].constant) {
+    _stack[left].value =
+        fold(instruction, _stack[left].value, _stack[right].value);
+    _stack.pop_back();
+    return;
+  }
+  const auto target = location(left);
+  const auto work =
+      target.kind == Operand::Kind::Register ? target.reg : RAX;
+  load(work, operand(left));
+  const auto source = operand(right);
+  switch (instruction) {
+  case plzerow::OP_ADD:
+    _asm.alu(Alu::Add, work, source);
+    break;
+  case plzerow::OP_SUBTRACT:
+    _asm.alu(Alu::Sub, work, source);
+    break;
+  default:
+    _asm.imul(work, source);
+    break;
+  }
+  store(target, reg(work));
+  _stack.pop_back();
+  _stack.back() = {false, 0};
+}
+
+// idiv traps on INT_MIN / -1, which wraps in PL/0, so -1 negates instead
+void Translator::divide(std::size_t offset) {
+  const auto right = _stack.size() - 1;
+  const auto left = right - 1;
+  const auto divisor = operand(right);
+  if (divisor.kind == Operand::Kind::Immediate && divisor.value != 0 &&
+      _stack[left].constant) {
+    _stack[left].value = fold(plzerow::OP_DIVIDE, _stack[left].value,
+                              divisor.value);
+    _stack.pop_back();
+    return;
+  }
+  load(RAX, operand(left));
+  if (divisor.kind == Operand::Kind::Immediate) {
+    if (divisor.value == 0) {
+      fail(JitCode::Status::DivisionByZero, offset);
+    } else if (divisor.value == -1) {
+      _asm.neg(reg(RAX));
+    } else {
+      _asm.mov(R13, divisor);
+      _asm.cdq();
+      _asm.idiv(reg(R13));
+    }
+  } else {
+    _asm.alu(Alu::Cmp, divisor, 0);
+    const auto nonzero = _asm.jump(NE);
+    fail(JitCode::Status::DivisionByZero, offset);
+    _asm.bind(nonzero);
+    _asm.alu(Alu::Cmp, divisor, -1);
+    const auto general = _asm.jump(NE);
+    _asm.neg(reg(RAX));
+    const auto done = _asm.jump();
+    _asm.bind(general);
+    _asm.cdq();
+    _asm.idiv(divisor);
+    _asm.bind(done);
+  }
+  store(location(left), reg(RAX));
+  _stack.pop_back();
+  _stack.back() = {false, 0};
+}
+
+// sets the flags for the two topmost entries, from left to right
+void Translator::compare(std::size_t left) {
+  auto lhs = operand(left);
+  if (lhs.kind != Operand::Kind::Register) {
+    load(RAX, lhs);
+    lhs = reg(RAX);
+  }
+  _asm.alu(Alu::Cmp, lhs.reg, operand(left + 1));
+}
+
+void Translator::comparison(std::uint8_t instruction) {
+  const auto right = _stack.size() - 1;
+  const auto left = right - 1;
+  if (_stack[left].constant && _stack[right].constant) {
+    _stack[left].value =
+        fold(instruction, _stack[left].value, _stack[right].value);
+    _stack.pop_back();
+    return;
+  }
+  compare(left);
+  _asm.set(condition(instruction));
+  store(location(left), reg(RAX));
+  _stack.pop_back();
+  _stack.back() = {false, 0};
+}
+
+// JUMP_IF_FALSE, JUMP_IF_NOT_LESS and JUMP_IF_NOT_GREATER, false if the
+// operand stack is not empty afterwards
+bool Translator::branch_unless(std::uint8_t instruction, std::size_t target) {
+  const auto top = _stack.size() - 1;
+  if (instruction == plzerow::OP_JUMP_IF_FALSE) {
+    const auto value = operand(top);
+    if (value.kind == Operand::Kind::Immediate) {
+      if (value.value == 0) {
+        jump_to(_asm.jump(), target);
+      }
+    } else {
+      if (value.kind == Operand::Kind::Register) {
+        _asm.test(value.reg, value.reg);
+      } else {
+        _asm.alu(Alu::Cmp, value, 0);
+      }
+      jump_to(_asm.jump(EQ), target);
+    }
+    _stack.pop_back();
+    return _stack.empty();
+  }
+
+  const auto comparison = instruction == plzerow::OP_JUMP_IF_NOT_LESS
+                              ? plzerow::OP_LESS
+                              : plzerow::OP_GREATER;
+  const auto left = top - 1;
+  if (_stack[left].constant && _stack[top].constant) {
+    if (fold(comparison, _stack[left].value, _stack[top].value) == 0) {
+      jump_to(_asm.jump(), target);
+    }
+  } else {
+    compare(left);
+    jump_to(_asm.jump(comparison == plzerow::OP_LESS ? GE : LE), target);
+  }
+  _stack.resize(left);
+  return _stack.empty();
+}
+
+bool Translator::translate(std::size_t offset) {
+  const auto instruction = byte(offset);
+  switch (instruction) {
+  case plzerow::OP_CONSTANT:
+    push_constant(constant(byte(offset + 1)));
+    return true;
+  case plzerow::OP_CONSTANT_LONG:
+    push_constant(constant(plzerow::read_long_constant(_code + offset + 1)));
+    return true;
+  case plzerow::OP_NEGATE:
+  case plzerow::OP_ODD: {
+    auto &top = _stack.back();
+    if (top.constant) {
+      top.value = instruction == plzerow::OP_NEGATE
+                      ? plzerow::wrapping_negate(top.value)
+                      : (top.value & 1) != 0;
+    } else if (instruction == plzerow::OP_NEGATE) {
+      _asm.neg(location(_stack.size() - 1));
+    } else {
+      _asm.alu(Alu::And, location(_stack.size() - 1), 1);
+    }
+    return true;
+  }
+  case plzerow::OP_ADD:
+  case plzerow::OP_SUBTRACT:
+  case plzerow::OP_MULTIPLY:
+    arithmetic(instruction);
+    return true;
+  case plzerow::OP_ADD_CONST:
+  case plzerow::OP_SUBTRACT_CONST:
+    push_constant(constant(byte(offset + 1)));
+    arithmetic(instruction == plzerow::OP_ADD_CONST ? plzerow::OP_ADD
+                                                    : plzerow::OP_SUBTRACT);
+    return true;
+  case plzerow::OP_DIVIDE:
+    divide(offset);
+    return true;
+  case plzerow::OP_EQUAL:
+  case plzerow::OP_NOT_EQUAL:
+  case plzerow::OP_LESS:
+  case plzerow::OP_GREATER:
+    comparison(instruction);
+    return true;
+  case plzerow::OP_GET_LOCAL:
+    push(variable(byte(offset + 1), RBX));
+    return true;
+  case plzerow::OP_SET_LOCAL:
+    store(variable(byte(offset + 1), RBX), operand(_stack.size() - 1));
+    _stack.pop_back();
+    return true;
+  case plzerow::OP_GET_VAR:
+    static_link(byte(offset + 1));
+    push(variable(byte(offset + 2), RAX));
+    return true;
+  case plzerow::OP_SET_VAR:
+    static_link(byte(offset + 1));
+    store(variable(byte(offset + 2), RAX), operand(_stack.size() - 1));
+    _stack.pop_back();
+    return true;
+  case plzerow::OP_INC_LOCAL:
+    _asm.alu(Alu::Add, variable(byte(offset + 1), RBX),
+             constant(byte(offset + 2)));
+    return true;
+  case plzerow::OP_JUMP:
+    jump_to(_asm.jump(), offset + 3 + read_short(offset + 1));
+    return _stack.empty();
+  case plzerow::OP_LOOP:
+    jump_to(_asm.jump(), offset + 3 - read_short(offset + 1));
+    return _stack.empty();
+  case plzerow::OP_JUMP_IF_FALSE:
+  case plzerow::OP_JUMP_IF_NOT_LESS:
+  case plzerow::OP_JUMP_IF_NOT_GREATER:
+    return branch_unless(instruction, offset + 3 + read_short(offset + 1));
+  case plzerow::OP_CALL: {
+    std::size_t address = 0;
+    for (std::size_t i = 0; i < 4; ++i) {
+      address = address << 8 | byte(offset + 2 + i);
+    }
+    static_link(byte(offset + 1));
+    jump_to(_asm.call(), address);
+    return _stack.empty();
+  }
+  case plzerow::OP_ENTER:
+    enter(offset, byte(offset + 1));
+    return true;
+  case plzerow::OP_RETURN:
+    _asm.mov(R12, reg(RBX), true);
+    _asm.pop(RBX);
+    _asm.ret();
+    return _stack.empty();
+  default:
+    return false;
+  }
+}
+
+#ifdef PLZEROW_HAS_JIT
+
+std::size_t page_aligned(std::size_t size) {
+  constexpr std::size_t page = 4096;
+  return (size + page - 1) & ~(page - 1);
+}
+
+// anonymous memory reserved up front and committed as it is touched
+class Reservation {
+public:
+  explicit Reservation(std::size_t size)
+      : _data{::mmap(nullptr, size, PROT_READ | PROT_WRITE,
+                     MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE, -1, 0)},
+        _size{size} {}
+  Reservation(const Reservation &) = delete;
+  Reservation &operator=(const Reservation &) = delete;
+  ~Reservation() {
+    if (_data != MAP_FAILED) {
+      ::munmap(_data, _size);
+    }
+  }
+
+  bool valid() const { return _data != MAP_FAILED; }
+  std::uint8_t *begin() const { return static_cast<std::uint8_t *>(_data); }
+  std::uint8_t *end() const { return begin() + _size; }
+
+private:
+  void *_data;
+  std::size_t _size;
+};
+
+#endif
+
+} // namespace
+
+namespace plzerow {
+
+std::optional<JitCode> JitCode::compile(const Chunk &chunk) {
+#ifdef PLZEROW_HAS_JIT
+  Translator translator{chunk};
+  if (chunk.size() == 0 || !translator.run()) {
+    return std::nullopt;
+  }
+  const auto &native = translator.code();
+  const auto size = page_aligned(native.size());
+  void *code = ::mmap(nullptr, size, PROT_READ | PROT_WRITE,
+                      MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+  if (code == MAP_FAILED) {
+    return std::nullopt;
+  }
+  std::memcpy(code, native.data(), native.size());
+  if (::mprotect(code, size, PROT_READ | PROT_EXEC) != 0) {
+    ::munmap(code, size);
+    return std::nullopt;
+  }
+  JitCode result;
+  result._code = code;
+  result._size = size;
+  result._spills = translator.spills();
+  return result;
+#else
+  (void)chunk;
+  return std::nullopt;
+#endif
+}
+
+JitCode::JitCode(JitCode &&other) noexcept
+    : _code{std::exchange(other._code, nullptr)},
+      _size{std::exchange(other._size, 0)},
+      _spills{std::exchange(other._spills, 0)} {}
+
+JitCode &JitCode::operator=(JitCode &&other) noexcept {
+  if (this != &other) {
+    release();
+    _code = std::exchange(other._code, nullptr);
+    _size = std::exchange(other._size, 0);
+    _spills = std::exchange(other._spills, 0);
+  }
+  return *this;
+}
+
+JitCode::~JitCode() { release(); }
+
+void JitCode::release() {
+#ifdef PLZEROW_HAS_JIT
+  if (_code != nullptr) {
+    ::munmap(_code, _size);
+  }
+#endif
+  _code = nullptr;
+  _size = 0;
+}
+
+JitCode::Result JitCode::run(std::size_t globals) const {
+#ifdef PLZEROW_HAS_JIT
+  Reservation stack{native_stack_size};
+  Reservation frames{frame_area_size};
+  std::vector<std::int32_t> spills(_spills);
+  if (!stack.valid() || !frames.valid()) {
+    return {Status::StackOverflow, 0, std::vector<std::int32_t>(globals, 0)};
+  }
+  JitState state{
+      nullptr,
+      stack.end(),
+      stack.begin() + stack_reserve,
+      reinterpret_cast<std::int32_t *>(frames.begin()),
+      reinterpret_cast<std::int32_t *>(frames.end()),
+      spills.data(),
+      Status::OK,
+      0,
+  };
+  reinterpret_cast<void (*)(JitState *)>(_code)(&state);
+  // the main program's frame opens the frame area, after its static link
+  const auto *variables = state.frames + 2;
+  return {state.status, state.offset, {variables, variables + globals}};
+#else
+  (void)globals;
+  return {Status::OK, 0, {}};
+#endif
+}
+
+} // namespace plzerow
@@ -1,42 +1,85 @@
 #include "lexer.hpp"
 #include "fmt/core.h"
+#include "scanner.hpp"
 #include "token.hpp"
 #include "token_type.hpp"
 #include <algorithm>
-#include <cctype>
+#include <cstdint>
 #include <iostream>
-#include <iterator>
+#include <limits>
 #include <string>
-#include <unordered_map>
+#include <string_view>
+
+namespace {
+
+using plzerow::keyword_or_ident;
+using plzerow::TOKEN;
+
+static_assert(keyword_or_ident(plzerow::kw_procedure) == TOKEN::PROCEDURE);
+static_assert(keyword_or_ident("procedures") == TOKEN::IDENT);
+static_assert(keyword_or_ident("x") == TOKEN::IDENT);
+
+// Converts a run of digits and ' separators, failing when the value does not
+// fit the VM's 32-bit integers.
+constexpr bool number_value(std::string_view literal, std::int32_t &value) {
+  std::uint64_t accumulated = 0;
+  for (const char c : literal) {
+    if (c == '\'') {
+      continue;
+    }
+    accumulated = accumulated * 10 + static_cast<std::uint64_t>(c - '0');
+    if (accumulated > std::numeric_limits<std::int32_t>::max()) {
+      return false;
+    }
+  }
+  value = static_cast<std::int32_t>(accumulated);
+  return true;
+}
+
+} // namespace
 
 namespace plzerow {
 
 Lexer::Lexer(std::vector<char> &&source)
-    : _buffer{std::forward<std::vector<char>>(source)},
-      _filesize{_buffer.size()}, _filename{"repl"} {}
+    : Lexer("repl", SourceBuffer{std::move(source)}) {}
 
 Lexer::Lexer(const std::string &filename, std::vector<char> &&source)
-    : _buffer{std::forward<std::vector<char>>(source)},
-      _filesize{_buffer.size()}, _filename{filename} {}
+    : Lexer(filename, SourceBuffer{std::move(source)}) {}
+
+Lexer::Lexer(const std::string &filename, SourceBuffer &&source,
+             Interner *symbols)
+    : _source{std::move(source)}, _data{_source.data()}, _symbols{symbols},
+      _filesize{_source.size()}, _filename{filename} {}
 
 std::vector<Token> Lexer::tokenize() {
   std::vector<Token> tokens;
-  Token current{TOKEN::ENDFILE, 0, 1};
 
   do {
     tokens.push_back(next());
-  } while (!at_end());
+  } while (tokens.back().type() != TOKEN::ENDFILE);
 
   return tokens;
 }
 
 char Lexer::peek_next() const {
-  return _pos + 1 < _filesize ? _buffer[_pos + 1] : '\0';
+  return _pos + 1 < _filesize ? _data[_pos + 1] : '\0';
 }
 
-char Lexer::peek() const { return _pos < _filesize ? _buffer[_pos] : '\0'; }
+char Lexer::peek() const { return _pos < _filesize ? _data[_pos] : '\0'; }
 
-bool Lexer::at_end() const { return _pos >= _filesize; }
+bool Lexer::at_end() const { return _pos >= _filesize && _source.exhausted(); }
+
+bool Lexer::refill(std::size_t keep_from) {
+  if (_source.exhausted()) {
+    return false;
+  }
+  const auto discarded = _source.refill(keep_from);
+  _pos -= discarded;
+  _token_start = _token_start >= discarded ? _token_start - discarded : 0;
+  _data = _source.data();
+  _filesize = _source.size();
+  return _pos < _filesize;
+}
 
 char Lexer::advance() {
   auto c = peek();
@@ -56,96 +99,123 @@ void Lexer::parse_error(const std::string &err) const {
             << _token_line_pos << "] " << err << "\n";
 }
 
+void Lexer::set_report_errors(bool report_errors) {
+  _report_errors = report_errors;
+}
+
+void Lexer::set_scan_kernels(const ScanKernels &kernels) { _scan = &kernels; }
+
+void Lexer::report_error(const std::string &filename, const Token &token) {
+  const auto literal = token.literal();
+  const auto err =
+      token.error() == LexError::NUMBER_OUT_OF_RANGE
+          ? fmt::format("number literal {} out of range", literal)
+          : fmt::format("unexpected token {}", literal.front());
+  std::cerr << "[LEXICAL_ERROR] [" << filename << ":" << token.linum() << ":"
+            << token.token_start() << "] " << err << "\n";
+}
+
+std::size_t Lexer::linum() const { return _linum; }
+
+bool Lexer::ended_in_comment() const { return _in_comment; }
+
+void Lexer::skip_to(const char *position) {
+  const auto distance = static_cast<std::size_t>(position - cursor());
+  _pos += distance;
+  _lpos += distance;
+}
+
+const char *Lexer::cursor() const { return _data + _pos; }
+
+const char *Lexer::buffer_end() const { return _data + _filesize; }
+
+std::string_view Lexer::lexeme(std::size_t start) const {
+  return {_data + start, std::min(_pos, _filesize) - start};
+}
+
 Token Lexer::parse_ident() {
-  const auto pos = _token_start;
-  while (isalnum(peek()) || peek() == '_') {
-    advance();
-  }
+  do {
+    skip_to(_scan->skip_ident(cursor(), buffer_end()));
+  } while (_pos == _filesize && refill(_token_start));
 
-  std::string identifier{_buffer.begin() + pos, _buffer.begin() + _pos};
-  _literal = identifier;
-
-  static const std::unordered_map<std::string, TOKEN> keywords = {
-      {kw_var, TOKEN::VAR},
-      {kw_odd, TOKEN::ODD},
-      {kw_const, TOKEN::CONST},
-      {kw_cond, TOKEN::IF},
-      {kw_do, TOKEN::DO},
-      {kw_then, TOKEN::THEN},
-      {kw_call, TOKEN::CALL},
-      {kw_begin, TOKEN::BEGIN},
-      {kw_while, TOKEN::WHILE},
-      {kw_end, TOKEN::END},
-      {kw_procedure, TOKEN::PROCEDURE}};
-
-  auto it = keywords.find(identifier);
-  if (it != keywords.end()) {
-    _token = it->second;
-  } else {
-    _token = TOKEN::IDENT;
+  const auto identifier = lexeme(_token_start);
+  _token = keyword_or_ident(identifier);
+  if (_token == TOKEN::IDENT && _symbols != nullptr) {
+    return Token(_token, identifier, _symbols->intern(identifier), _linum,
+                 _token_line_pos);
   }
-
-  return Token(_token, _literal, _linum, _token_line_pos);
+  return Token(_token, identifier, _linum, _token_line_pos);
 }
 
 Token Lexer::parse_number() {
-  const auto pos = _token_start;
-  std::string number;
-  while (std::isdigit(peek()) || peek() == '\'') {
-    advance();
-  }
+  do {
+    skip_to(_scan->skip_number(cursor(), buffer_end()));
+  } while (_pos == _filesize && refill(_token_start));
 
-  std::remove_copy_if(_buffer.begin() + pos, _buffer.begin() + _pos,
-                      std::back_inserter(number),
-                      [](char c) { return c == '\''; });
-  _literal = number;
+  std::int32_t value = 0;
+  const auto literal = lexeme(_token_start);
   _token = TOKEN::NUMBER;
-  return Token(_token, _literal, _linum, _token_line_pos);
+  if (!number_value(literal, value)) {
+    const Token error{_token, literal, LexError::NUMBER_OUT_OF_RANGE, _linum,
+                      _token_line_pos};
+    if (_report_errors) {
+      report_error(_filename, error);
+    }
+    return error;
+  }
+  return Token(_token, literal, value, _linum, _token_line_pos);
+}
+
+void Lexer::skip_lines(const LineRun &run) {
+  if (run.newlines != 0) {
+    _linum += run.newlines;
+    _lpos = run.end - run.last_newline;
+    _pos = run.end - _data;
+  } else {
+    skip_to(run.end);
+  }
 }
 
 void Lexer::parse_comment() {
-  while (peek() != '}') {
+  do {
+    skip_lines(_scan->find_comment_end(cursor(), buffer_end()));
+  } while (_pos == _filesize && refill(_pos));
+  _in_comment = at_end();
+  if (!_in_comment) {
     advance();
   }
-  advance();
 }
 
 void Lexer::parse_whitespace() {
   for (;;) {
-    const char c = peek();
-    switch (c) {
-    case ' ':
-    case '\r':
-    case '\t':
-      advance();
-      break;
-    case '\n':
-      ++_linum;
-      _lpos = 0;
-      advance();
-      break;
-    case '{':
-      parse_comment();
-      break;
-    default:
+    skip_lines(_scan->skip_whitespace(cursor(), buffer_end()));
+
+    if (_pos == _filesize && refill(_pos)) {
+      continue;
+    }
+    if (peek() != '{') {
       return;
     }
+    parse_comment();
   }
 }
 
 Token Lexer::next() {
   parse_whitespace();
+  if (_filesize - _pos < 2) {
+    // operators look at most one character ahead
+    refill(_pos);
+  }
 
-  _literal = "";
   _token = TOKEN::UNKNOWN;
   _token_line_pos = _lpos;
   _token_start = _pos;
 
   auto c = advance();
 
-  if (std::isalpha(c) || c == '_') {
+  if (is_ident_start(c)) {
     return parse_ident();
-  } else if (std::isdigit(c)) {
+  } else if (is_digit(c)) {
     return parse_number();
   }
 
@@ -192,7 +262,7 @@ Token Lexer::next() {
   case ':':
     if (peek() != '=') {
       _token = TOKEN::ERROR;
-      _literal = fmt::format("unexpected token {}", c);
+      break;
     }
     _token = TOKEN::ASSIGN;
     advance();
@@ -202,10 +272,17 @@ Token Lexer::next() {
     break;
   default:
     _token = TOKEN::ERROR;
-    _literal = fmt::format("unexpected token {}", c);
   }
 
-  return Token(_token, _literal, _linum, _token_line_pos);
+  if (_token == TOKEN::ERROR) {
+    const Token error{_token, lexeme(_token_start),
+                      LexError::UNEXPECTED_CHARACTER, _linum, _token_line_pos};
+    if (_report_errors) {
+      report_error(_filename, error);
+    }
+    return error;
+  }
+  return Token(_token, _linum, _token_line_pos);
 }
 
 } // namespace plzerow
@@ -1,6 +1,10 @@
+#include "benchmark.hpp"
 #include "virtual_machine.hpp"
+#include <charconv>
 #include <cstdlib>
 #include <iostream>
+#include <string>
+#include <string_view>
 
 /*
  * pl0c -- PL/0 compiler.
@@ -27,17 +31,166 @@
 
 using namespace plzerow;
 
-void help() { std::cout << "usage: pl0 [file.pl0]\n"; }
+void help() {
+  std::cout << "usage: pl0 [options] [file.pl0]\n"
+               "  --input=read|mmap|stream  how the source file is loaded "
+               "(default mmap)\n"
+               "  --lex-threads=N           tokenize on N threads "
+               "(default 1)\n"
+               "  --pipeline                lex on a second thread while "
+               "parsing\n"
+               "  --codegen-threads=N       generate the code of procedures "
+               "on N threads\n"
+               "                            (default 1)\n"
+               "  --engine=stack|register|jit|threaded\n"
+               "                            the bytecode the program runs as, "
+               "jit runs the\n"
+               "                            stack code natively on x86-64, "
+               "threaded\n"
+               "                            decodes it into threaded code "
+               "first (default stack)\n"
+               "  --jit-verify              with --engine=jit, also interpret "
+               "the program and\n"
+               "                            report any difference\n"
+               "  --emit-c=FILE             write the program as C to FILE "
+               "instead of running it\n"
+               "  --native=FILE             build the program into an "
+               "executable with the\n"
+               "                            system C compiler ($CC or cc)\n"
+               "  --native-shared=FILE      build it into a shared object "
+               "exporting\n"
+               "                            plzerow_run instead\n"
+               "  --native-verify           run the program natively and "
+               "interpreted and\n"
+               "                            report any difference, exiting "
+               "with 1, or 2\n"
+               "                            if it could not be built\n"
+               "  -O0|-O1|-O2               optimization level: -O1 folds "
+               "constants and\n"
+               "                            removes dead code, -O2 also "
+               "inlines small\n"
+               "                            procedures, merges redundant "
+               "expressions and\n"
+               "                            hoists loop invariants "
+               "(default -O0)\n"
+               "  --dump-ir                 print the optimized SSA form "
+               "(with -O1 or -O2)\n"
+               "  --inline-threshold=N      -O2 inlines procedures of up to N "
+               "instructions,\n"
+               "                            0 turns inlining off (default "
+               "40)\n"
+               "  --inline-budget=N         instructions inlining may add to "
+               "a procedure\n"
+               "                            (default 400)\n"
+               "  --cache-dir=DIR           reuse bytecode compiled by earlier "
+               "runs, kept in DIR\n"
+               "  --bench-lex               time the lexer on the file with "
+               "each scanning\n"
+               "                            kernel instead of running it\n"
+               "  --bench-parse             time the parser on the file, from "
+               "tokens, from the\n"
+               "                            lexer and pipelined, instead of "
+               "running it\n";
+}
+
+bool parse_count(std::string_view arg, std::string_view flag,
+                 unsigned &value) {
+  if (!arg.starts_with(flag)) {
+    return false;
+  }
+  const auto digits = arg.substr(flag.size());
+  const auto [end, ec] =
+      std::from_chars(digits.data(), digits.data() + digits.size(), value);
+  return ec == std::errc{} && end == digits.data() + digits.size();
+}
 
 int main(int argc, char *argv[]) {
-  VM vm;
-  if (argc == 1) {
+  CompilerOptions options;
+  InputMode input_mode = InputMode::Map;
+  std::string filename;
+  bool bench_lex = false;
+  bool bench_parse = false;
+
+  for (int i = 1; i < argc; ++i) {
+    const std::string_view arg{argv[i]};
+    if (arg == "--input=read") {
+      input_mode = InputMode::Read;
+    } else if (arg == "--input=mmap") {
+      input_mode = InputMode::Map;
+    } else if (arg == "--input=stream") {
+      input_mode = InputMode::Stream;
+    } else if (arg == "--engine=stack") {
+      options.engine = Engine::Stack;
+    } else if (arg == "--engine=register") {
+      options.engine = Engine::Register;
+    } else if (arg == "--engine=jit") {
+      options.engine = Engine::Jit;
+    } else if (arg == "--engine=threaded") {
+      options.engine = Engine::Threaded;
+    } else if (arg == "--jit-verify") {
+      options.jit_verify = true;
+    } else if (arg.starts_with("--emit-c=")) {
+      options.native.emit_c = arg.substr(std::string_view{"--emit-c="}.size());
+    } else if (arg.starts_with("--native=")) {
+      options.native.output = arg.substr(std::string_view{"--native="}.size());
+    } else if (arg.starts_with("--native-shared=")) {
+      options.native.output =
+          arg.substr(std::string_view{"--native-shared="}.size());
+      options.native.shared = true;
+    } else if (arg == "--native-verify") {
+      options.native.verify = true;
+    } else if (arg == "-O0" || arg == "-O1" || arg == "-O2") {
+      options.opt_level = arg[2] - '0';
+    } else if (arg == "--dump-ir") {
+      options.dump_ir = true;
+    } else if (arg.starts_with("--cache-dir=")) {
+      options.cache_dir = arg.substr(std::string_view{"--cache-dir="}.size());
+    } else if (arg == "--pipeline") {
+      options.pipeline = true;
+    } else if (arg == "--bench-lex") {
+      bench_lex = true;
+    } else if (arg == "--bench-parse") {
+      bench_parse = true;
+    } else if (parse_count(arg, "--lex-threads=", options.lex_threads) ||
+               parse_count(arg, "--codegen-threads=",
+                           options.codegen_threads) ||
+               parse_count(arg, "--inline-threshold=",
+                           options.inline_threshold) ||
+               parse_count(arg, "--inline-budget=", options.inline_budget)) {
+      continue;
+    } else if (!arg.starts_with("-") && filename.empty()) {
+      filename = arg;
+    } else {
+      help();
+      exit(1);
+    }
+  }
+
+  if (bench_lex || bench_parse) {
+    if (filename.empty()) {
+      help();
+      exit(1);
+    }
+    if (bench_lex) {
+      plzerow::bench_lex(filename);
+    }
+    if (bench_parse) {
+      plzerow::bench_parse(filename);
+    }
+    return 0;
+  }
+
+  VM vm{options};
+  if (filename.empty()) {
     vm.repl();
-  } else if (argc == 2) {
-    const std::string filename{argv[1]};
-    vm.runfile(filename);
-  } else {
-    help();
-    exit(1);
+    return 0;
+  }
+  switch (vm.runfile(filename, input_mode)) {
+  case NativeCheck::Differs:
+    return 1;
+  case NativeCheck::NotBuilt:
+    return 2;
+  default:
+    return 0;
   }
 }
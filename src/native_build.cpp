@@ -0,0 +1,155 @@
+#include "native_build.hpp"
+#include <cstdlib>
+#include <filesystem>
+#include <fmt/core.h>
+#include <fstream>
+#include <iostream>
+#include <iterator>
+#include <random>
+#include <vector>
+
+#if defined(__unix__) || defined(__APPLE__)
+#include <cerrno>
+#include <fcntl.h>
+#include <spawn.h>
+#include <sys/wait.h>
+#define PLZEROW_HAS_SPAWN 1
+extern char **environ;
+#endif
+
+namespace {
+
+// a fresh directory under the system's temporary one, removed with
+// everything in it when it goes out of scope
+class ScratchDirectory {
+public:
+  ScratchDirectory() {
+    std::error_code error;
+    _path = std::filesystem::temp_directory_path(error) /
+            fmt::format("plzerow-{:08x}", std::random_device{}());
+    _created = !error && std::filesystem::create_directories(_path, error);
+  }
+  ScratchDirectory(const ScratchDirectory &) = delete;
+  ScratchDirectory &operator=(const ScratchDirectory &) = delete;
+  ~ScratchDirectory() {
+    std::error_code error;
+    if (_created) {
+      std::filesystem::remove_all(_path, error);
+    }
+  }
+
+  explicit operator bool() const { return _created; }
+  std::string file(const char *name) const { return (_path / name).string(); }
+
+private:
+  std::filesystem::path _path;
+  bool _created = false;
+};
+
+bool write_file(const std::string &path, const std::string &contents) {
+  std::ofstream out{path, std::ios::binary};
+  out << contents;
+  out.close();
+  return !out.fail();
+}
+
+std::string read_file(const std::string &path) {
+  std::ifstream in{path, std::ios::binary};
+  return {std::istreambuf_iterator<char>{in}, std::istreambuf_iterator<char>{}};
+}
+
+#ifdef PLZEROW_HAS_SPAWN
+
+// Runs args[0], looked up in PATH, with its standard output and error
+// redirected to the given files if they are not empty, and waits for it.
+// -1 if it could not be started or did not exit.
+int spawn(const std::vector<std::string> &args, const std::string &out = {},
+          const std::string &err = {}) {
+  posix_spawn_file_actions_t actions;
+  posix_spawn_file_actions_init(&actions);
+  if (!out.empty()) {
+    posix_spawn_file_actions_addopen(&actions, 1, out.c_str(),
+                                     O_WRONLY | O_CREAT | O_TRUNC, 0644);
+  }
+  if (!err.empty()) {
+    posix_spawn_file_actions_addopen(&actions, 2, err.c_str(),
+                                     O_WRONLY | O_CREAT | O_TRUNC, 0644);
+  }
+  std::vector<char *> argv;
+  for (const auto &arg : args) {
+    argv.push_back(const_cast<char *>(arg.c_str()));
+  }
+  argv.push_back(nullptr);
+
+  // whatever is buffered belongs before anything the child prints
+  std::cout.flush();
+  pid_t pid;
+  const auto started = posix_spawnp(&pid, argv[0], &actions, nullptr,
+                                    argv.data(), environ) == 0;
+  posix_spawn_file_actions_destroy(&actions);
+  if (!started) {
+    return -1;
+  }
+  int status;
+  while (waitpid(pid, &status, 0) < 0) {
+    if (errno != EINTR) {
+      return -1;
+    }
+  }
+  return WIFEXITED(status) ? WEXITSTATUS(status) : -1;
+}
+
+#endif
+
+bool compile_c(const std::string &c_file, const std::string &output,
+               bool shared) {
+#ifdef PLZEROW_HAS_SPAWN
+  const auto *cc = std::getenv("CC");
+  std::vector<std::string> args{cc != nullptr && *cc != '\0' ? cc : "cc",
+                                "-O2", "-pthread"};
+  if (shared) {
+    args.insert(args.end(), {"-shared", "-fPIC", "-DPLZEROW_NO_MAIN"});
+  }
+  args.insert(args.end(), {"-o", output, c_file});
+  const auto status = spawn(args);
+  if (status < 0) {
+    std::cerr << "unable to run the C compiler " << args[0] << "\n";
+  }
+  return status == 0;
+#else
+  std::cerr << "native builds are not supported on this host\n";
+  return false;
+#endif
+}
+
+} // namespace
+
+namespace plzerow {
+
+bool build_native(const std::string &c_source, const std::string &output,
+                  bool shared) {
+  const ScratchDirectory scratch;
+  const auto c_file = scratch.file("program.c");
+  return scratch && write_file(c_file, c_source) &&
+         compile_c(c_file, output, shared);
+}
+
+std::optional<NativeRun> run_native(const std::string &c_source) {
+  const ScratchDirectory scratch;
+  const auto c_file = scratch.file("program.c");
+  const auto executable = scratch.file("program");
+  if (!scratch || !write_file(c_file, c_source) ||
+      !compile_c(c_file, executable, false)) {
+    return std::nullopt;
+  }
+#ifdef PLZEROW_HAS_SPAWN
+  const auto out = scratch.file("out");
+  const auto err = scratch.file("err");
+  const auto status = spawn({executable}, out, err);
+  return NativeRun{status, read_file(out), read_file(err)};
+#else
+  return std::nullopt;
+#endif
+}
+
+} // namespace plzerow
@@ -0,0 +1,193 @@
+#include "parallel_lexer.hpp"
+#include "lexer.hpp"
+#include "source_buffer.hpp"
+#include "thread_pool.hpp"
+#include "token_type.hpp"
+#include <algorithm>
+#include <future>
+
+namespace {
+
+// segments smaller than this are not worth a task
+constexpr std::size_t min_segment_size = 1 << 16;
+// more segments than threads so uneven segments still balance
+constexpr std::size_t segments_per_thread = 4;
+
+struct Placement {
+  std::size_t first;
+  std::size_t last;
+  std::size_t line_offset;
+  std::size_t out;
+};
+
+} // namespace
+
+namespace plzerow {
+
+ParallelLexer::ParallelLexer(const std::string &filename,
+                             std::string_view source, Interner &symbols,
+                             unsigned threads)
+    : _filename{filename}, _source{source}, _symbols{symbols},
+      _threads{std::max(threads, 1u)} {}
+
+std::vector<std::string_view> ParallelLexer::split() const {
+  const auto wanted = std::max<std::size_t>(
+      1, std::min(_threads * segments_per_thread,
+                  _source.size() / min_segment_size));
+  const auto target = _source.size() / wanted;
+
+  std::vector<std::string_view> segments;
+  std::size_t begin = 0;
+  while (begin < _source.size()) {
+    std::size_t end = _source.size();
+    if (segments.size() + 1 < wanted) {
+      const auto newline = _source.find('\n', begin + target);
+      if (newline != std::string_view::npos) {
+        end = newline + 1;
+      }
+    }
+    segments.push_back(_source.substr(begin, end - begin));
+    begin = end;
+  }
+  if (segments.empty()) {
+    segments.push_back(_source);
+  }
+  return segments;
+}
+
+void ParallelLexer::lex(Segment &segment) const {
+  Lexer lexer{_filename, SourceBuffer::view(segment.text),
+              &segment.symbols};
+  lexer.set_report_errors(false);
+  segment.tokens = lexer.tokenize();
+  segment.newlines = lexer.linum() - 1;
+  segment.ends_in_comment = lexer.ended_in_comment();
+
+  const auto close = segment.text.find('}');
+  if (close == std::string_view::npos) {
+    return;
+  }
+  const auto head = segment.text.substr(0, close);
+  const auto last_newline = head.rfind('\n');
+  segment.has_close = true;
+  segment.close_linum = 1 + std::count(head.begin(), head.end(), '\n');
+  segment.close_column =
+      last_newline == std::string_view::npos ? close + 1 : close - last_newline;
+}
+
+std::vector<Token> ParallelLexer::tokenize() {
+  const auto texts = split();
+  std::vector<Segment> segments(texts.size());
+  for (std::size_t i = 0; i < texts.size(); ++i) {
+    segments[i].text = texts[i];
+  }
+
+  ThreadPool pool{std::min<unsigned>(_threads, segments.size())};
+  std::vector<std::future<void>> pending;
+  pending.reserve(segments.size());
+  for (auto &segment : segments) {
+    pending.push_back(pool.submit([this, &segment]() { lex(segment); }));
+  }
+  for (auto &task : pending) {
+    task.get();
+  }
+
+  // Resolve which tokens of each speculative lex are real. Every segment's
+  // token array ends in ENDFILE; only the last one is kept.
+  std::vector<Placement> placements;
+  placements.reserve(segments.size());
+  bool in_comment = false;
+  std::size_t line_offset = 0;
+  std::size_t total = 0;
+  for (std::size_t i = 0; i < segments.size(); ++i) {
+    const auto &segment = segments[i];
+    const auto last = segment.tokens.size() - (i + 1 < segments.size());
+    std::size_t first = 0;
+
+    if (in_comment && !segment.has_close) {
+      first = segment.tokens.size() - 1;
+    } else {
+      if (in_comment) {
+        const auto after_close = std::find_if(
+            segment.tokens.begin(), segment.tokens.end(),
+            [&segment](const Token &token) {
+              return token.linum() > segment.close_linum ||
+                     (token.linum() == segment.close_linum &&
+                      token.token_start() > segment.close_column);
+            });
+        first = after_close - segment.tokens.begin();
+      }
+      in_comment = segment.ends_in_comment;
+    }
+
+    first = std::min(first, last);
+    placements.push_back({first, last, line_offset, total});
+    total += last - first;
+    line_offset += segment.newlines;
+  }
+
+  // Names seen only in a skipped prefix (text that is really inside a
+  // comment) must not get ids, so each segment lists its local symbols in
+  // the order they first occur among the kept tokens.
+  pending.clear();
+  for (std::size_t i = 0; i < segments.size(); ++i) {
+    pending.push_back(pool.submit([&segments, &placements, i]() {
+      auto &segment = segments[i];
+      const auto &place = placements[i];
+      segment.remap.assign(segment.symbols.size(), no_symbol);
+      for (auto j = place.first; j < place.last; ++j) {
+        const auto local = segment.tokens[j].symbol();
+        if (local != no_symbol && segment.remap[local] == no_symbol) {
+          segment.remap[local] = 0;
+          segment.first_seen.push_back(local);
+        }
+      }
+    }));
+  }
+  for (auto &task : pending) {
+    task.get();
+  }
+  for (auto &segment : segments) {
+    for (const auto local : segment.first_seen) {
+      segment.remap[local] = _symbols.intern(segment.symbols.name(local));
+    }
+  }
+
+  std::vector<Token> tokens(total, Token{TOKEN::ENDFILE, 0, 0});
+  pending.clear();
+  for (std::size_t i = 0; i < segments.size(); ++i) {
+    pending.push_back(pool.submit([&tokens, &segments, &placements, i]() {
+      const auto &place = placements[i];
+      const auto &source = segments[i].tokens;
+      const auto &remap = segments[i].remap;
+      for (auto j = place.first; j < place.last; ++j) {
+        const auto &token = source[j];
+        const auto linum = token.linum() + place.line_offset;
+        auto &out = tokens[place.out + j - place.first];
+        if (token.error() != LexError::NONE) {
+          out = Token{token.type(), token.literal(), token.error(), linum,
+                      token.token_start()};
+        } else if (token.type() == TOKEN::IDENT) {
+          out = Token{token.type(), token.literal(), remap[token.symbol()],
+                      linum, token.token_start()};
+        } else {
+          out = Token{token.type(), token.literal(), token.number(), linum,
+                      token.token_start()};
+        }
+      }
+    }));
+  }
+  for (auto &task : pending) {
+    task.get();
+  }
+
+  for (const auto &token : tokens) {
+    if (token.error() != LexError::NONE) {
+      Lexer::report_error(_filename, token);
+    }
+  }
+
+  return tokens;
+}
+
+} // namespace plzerow
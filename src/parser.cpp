@@ -1,38 +1,58 @@
 #include "parser.hpp"
 #include "ast_nodes.hpp"
+#include "lexer.hpp"
+#include "token_pipeline.hpp"
+#include "token_source.hpp"
 #include "token_type.hpp"
+#include <fmt/core.h>
+#include <cstdint>
 #include <cstdlib>
 #include <iostream>
-#include <memory>
+#include <span>
 #include <sstream>
+#include <utility>
 
 namespace plzerow {
 
-Parser::Parser()
-    : _next_token{[]() {
-        return plzerow::Token(plzerow::TOKEN::ENDFILE, 0, 0);
-      }},
-      _current{_next_token()}, _previous{TOKEN::ENDFILE, 0, 0} {}
+template <TokenSource Source>
+Parser<Source>::Parser(Source &source)
+    : _source{source}, _current{_source.next()},
+      _previous{TOKEN::ENDFILE, 0, 0},
+      _had_error{_current.error() != LexError::NONE} {}
 
-Parser::Parser(std::function<Token()> &&next_token)
-    : _next_token(std::forward<TokenGenerator>(next_token)),
-      _current{_next_token()}, _previous{TOKEN::ENDFILE, 0, 0} {}
-
-void Parser::parse_error(const std::string &err) const {
+template <TokenSource Source>
+void Parser<Source>::parse_error(const std::string &err) {
+  _had_error = true;
   std::cerr << "[PARSE_ERROR] [" << current().linum() << ":"
             << current().token_start() << "] " << err << "\n";
 }
 
-void Parser::next() {
+template <TokenSource Source> void Parser<Source>::next() {
+#ifdef PLZEROW_TRACE
   std::cout << _current << "\n";
+#endif
   _previous = _current;
-  _current = _next_token();
+  _current = _source.next();
+  // the lexer has already reported it
+  if (_current.error() != LexError::NONE) {
+    _had_error = true;
+  }
+}
+
+template <TokenSource Source> bool Parser<Source>::had_error() const {
+  return _had_error;
 }
 
-const Token &Parser::current() const { return _current; }
-const Token &Parser::previous() const { return _previous; }
+template <TokenSource Source> const Token &Parser<Source>::current() const {
+  return _current;
+}
+
+template <TokenSource Source> const Token &Parser<Source>::previous() const {
+  return _previous;
+}
 
-void Parser::expect(TOKEN expected_token) {
+template <TokenSource Source>
+void Parser<Source>::expect(TOKEN expected_token) {
   if (current().type() != expected_token) {
     std::stringstream err;
 
@@ -50,138 +70,160 @@ void Parser::expect(TOKEN expected_token) {
   next();
 }
 
-std::unique_ptr<ASTNode> Parser::make_constant() {
-  const auto ident = current().literal();
+template <TokenSource Source> NodeIndex Parser<Source>::make_constant() {
+  const auto ident = current().symbol();
   expect(TOKEN::IDENT);
   expect(TOKEN::EQUAL);
+  const auto number = current().number();
   expect(TOKEN::NUMBER);
-  auto number_literal = previous().literal();
-  auto number = std::atoi(number_literal.c_str());
-  return make_ast_node<ConstDecl>(previous().linum(), previous().token_start(),
-                                  ident, number);
+  return _ast.make_node<ConstDecl>(location(previous()), ident, number);
 }
 
-std::unique_ptr<ASTNode> Parser::make_var() {
-  auto var_decl = make_ast_node<VarDecl>(
-      current().linum(), current().token_start(), current().literal());
+template <TokenSource Source> NodeIndex Parser<Source>::make_var() {
+  const auto var_decl =
+      _ast.make_node<VarDecl>(location(current()), current().symbol());
   expect(TOKEN::IDENT);
   return var_decl;
 }
 
-std::unique_ptr<ASTNode> Parser::make_procedure() {
-  const auto linum = current().linum();
-  const auto column = current().token_start();
+template <TokenSource Source> NodeIndex Parser<Source>::make_procedure() {
+  const auto loc = location(current());
 
   expect(TOKEN::PROCEDURE);
-  const auto name = current().literal();
+  const auto name = current().symbol();
   expect(TOKEN::IDENT);
   expect(TOKEN::SEMICOLON);
 
-  auto blk = block();
+  const auto blk = block();
 
   expect(TOKEN::SEMICOLON);
-  return make_ast_node<Procedure>(linum, column, name, std::move(blk));
+  return _ast.make_node<Procedure>(loc, name, blk);
+}
+
+template <TokenSource Source>
+NodeRange Parser<Source>::children_since(std::size_t mark) {
+  const auto range =
+      _ast.add_children(std::span{_node_scratch}.subspan(mark));
+  _node_scratch.resize(mark);
+  return range;
+}
+
+template <TokenSource Source>
+ExprRange Parser<Source>::operands_since(std::size_t mark) {
+  const auto range =
+      _ast.add_operands(std::span{_operand_scratch}.subspan(mark));
+  _operand_scratch.resize(mark);
+  return range;
+}
+
+template <TokenSource Source>
+SourceLoc Parser<Source>::location(const Token &token) {
+  return {static_cast<std::uint32_t>(token.linum()),
+          static_cast<std::uint32_t>(token.token_start())};
 }
 
-std::unique_ptr<ASTNode> Parser::parse() {
-  auto blk = block();
-  auto program = make_ast_node<Program>(0, 0, std::move(blk));
+template <TokenSource Source> Ast Parser<Source>::parse() {
+  _ast.clear();
+  const auto blk = block();
+  _ast.set_root(_ast.make_node<Program>(SourceLoc{0, 0}, blk));
   expect(TOKEN::DOT);
-  return program;
+  return std::move(_ast);
 }
 
-std::unique_ptr<ASTNode> Parser::block() {
-  std::vector<std::unique_ptr<ASTNode>> const_decls;
-  std::vector<std::unique_ptr<ASTNode>> var_decls;
-  std::vector<std::unique_ptr<ASTNode>> procedures;
-  const auto linum = current().linum();
-  const auto column = current().token_start();
+template <TokenSource Source> NodeIndex Parser<Source>::block() {
+  const auto loc = location(current());
 
+  const auto mark = _node_scratch.size();
   if (current().type() == TOKEN::CONST) {
     expect(TOKEN::CONST);
-    const_decls.push_back(make_constant());
+    _node_scratch.push_back(make_constant());
 
     while (current().type() == TOKEN::COMMA) {
       expect(TOKEN::COMMA);
-      const_decls.push_back(make_constant());
+      _node_scratch.push_back(make_constant());
     }
 
     expect(TOKEN::SEMICOLON);
   }
+  const auto const_decls = children_since(mark);
 
   if (current().type() == TOKEN::VAR) {
     expect(TOKEN::VAR);
-    var_decls.push_back(make_var());
+    _node_scratch.push_back(make_var());
 
     while (current().type() == TOKEN::COMMA) {
       expect(TOKEN::COMMA);
-      var_decls.push_back(make_var());
+      _node_scratch.push_back(make_var());
     }
 
     expect(TOKEN::SEMICOLON);
   }
+  const auto var_decls = children_since(mark);
 
   while (current().type() == TOKEN::PROCEDURE) {
-    procedures.push_back(make_procedure());
+    _node_scratch.push_back(make_procedure());
   }
+  const auto procedures = children_since(mark);
 
-  auto stmt = statement();
-  return make_ast_node<Block>(linum, column, std::move(const_decls),
-                              std::move(var_decls), std::move(procedures),
-                              std::move(stmt));
+  const auto stmt = statement();
+  return _ast.make_node<Block>(loc, const_decls, var_decls, procedures, stmt);
 }
 
-std::unique_ptr<ASTNode> Parser::statement() {
+template <TokenSource Source> NodeIndex Parser<Source>::statement() {
   switch (current().type()) {
   case TOKEN::IDENT: {
-    auto name = current().literal();
+    const auto loc = location(current());
+    const auto name = current().symbol();
     expect(TOKEN::IDENT);
     expect(TOKEN::ASSIGN);
-    auto expr = expression();
-    return make_ast_node<Assignment>(
-        previous().linum(), previous().token_start(), name, std::move(expr));
+    const auto expr = expression();
+    return _ast.make_node<Assignment>(loc, name, expr);
+  }
+  case TOKEN::CALL: {
+    expect(TOKEN::CALL);
+    const auto loc = location(current());
+    const auto name = current().symbol();
+    expect(TOKEN::IDENT);
+    return _ast.make_node<Call>(loc, name);
   }
   case TOKEN::BEGIN: {
-    std::vector<std::unique_ptr<ASTNode>> stmts;
+    const auto mark = _node_scratch.size();
     expect(TOKEN::BEGIN);
-    stmts.push_back(statement());
+    _node_scratch.push_back(statement());
     while (current().type() == TOKEN::SEMICOLON) {
       expect(TOKEN::SEMICOLON);
-      stmts.push_back(statement());
+      _node_scratch.push_back(statement());
     }
     expect(TOKEN::END);
-    return make_ast_node<Begin>(previous().linum(), previous().token_start(),
-                                nullptr, std::move(stmts));
+    const auto stmts = children_since(mark);
+    return _ast.make_node<Begin>(location(previous()), no_node, stmts);
   }
   case TOKEN::IF: {
     expect(TOKEN::IF);
-    auto cond = condition();
+    const auto cond = condition();
     expect(TOKEN::THEN);
-    auto stmt = statement();
-    return make_ast_node<If>(previous().linum(), previous().token_start(),
-                             std::move(cond), std::move(stmt));
+    const auto stmt = statement();
+    return _ast.make_node<If>(location(previous()), cond, stmt);
   }
   case TOKEN::WHILE: {
     expect(TOKEN::WHILE);
-    auto cond = condition();
+    const auto cond = condition();
     expect(TOKEN::DO);
-    auto stmt = statement();
-    return make_ast_node<While>(previous().linum(), previous().token_start(),
-                                std::move(cond), std::move(stmt));
+    const auto stmt = statement();
+    return _ast.make_node<While>(location(previous()), cond, stmt);
   }
   default:
-    return nullptr;
+    return no_node;
   }
 }
 
-std::unique_ptr<ASTNode> Parser::condition() {
+template <TokenSource Source> NodeIndex Parser<Source>::condition() {
   if (current().type() == TOKEN::ODD) {
     expect(TOKEN::ODD);
-    auto expr = expression();
-    return make_ast_node<OddCondition>(
-        previous().linum(), previous().token_start(), std::move(expr));
+    const auto expr = expression();
+    return _ast.make_node<OddCondition>(location(previous()), expr);
   } else {
-    auto left = expression();
+    const auto left = expression();
     auto op = current().type();
     switch (op) {
     case TOKEN::EQUAL:
@@ -191,67 +233,77 @@ std::unique_ptr<ASTNode> Parser::condition() {
       next();
       break;
     default:
+      parse_error(fmt::format("syntax error: expected a comparison but found "
+                              "'{}'",
+                              static_cast<char>(op)));
       next();
     }
-    auto right = expression();
-    return make_ast_node<Condition>(previous().linum(),
-                                    previous().token_start(), op,
-                                    std::move(left), std::move(right));
+    const auto right = expression();
+    return _ast.make_node<Condition>(location(previous()), op, left, right);
   }
 }
 
-std::unique_ptr<ASTNode> Parser::expression() {
-  std::vector<std::pair<TOKEN, std::unique_ptr<ASTNode>>> terms;
+template <TokenSource Source> NodeIndex Parser<Source>::expression() {
+  const auto mark = _operand_scratch.size();
   TOKEN op = current().type();
   if (op == TOKEN::PLUS || op == TOKEN::MINUS) {
     next();
   }
-  auto term_node = term();
+  const auto term_node = term();
   while (current().type() == TOKEN::PLUS || current().type() == TOKEN::MINUS) {
     TOKEN current_op = current().type();
     next();
-    terms.push_back({current_op, term()});
+    _operand_scratch.push_back({current_op, term()});
   }
-  return make_ast_node<Expression>(previous().linum(), previous().token_start(),
-                                   op, std::move(term_node), std::move(terms));
+  const auto terms = operands_since(mark);
+  return _ast.make_node<Expression>(location(previous()), op, term_node,
+                                    terms);
 }
 
-std::unique_ptr<ASTNode> Parser::factor() {
+template <TokenSource Source> NodeIndex Parser<Source>::factor() {
   TOKEN factor_op = previous().type();
   switch (current().type()) {
   case TOKEN::IDENT: {
-    auto value = make_node<Primary>(current().literal());
+    const auto value = make_node<Primary>(current().symbol());
     next();
-    return make_node<Factor>(factor_op, std::move(value));
+    return make_node<Factor>(factor_op, value);
   }
   case TOKEN::NUMBER: {
-    auto value = make_node<Primary>(current().literal());
+    const auto value = make_node<Literal>(current().number());
     next();
-    return make_node<Factor>(factor_op, std::move(value));
+    return make_node<Factor>(factor_op, value);
   }
   case TOKEN::LPAREN: {
     expect(TOKEN::LPAREN);
-    auto expr = expression();
+    const auto expr = expression();
     expect(TOKEN::RPAREN);
-    return make_node<Factor>(factor_op, std::move(expr));
+    return make_node<Factor>(factor_op, expr);
   }
   }
-  return nullptr;
+  parse_error(fmt::format("syntax error: expected an identifier, number or "
+                          "'(' but found '{}'",
+                          static_cast<char>(current().type())));
+  return no_node;
 }
 
-std::unique_ptr<ASTNode> Parser::term() {
-  std::vector<std::pair<TOKEN, std::unique_ptr<ASTNode>>> factors;
-  auto fact = factor();
+template <TokenSource Source> NodeIndex Parser<Source>::term() {
+  const auto mark = _operand_scratch.size();
+  const auto fact = factor();
   TOKEN initial_token = current().type();
   while (current().type() == TOKEN::MULTIPLY ||
          current().type() == TOKEN::DIVIDE) {
     TOKEN current_token = current().type();
     next();
-    factors.push_back({current_token, factor()});
+    _operand_scratch.push_back({current_token, factor()});
   }
-  return make_ast_node<Term>(previous().linum(), previous().token_start(),
-                             initial_token, std::move(fact),
-                             std::move(factors));
+  const auto factors = operands_since(mark);
+  return _ast.make_node<Term>(location(previous()), initial_token, fact,
+                              factors);
 }
 
+template class Parser<Lexer>;
+template class Parser<TokenArray>;
+template class Parser<TokenPipeline>;
+template class Parser<TokenFunction>;
+
 } // namespace plzerow
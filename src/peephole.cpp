@@ -0,0 +1,208 @@
+#include "peephole.hpp"
+#include "opcodes.hpp"
+#include "relocations.hpp"
+#include "value.hpp"
+#include <cstddef>
+#include <cstdint>
+#include <initializer_list>
+#include <variant>
+#include <vector>
+
+namespace {
+
+using plzerow::Chunk;
+using plzerow::Relocations;
+
+/*
+ * The superinstructions cover the most frequent instruction pairs executed
+ * by the sample programs:
+ *
+ *   GET_LOCAL s  CONSTANT k  ADD  SET_LOCAL s   ->  INC_LOCAL s k
+ *   CONSTANT k  ADD | SUBTRACT                  ->  ADD_CONST k | ...
+ *   LESS | GREATER  JUMP_IF_FALSE               ->  JUMP_IF_NOT_LESS | ...
+ *
+ * and the push/pop pairs left by constant folding and self assignment
+ *
+ *   CONSTANT k  JUMP_IF_FALSE                   ->  JUMP or nothing
+ *   GET_LOCAL s  SET_LOCAL s                    ->  nothing
+ */
+class Peephole {
+public:
+  explicit Peephole(const Chunk &code)
+      : _code{code}, _locations{code.debug_info()}, _relocations{code.size()},
+        _targets(code.size() + 1, false) {}
+
+  Chunk run();
+
+private:
+  std::uint8_t byte(std::size_t offset) const {
+    return _code.cbegin()[offset];
+  }
+  std::uint16_t read_short(std::size_t offset) const {
+    return static_cast<std::uint16_t>(byte(offset) << 8 | byte(offset + 1));
+  }
+  std::uint32_t read_address(std::size_t offset) const;
+
+  void find_targets();
+  // the opcodes of the instructions from offset on, if none but the first
+  // is a jump target
+  bool matches(std::size_t offset,
+               std::initializer_list<std::uint8_t> instructions) const;
+  std::size_t fuse(std::size_t offset);
+  void copy(std::size_t offset);
+  void emit(std::uint8_t byte) { _out.append(byte, _loc); }
+  void emit_jump(std::uint8_t instruction, std::size_t target);
+
+  const Chunk &_code;
+  plzerow::DebugCursor _locations;
+  Chunk _out;
+  plzerow::SourceLoc _loc{0, 0};
+  Relocations _relocations;
+  std::vector<bool> _targets;
+};
+
+std::uint32_t Peephole::read_address(std::size_t offset) const {
+  std::uint32_t address = 0;
+  for (std::size_t i = 0; i < 4; ++i) {
+    address = address << 8 | byte(offset + i);
+  }
+  return address;
+}
+
+void Peephole::find_targets() {
+  for (std::size_t offset = 0; offset < _code.size();) {
+    const auto instruction = byte(offset);
+    const auto next = offset + plzerow::instruction_size(instruction);
+    switch (instruction) {
+    case plzerow::OP_JUMP:
+    case plzerow::OP_JUMP_IF_FALSE:
+      _targets[next + read_short(offset + 1)] = true;
+      break;
+    case plzerow::OP_LOOP:
+      _targets[next - read_short(offset + 1)] = true;
+      break;
+    case plzerow::OP_CALL:
+      _targets[read_address(offset + 2)] = true;
+      break;
+    }
+    offset = next;
+  }
+}
+
+bool Peephole::matches(std::size_t offset,
+                       std::initializer_list<std::uint8_t> instructions) const {
+  const auto first = offset;
+  for (const auto instruction : instructions) {
+    if (offset >= _code.size() || byte(offset) != instruction ||
+        (offset != first && _targets[offset])) {
+      return false;
+    }
+    offset += plzerow::instruction_size(instruction);
+  }
+  return true;
+}
+
+void Peephole::emit_jump(std::uint8_t instruction, std::size_t target) {
+  emit(instruction);
+  _relocations.add(_out.size(), target, Relocations::Kind::Forward);
+  emit(0);
+  emit(0);
+}
+
+// the offset after the fused sequence starting at offset, or offset if
+// none starts there
+std::size_t Peephole::fuse(std::size_t offset) {
+  using namespace plzerow;
+  if (matches(offset, {OP_GET_LOCAL, OP_CONSTANT, OP_ADD, OP_SET_LOCAL}) &&
+      byte(offset + 1) == byte(offset + 6)) {
+    emit(OP_INC_LOCAL);
+    emit(byte(offset + 1));
+    emit(byte(offset + 3));
+    return offset + 7;
+  }
+  if (matches(offset, {OP_GET_LOCAL, OP_SET_LOCAL}) &&
+      byte(offset + 1) == byte(offset + 3)) {
+    return offset + 4;
+  }
+  if (matches(offset, {OP_CONSTANT, OP_JUMP_IF_FALSE})) {
+    if (std::visit(Number, _code.constant(byte(offset + 1))) == 0) {
+      emit_jump(OP_JUMP, offset + 5 + read_short(offset + 3));
+    }
+    return offset + 5;
+  }
+  if (matches(offset, {OP_CONSTANT, OP_ADD}) ||
+      matches(offset, {OP_CONSTANT, OP_SUBTRACT})) {
+    emit(byte(offset + 2) == OP_ADD ? OP_ADD_CONST : OP_SUBTRACT_CONST);
+    emit(byte(offset + 1));
+    return offset + 3;
+  }
+  if (matches(offset, {OP_LESS, OP_JUMP_IF_FALSE}) ||
+      matches(offset, {OP_GREATER, OP_JUMP_IF_FALSE})) {
+    emit_jump(byte(offset) == OP_LESS ? OP_JUMP_IF_NOT_LESS
+                                      : OP_JUMP_IF_NOT_GREATER,
+              offset + 4 + read_short(offset + 2));
+    return offset + 4;
+  }
+  return offset;
+}
+
+void Peephole::copy(std::size_t offset) {
+  const auto instruction = byte(offset);
+  const auto next = offset + plzerow::instruction_size(instruction);
+  emit(instruction);
+  switch (instruction) {
+  case plzerow::OP_JUMP:
+  case plzerow::OP_JUMP_IF_FALSE:
+    _relocations.add(_out.size(), next + read_short(offset + 1),
+                     Relocations::Kind::Forward);
+    break;
+  case plzerow::OP_LOOP:
+    _relocations.add(_out.size(), next - read_short(offset + 1),
+                     Relocations::Kind::Backward);
+    break;
+  case plzerow::OP_CALL:
+    emit(byte(offset + 1));
+    _relocations.add(_out.size(), read_address(offset + 2),
+                     Relocations::Kind::Address);
+    offset += 1;
+    break;
+  }
+  for (auto operand = offset + 1; operand < next; ++operand) {
+    emit(byte(operand));
+  }
+}
+
+Chunk Peephole::run() {
+  for (std::size_t i = 0; i < _code.constant_count(); ++i) {
+    _out.add_constant(_code.constant(i));
+  }
+  for (const auto &name : _code.globals()) {
+    _out.add_global(name);
+  }
+  find_targets();
+
+  for (std::size_t offset = 0; offset < _code.size();) {
+    _relocations.move(offset, _out.size());
+    _loc = _locations.location(offset);
+    const auto next = fuse(offset);
+    if (next != offset) {
+      offset = next;
+      continue;
+    }
+    copy(offset);
+    offset += plzerow::instruction_size(byte(offset));
+  }
+  _relocations.move(_code.size(), _out.size());
+
+  // the code only shrinks, every jump still fits its offset
+  _relocations.apply(_out);
+  return std::move(_out);
+}
+
+} // namespace
+
+namespace plzerow {
+
+Chunk peephole(const Chunk &code) { return Peephole{code}.run(); }
+
+} // namespace plzerow
@@ -0,0 +1,325 @@
+#include "register_lowering.hpp"
+#include "opcodes.hpp"
+#include "relocations.hpp"
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <limits>
+#include <optional>
+#include <vector>
+
+namespace {
+
+using plzerow::Chunk;
+
+// A value on the abstract operand stack: a register that already holds it
+// or a constant that has not been loaded yet.
+struct Slot {
+  bool constant;
+  // a register, or the constant's index in the pool
+  std::uint32_t index;
+};
+
+class Lowering {
+public:
+  explicit Lowering(const Chunk &code)
+      : _code{code}, _locations{code.debug_info()}, _relocations{code.size()} {}
+
+  std::optional<Chunk> run();
+
+private:
+  std::uint8_t byte(std::size_t offset) const {
+    return _code.cbegin()[offset];
+  }
+  std::uint16_t read_short(std::size_t offset) const {
+    return static_cast<std::uint16_t>(byte(offset) << 8 | byte(offset + 1));
+  }
+
+  void emit(std::uint8_t byte) { _out.append(byte, _loc); }
+  std::uint8_t temporary(std::size_t depth) const {
+    return static_cast<std::uint8_t>(_variables + depth);
+  }
+  void push(Slot slot);
+  void emit_load(std::uint8_t dst, std::uint32_t index);
+  std::uint8_t pop();
+  void unary(std::uint8_t instruction);
+  void binary(std::uint8_t instruction);
+  void set_local(std::uint8_t slot);
+  void enter(std::uint8_t variables);
+  bool finish_procedure();
+
+  const Chunk &_code;
+  plzerow::DebugCursor _locations;
+  Chunk _out;
+  plzerow::SourceLoc _loc{0, 0};
+
+  std::vector<Slot> _stack;
+  plzerow::Relocations _relocations;
+
+  // the procedure being lowered
+  std::size_t _variables = 0;
+  std::size_t _max_depth = 0;
+  std::size_t _enter_operand = 0;
+  bool _in_procedure = false;
+  // the destination operand of the last instruction if it wrote the
+  // temporary on top of the stack, an assignment can retarget it
+  std::optional<std::size_t> _last_result;
+};
+
+void Lowering::push(Slot slot) {
+  _stack.push_back(slot);
+  _max_depth = std::max(_max_depth, _stack.size());
+}
+
+// loads a constant, the long form only past the first 256 of the pool
+void Lowering::emit_load(std::uint8_t dst, std::uint32_t index) {
+  if (index < plzerow::short_constants) {
+    emit(plzerow::REG_LOADK);
+    emit(dst);
+    emit(static_cast<std::uint8_t>(index));
+    return;
+  }
+  emit(plzerow::REG_LOADK_LONG);
+  emit(dst);
+  emit(static_cast<std::uint8_t>(index >> 16));
+  emit(static_cast<std::uint8_t>(index >> 8));
+  emit(static_cast<std::uint8_t>(index));
+}
+
+// the register holding the top of the stack, loading a pending constant
+// into its temporary
+std::uint8_t Lowering::pop() {
+  const auto slot = _stack.back();
+  _stack.pop_back();
+  if (!slot.constant) {
+    return static_cast<std::uint8_t>(slot.index);
+  }
+  const auto dst = temporary(_stack.size());
+  emit_load(dst, slot.index);
+  return dst;
+}
+
+void Lowering::unary(std::uint8_t instruction) {
+  const auto src = pop();
+  const auto dst = temporary(_stack.size());
+  emit(instruction);
+  _last_result = _out.size();
+  emit(dst);
+  emit(src);
+  push({false, dst});
+}
+
+void Lowering::binary(std::uint8_t instruction) {
+  const auto rhs = pop();
+  const auto lhs = pop();
+  const auto dst = temporary(_stack.size());
+  emit(instruction);
+  _last_result = _out.size();
+  emit(dst);
+  emit(lhs);
+  emit(rhs);
+  push({false, dst});
+}
+
+void Lowering::set_local(std::uint8_t slot) {
+  const auto value = _stack.back();
+  _stack.pop_back();
+  // entries still on the stack that read the variable must keep the value
+  // it had when they were pushed
+  bool saved = false;
+  for (std::size_t depth = 0; depth < _stack.size(); ++depth) {
+    auto &entry = _stack[depth];
+    if (!entry.constant && entry.index == slot) {
+      emit(plzerow::REG_MOVE);
+      emit(temporary(depth));
+      emit(slot);
+      entry.index = temporary(depth);
+      saved = true;
+    }
+  }
+  if (value.constant) {
+    emit_load(slot, value.index);
+  } else if (_last_result && !saved &&
+             value.index == temporary(_stack.size())) {
+    _out.patch(*_last_result, slot);
+    _last_result.reset();
+  } else {
+    emit(plzerow::REG_MOVE);
+    emit(slot);
+    emit(static_cast<std::uint8_t>(value.index));
+  }
+}
+
+void Lowering::enter(std::uint8_t variables) {
+  _in_procedure = true;
+  _variables = variables;
+  _max_depth = 0;
+  emit(plzerow::REG_ENTER);
+  _enter_operand = _out.size();
+  emit(variables);
+}
+
+// the frame holds the variables and one temporary per stack position
+bool Lowering::finish_procedure() {
+  if (!_in_procedure) {
+    return true;
+  }
+  const auto registers = _variables + _max_depth;
+  if (registers > std::numeric_limits<std::uint8_t>::max()) {
+    return false;
+  }
+  _out.patch(_enter_operand, static_cast<std::uint8_t>(registers));
+  return true;
+}
+
+std::optional<Chunk> Lowering::run() {
+  for (std::size_t i = 0; i < _code.constant_count(); ++i) {
+    _out.add_constant(_code.constant(i));
+  }
+  for (const auto &name : _code.globals()) {
+    _out.add_global(name);
+  }
+
+  for (std::size_t offset = 0; offset < _code.size();) {
+    const auto instruction = byte(offset);
+    const auto next = offset + plzerow::instruction_size(instruction);
+    _relocations.move(offset, _out.size());
+    _loc = _locations.location(offset);
+    const auto previous_size = _out.size();
+    const auto last_result = _last_result;
+
+    switch (instruction) {
+    case plzerow::OP_CONSTANT:
+      push({true, byte(offset + 1)});
+      break;
+    case plzerow::OP_CONSTANT_LONG:
+      push({true, plzerow::read_long_constant(_code.cbegin() + offset + 1)});
+      break;
+    case plzerow::OP_GET_LOCAL:
+      push({false, byte(offset + 1)});
+      break;
+    case plzerow::OP_SET_LOCAL:
+      set_local(byte(offset + 1));
+      break;
+    case plzerow::OP_GET_VAR: {
+      const auto dst = temporary(_stack.size());
+      emit(plzerow::REG_GET_VAR);
+      _last_result = _out.size();
+      emit(dst);
+      emit(byte(offset + 1));
+      emit(byte(offset + 2));
+      push({false, dst});
+      break;
+    }
+    case plzerow::OP_SET_VAR: {
+      const auto src = pop();
+      emit(plzerow::REG_SET_VAR);
+      emit(byte(offset + 1));
+      emit(byte(offset + 2));
+      emit(src);
+      break;
+    }
+    case plzerow::OP_NEGATE:
+      unary(plzerow::REG_NEGATE);
+      break;
+    case plzerow::OP_ODD:
+      unary(plzerow::REG_ODD);
+      break;
+    case plzerow::OP_ADD:
+      binary(plzerow::REG_ADD);
+      break;
+    case plzerow::OP_SUBTRACT:
+      binary(plzerow::REG_SUBTRACT);
+      break;
+    case plzerow::OP_MULTIPLY:
+      binary(plzerow::REG_MULTIPLY);
+      break;
+    case plzerow::OP_DIVIDE:
+      binary(plzerow::REG_DIVIDE);
+      break;
+    case plzerow::OP_EQUAL:
+      binary(plzerow::REG_EQUAL);
+      break;
+    case plzerow::OP_NOT_EQUAL:
+      binary(plzerow::REG_NOT_EQUAL);
+      break;
+    case plzerow::OP_LESS:
+      binary(plzerow::REG_LESS);
+      break;
+    case plzerow::OP_GREATER:
+      binary(plzerow::REG_GREATER);
+      break;
+    case plzerow::OP_JUMP:
+      emit(plzerow::REG_JUMP);
+      _relocations.add(_out.size(), next + read_short(offset + 1),
+                       plzerow::Relocations::Kind::Forward);
+      emit(0);
+      emit(0);
+      break;
+    case plzerow::OP_JUMP_IF_FALSE: {
+      const auto condition = pop();
+      emit(plzerow::REG_JUMP_IF_FALSE);
+      emit(condition);
+      _relocations.add(_out.size(), next + read_short(offset + 1),
+                       plzerow::Relocations::Kind::Forward);
+      emit(0);
+      emit(0);
+      break;
+    }
+    case plzerow::OP_LOOP:
+      emit(plzerow::REG_LOOP);
+      _relocations.add(_out.size(), next - read_short(offset + 1),
+                       plzerow::Relocations::Kind::Backward);
+      emit(0);
+      emit(0);
+      break;
+    case plzerow::OP_CALL: {
+      std::size_t address = 0;
+      for (std::size_t i = 0; i < 4; ++i) {
+        address = address << 8 | byte(offset + 2 + i);
+      }
+      emit(plzerow::REG_CALL);
+      emit(byte(offset + 1));
+      _relocations.add(_out.size(), address,
+                       plzerow::Relocations::Kind::Address);
+      for (std::size_t i = 0; i < 4; ++i) {
+        emit(0);
+      }
+      break;
+    }
+    case plzerow::OP_ENTER:
+      if (!finish_procedure()) {
+        return std::nullopt;
+      }
+      enter(byte(offset + 1));
+      break;
+    case plzerow::OP_RETURN:
+      emit(plzerow::REG_RETURN);
+      break;
+    default:
+      return std::nullopt;
+    }
+
+    // only the instruction that just wrote a temporary may be retargeted
+    if (_out.size() != previous_size && _last_result == last_result) {
+      _last_result.reset();
+    }
+    offset = next;
+  }
+  _relocations.move(_code.size(), _out.size());
+
+  if (!finish_procedure() || !_relocations.apply(_out)) {
+    return std::nullopt;
+  }
+  return std::move(_out);
+}
+
+} // namespace
+
+namespace plzerow {
+
+std::optional<Chunk> lower_to_registers(const Chunk &code) {
+  return Lowering{code}.run();
+}
+
+} // namespace plzerow
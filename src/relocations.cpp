@@ -0,0 +1,26 @@
+#include "relocations.hpp"
+#include <limits>
+
+namespace plzerow {
+
+bool Relocations::apply(Chunk &chunk) const {
+  for (const auto &entry : _entries) {
+    const auto target = _offsets[entry.target];
+    if (entry.kind == Kind::Address) {
+      for (std::size_t i = 0; i < 4; ++i) {
+        chunk.patch(entry.operand + i, (target >> (24 - 8 * i)) & 0xff);
+      }
+      continue;
+    }
+    const auto end = entry.operand + 2;
+    const auto jump = entry.kind == Kind::Forward ? target - end : end - target;
+    if (jump > std::numeric_limits<std::uint16_t>::max()) {
+      return false;
+    }
+    chunk.patch(entry.operand, (jump >> 8) & 0xff);
+    chunk.patch(entry.operand + 1, jump & 0xff);
+  }
+  return true;
+}
+
+} // namespace plzerow
@@ -0,0 +1,199 @@
+#include "resolver.hpp"
+#include "value.hpp"
+#include <fmt/core.h>
+#include <iostream>
+#include <limits>
+#include <variant>
+
+namespace plzerow {
+
+const Resolution &SymbolTable::operator[](NodeIndex node) const {
+  return _resolutions[node];
+}
+
+bool SymbolTable::captured(NodeIndex decl) const { return _captured[decl]; }
+
+std::size_t SymbolTable::procedures() const { return _procedures; }
+
+Resolver::Resolver(const Ast &ast, const Interner &symbols)
+    : _ast{ast}, _symbols{symbols} {}
+
+std::optional<SymbolTable> Resolver::resolve() {
+  _table = SymbolTable{};
+  _table._resolutions.assign(_ast.size(), Resolution{});
+  _table._captured.assign(_ast.size(), false);
+  _table._procedures = 1;
+  _bindings.assign(_symbols.size(), Binding{});
+  _shadowed.clear();
+  _level = 0;
+  _had_error = false;
+
+  block(std::get<Program>(_ast[_ast.root()]._value)._block);
+  if (_had_error) {
+    return std::nullopt;
+  }
+  return std::move(_table);
+}
+
+void Resolver::block(NodeIndex node) {
+  const auto &blk = std::get<Block>(_ast[node]._value);
+  const auto scope = _shadowed.size();
+
+  for (const auto c : _ast.children(blk._constDecls)) {
+    const auto &decl = std::get<ConstDecl>(_ast[c]._value);
+    declare(c, decl._name,
+            {Resolution::Kind::Constant, _level, decl._value, c});
+  }
+
+  std::int32_t slots = 0;
+  for (const auto v : _ast.children(blk._varDecls)) {
+    const auto &decl = std::get<VarDecl>(_ast[v]._value);
+    declare(v, decl._name, {Resolution::Kind::Variable, _level, slots++, v});
+  }
+  if (slots > std::numeric_limits<std::uint8_t>::max()) {
+    error(node, "too many variables in one block");
+  }
+
+  const auto procedures = _ast.children(blk._procedures);
+  for (const auto p : procedures) {
+    const auto &decl = std::get<Procedure>(_ast[p]._value);
+    const auto index = static_cast<std::int32_t>(_table._procedures++);
+    declare(p, decl._name, {Resolution::Kind::Procedure, _level, index, p});
+  }
+
+  statement(blk._statement);
+
+  ++_level;
+  for (const auto p : procedures) {
+    block(std::get<Procedure>(_ast[p]._value)._block);
+  }
+  --_level;
+
+  close_scope(scope);
+}
+
+void Resolver::statement(NodeIndex node) {
+  if (node == no_node) {
+    return;
+  }
+  _ast[node].accept(Visitor{
+      [&](const Assignment &arg) {
+        expression(arg._expression);
+        const auto *resolution = resolve(node, arg._name);
+        if (resolution == nullptr ||
+            resolution->kind == Resolution::Kind::Variable) {
+          return;
+        }
+        error(node, fmt::format("cannot assign to {} '{}'",
+                                resolution->kind == Resolution::Kind::Constant
+                                    ? "constant"
+                                    : "procedure",
+                                _symbols.name(arg._name)));
+      },
+      [&](const Call &arg) {
+        const auto *resolution = resolve(node, arg._name);
+        if (resolution != nullptr &&
+            resolution->kind != Resolution::Kind::Procedure) {
+          error(node, fmt::format("'{}' is not a procedure",
+                                  _symbols.name(arg._name)));
+        }
+      },
+      [&](const Begin &arg) {
+        statement(arg._statement);
+        for (const auto s : _ast.children(arg._statements)) {
+          statement(s);
+        }
+      },
+      [&](const If &arg) {
+        expression(arg._condition);
+        statement(arg._statement);
+      },
+      [&](const While &arg) {
+        expression(arg._condition);
+        statement(arg._statement);
+      },
+      [&](const Statement &arg) { statement(arg._statement); },
+      [](const auto &) {},
+  });
+}
+
+// conditions included
+void Resolver::expression(NodeIndex node) {
+  _ast[node].accept(Visitor{
+      [&](const OddCondition &arg) { expression(arg._expression); },
+      [&](const Condition &arg) {
+        expression(arg._left);
+        expression(arg._right);
+      },
+      [&](const Expression &arg) {
+        expression(arg._left);
+        for (const auto &operand : _ast.operands(arg._right)) {
+          expression(operand.node);
+        }
+      },
+      [&](const Term &arg) {
+        expression(arg._left);
+        for (const auto &operand : _ast.operands(arg._right)) {
+          expression(operand.node);
+        }
+      },
+      [&](const Factor &arg) { expression(arg._right); },
+      [&](const Primary &arg) {
+        const auto *resolution = resolve(node, arg._name);
+        if (resolution != nullptr &&
+            resolution->kind == Resolution::Kind::Procedure) {
+          error(node, fmt::format("procedure '{}' used as a value",
+                                  _symbols.name(arg._name)));
+        }
+      },
+      [](const auto &) {},
+  });
+}
+
+void Resolver::declare(NodeIndex node, SymbolId name, Binding binding) {
+  auto &current = _bindings[name];
+  if (current.kind != Resolution::Kind::None && current.level == _level) {
+    error(node, fmt::format("'{}' is already declared", _symbols.name(name)));
+  }
+  _shadowed.emplace_back(name, current);
+  current = binding;
+  _table._resolutions[node] = {binding.kind, 0, binding.value, node};
+}
+
+void Resolver::close_scope(std::size_t mark) {
+  while (_shadowed.size() > mark) {
+    const auto &[name, hidden] = _shadowed.back();
+    _bindings[name] = hidden;
+    _shadowed.pop_back();
+  }
+}
+
+// records what the name at node refers to, nullptr if nothing it can reach
+const Resolution *Resolver::resolve(NodeIndex node, SymbolId name) {
+  const auto &binding = _bindings[name];
+  if (binding.kind == Resolution::Kind::None) {
+    error(node, fmt::format("undeclared name '{}'", _symbols.name(name)));
+    return nullptr;
+  }
+  const auto depth = _level - binding.level;
+  if (depth > std::numeric_limits<std::uint8_t>::max()) {
+    error(node, "procedures nested too deeply");
+    return nullptr;
+  }
+  if (binding.kind == Resolution::Kind::Variable && depth > 0) {
+    _table._captured[binding.decl] = true;
+  }
+  auto &resolution = _table._resolutions[node];
+  resolution = {binding.kind, static_cast<std::uint8_t>(depth), binding.value,
+                binding.decl};
+  return &resolution;
+}
+
+void Resolver::error(NodeIndex node, const std::string &message) {
+  _had_error = true;
+  const auto &loc = _ast[node]._loc;
+  std::cerr << "[COMPILE_ERROR] [" << loc.linum << ":" << loc.column << "] "
+            << message << "\n";
+}
+
+} // namespace plzerow
@@ -0,0 +1,316 @@
+#include "scanner.hpp"
+#include <bit>
+#include <cstdint>
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#define PLZEROW_X86 1
+#endif
+
+namespace {
+
+using plzerow::LineRun;
+
+constexpr bool is_whitespace(char c) {
+  return c == ' ' || c == '\t' || c == '\r' || c == '\n';
+}
+
+/*
+ * Scalar kernels. These double as the tail loops of the vector kernels so
+ * both paths agree byte for byte.
+ */
+
+LineRun skip_whitespace_scalar(const char *begin, const char *end,
+                               LineRun run) {
+  for (const char *p = begin; p < end; ++p) {
+    if (!is_whitespace(*p)) {
+      run.end = p;
+      return run;
+    }
+    if (*p == '\n') {
+      ++run.newlines;
+      run.last_newline = p;
+    }
+  }
+  run.end = end;
+  return run;
+}
+
+LineRun skip_whitespace_scalar(const char *begin, const char *end) {
+  return skip_whitespace_scalar(begin, end, {begin, 0, nullptr});
+}
+
+LineRun find_comment_end_scalar(const char *begin, const char *end,
+                                LineRun run) {
+  for (const char *p = begin; p < end; ++p) {
+    if (*p == '}') {
+      run.end = p;
+      return run;
+    }
+    if (*p == '\n') {
+      ++run.newlines;
+      run.last_newline = p;
+    }
+  }
+  run.end = end;
+  return run;
+}
+
+LineRun find_comment_end_scalar(const char *begin, const char *end) {
+  return find_comment_end_scalar(begin, end, {begin, 0, nullptr});
+}
+
+const char *skip_ident_scalar(const char *begin, const char *end) {
+  const char *p = begin;
+  while (p < end && plzerow::is_ident_char(*p))
+    ++p;
+  return p;
+}
+
+const char *skip_number_scalar(const char *begin, const char *end) {
+  const char *p = begin;
+  while (p < end && plzerow::is_number_char(*p))
+    ++p;
+  return p;
+}
+
+#ifdef PLZEROW_X86
+
+/*
+ * SSE2 kernels, 16 bytes per step. Range checks use the unsigned trick
+ * (x - lo) <= (hi - lo), expressed as max_epu8(x - lo, hi - lo) == hi - lo.
+ */
+
+inline __m128i in_range_sse2(__m128i v, char lo, char hi) {
+  const __m128i span = _mm_set1_epi8(static_cast<char>(hi - lo));
+  const __m128i shifted = _mm_sub_epi8(v, _mm_set1_epi8(lo));
+  return _mm_cmpeq_epi8(_mm_max_epu8(shifted, span), span);
+}
+
+inline __m128i ident_mask_sse2(__m128i v) {
+  const __m128i lower = _mm_or_si128(v, _mm_set1_epi8(0x20));
+  return _mm_or_si128(
+      _mm_or_si128(in_range_sse2(lower, 'a', 'z'), in_range_sse2(v, '0', '9')),
+      _mm_cmpeq_epi8(v, _mm_set1_epi8('_')));
+}
+
+LineRun skip_whitespace_sse2(const char *begin, const char *end) {
+  LineRun run{begin, 0, nullptr};
+  const char *p = begin;
+  for (; end - p >= 16; p += 16) {
+    const __m128i v = _mm_loadu_si128(reinterpret_cast<const __m128i *>(p));
+    const __m128i nl = _mm_cmpeq_epi8(v, _mm_set1_epi8('\n'));
+    const __m128i ws = _mm_or_si128(
+        _mm_or_si128(_mm_cmpeq_epi8(v, _mm_set1_epi8(' ')),
+                     _mm_cmpeq_epi8(v, _mm_set1_epi8('\t'))),
+        _mm_or_si128(_mm_cmpeq_epi8(v, _mm_set1_epi8('\r')), nl));
+    const auto other = ~static_cast<std::uint32_t>(_mm_movemask_epi8(ws)) &
+                       0xFFFFu;
+    auto newlines = static_cast<std::uint32_t>(_mm_movemask_epi8(nl));
+    if (other != 0)
+      newlines &= (1u << std::countr_zero(other)) - 1;
+    if (newlines != 0) {
+      run.newlines += std::popcount(newlines);
+      run.last_newline = p + (31 - std::countl_zero(newlines));
+    }
+    if (other != 0) {
+      run.end = p + std::countr_zero(other);
+      return run;
+    }
+  }
+  return skip_whitespace_scalar(p, end, run);
+}
+
+LineRun find_comment_end_sse2(const char *begin, const char *end) {
+  LineRun run{begin, 0, nullptr};
+  const char *p = begin;
+  for (; end - p >= 16; p += 16) {
+    const __m128i v = _mm_loadu_si128(reinterpret_cast<const __m128i *>(p));
+    const auto close = static_cast<std::uint32_t>(
+        _mm_movemask_epi8(_mm_cmpeq_epi8(v, _mm_set1_epi8('}'))));
+    auto newlines = static_cast<std::uint32_t>(
+        _mm_movemask_epi8(_mm_cmpeq_epi8(v, _mm_set1_epi8('\n'))));
+    if (close != 0)
+      newlines &= (1u << std::countr_zero(close)) - 1;
+    if (newlines != 0) {
+      run.newlines += std::popcount(newlines);
+      run.last_newline = p + (31 - std::countl_zero(newlines));
+    }
+    if (close != 0) {
+      run.end = p + std::countr_zero(close);
+      return run;
+    }
+  }
+  return find_comment_end_scalar(p, end, run);
+}
+
+const char *skip_ident_sse2(const char *begin, const char *end) {
+  const char *p = begin;
+  for (; end - p >= 16; p += 16) {
+    const __m128i v = _mm_loadu_si128(reinterpret_cast<const __m128i *>(p));
+    const auto other =
+        ~static_cast<std::uint32_t>(_mm_movemask_epi8(ident_mask_sse2(v))) &
+        0xFFFFu;
+    if (other != 0)
+      return p + std::countr_zero(other);
+  }
+  return skip_ident_scalar(p, end);
+}
+
+const char *skip_number_sse2(const char *begin, const char *end) {
+  const char *p = begin;
+  for (; end - p >= 16; p += 16) {
+    const __m128i v = _mm_loadu_si128(reinterpret_cast<const __m128i *>(p));
+    const __m128i number = _mm_or_si128(
+        in_range_sse2(v, '0', '9'), _mm_cmpeq_epi8(v, _mm_set1_epi8('\'')));
+    const auto other =
+        ~static_cast<std::uint32_t>(_mm_movemask_epi8(number)) & 0xFFFFu;
+    if (other != 0)
+      return p + std::countr_zero(other);
+  }
+  return skip_number_scalar(p, end);
+}
+
+/*
+ * AVX2 kernels, 32 bytes per step. Compiled with a per-function target
+ * attribute so the rest of the binary does not require AVX2.
+ */
+
+#define PLZEROW_AVX2 __attribute__((target("avx2")))
+
+PLZEROW_AVX2 inline __m256i in_range_avx2(__m256i v, char lo, char hi) {
+  const __m256i span = _mm256_set1_epi8(static_cast<char>(hi - lo));
+  const __m256i shifted = _mm256_sub_epi8(v, _mm256_set1_epi8(lo));
+  return _mm256_cmpeq_epi8(_mm256_max_epu8(shifted, span), span);
+}
+
+PLZEROW_AVX2 inline __m256i ident_mask_avx2(__m256i v) {
+  const __m256i lower = _mm256_or_si256(v, _mm256_set1_epi8(0x20));
+  return _mm256_or_si256(_mm256_or_si256(in_range_avx2(lower, 'a', 'z'),
+                                         in_range_avx2(v, '0', '9')),
+                         _mm256_cmpeq_epi8(v, _mm256_set1_epi8('_')));
+}
+
+PLZEROW_AVX2 LineRun skip_whitespace_avx2(const char *begin,
+                                          const char *end) {
+  LineRun run{begin, 0, nullptr};
+  const char *p = begin;
+  for (; end - p >= 32; p += 32) {
+    const __m256i v =
+        _mm256_loadu_si256(reinterpret_cast<const __m256i *>(p));
+    const __m256i nl = _mm256_cmpeq_epi8(v, _mm256_set1_epi8('\n'));
+    const __m256i ws = _mm256_or_si256(
+        _mm256_or_si256(_mm256_cmpeq_epi8(v, _mm256_set1_epi8(' ')),
+                        _mm256_cmpeq_epi8(v, _mm256_set1_epi8('\t'))),
+        _mm256_or_si256(_mm256_cmpeq_epi8(v, _mm256_set1_epi8('\r')), nl));
+    const auto other = ~static_cast<std::uint32_t>(_mm256_movemask_epi8(ws));
+    auto newlines = static_cast<std::uint32_t>(_mm256_movemask_epi8(nl));
+    if (other != 0)
+      newlines &= (1u << std::countr_zero(other)) - 1;
+    if (newlines != 0) {
+      run.newlines += std::popcount(newlines);
+      run.last_newline = p + (31 - std::countl_zero(newlines));
+    }
+    if (other != 0) {
+      run.end = p + std::countr_zero(other);
+      return run;
+    }
+  }
+  return skip_whitespace_scalar(p, end, run);
+}
+
+PLZEROW_AVX2 LineRun find_comment_end_avx2(const char *begin,
+                                           const char *end) {
+  LineRun run{begin, 0, nullptr};
+  const char *p = begin;
+  for (; end - p >= 32; p += 32) {
+    const __m256i v =
+        _mm256_loadu_si256(reinterpret_cast<const __m256i *>(p));
+    const auto close = static_cast<std::uint32_t>(
+        _mm256_movemask_epi8(_mm256_cmpeq_epi8(v, _mm256_set1_epi8('}'))));
+    auto newlines = static_cast<std::uint32_t>(
+        _mm256_movemask_epi8(_mm256_cmpeq_epi8(v, _mm256_set1_epi8('\n'))));
+    if (close != 0)
+      newlines &= (1u << std::countr_zero(close)) - 1;
+    if (newlines != 0) {
+      run.newlines += std::popcount(newlines);
+      run.last_newline = p + (31 - std::countl_zero(newlines));
+    }
+    if (close != 0) {
+      run.end = p + std::countr_zero(close);
+      return run;
+    }
+  }
+  return find_comment_end_scalar(p, end, run);
+}
+
+PLZEROW_AVX2 const char *skip_ident_avx2(const char *begin, const char *end) {
+  const char *p = begin;
+  for (; end - p >= 32; p += 32) {
+    const __m256i v =
+        _mm256_loadu_si256(reinterpret_cast<const __m256i *>(p));
+    const auto other = ~static_cast<std::uint32_t>(
+        _mm256_movemask_epi8(ident_mask_avx2(v)));
+    if (other != 0)
+      return p + std::countr_zero(other);
+  }
+  return skip_ident_scalar(p, end);
+}
+
+PLZEROW_AVX2 const char *skip_number_avx2(const char *begin, const char *end) {
+  const char *p = begin;
+  for (; end - p >= 32; p += 32) {
+    const __m256i v =
+        _mm256_loadu_si256(reinterpret_cast<const __m256i *>(p));
+    const __m256i number =
+        _mm256_or_si256(in_range_avx2(v, '0', '9'),
+                        _mm256_cmpeq_epi8(v, _mm256_set1_epi8('\'')));
+    const auto other =
+        ~static_cast<std::uint32_t>(_mm256_movemask_epi8(number));
+    if (other != 0)
+      return p + std::countr_zero(other);
+  }
+  return skip_number_scalar(p, end);
+}
+
+#undef PLZEROW_AVX2
+
+#endif // PLZEROW_X86
+
+constexpr plzerow::ScanKernels scalar_kernels{
+    "scalar", skip_whitespace_scalar, find_comment_end_scalar,
+    skip_ident_scalar, skip_number_scalar};
+
+#ifdef PLZEROW_X86
+constexpr plzerow::ScanKernels sse2_kernels{
+    "sse2", skip_whitespace_sse2, find_comment_end_sse2, skip_ident_sse2,
+    skip_number_sse2};
+
+constexpr plzerow::ScanKernels avx2_kernels{
+    "avx2", skip_whitespace_avx2, find_comment_end_avx2, skip_ident_avx2,
+    skip_number_avx2};
+#endif
+
+const plzerow::ScanKernels &select_kernels() {
+#ifdef PLZEROW_X86
+  __builtin_cpu_init();
+  if (__builtin_cpu_supports("avx2"))
+    return avx2_kernels;
+  if (__builtin_cpu_supports("sse2"))
+    return sse2_kernels;
+#endif
+  return scalar_kernels;
+}
+
+} // namespace
+
+namespace plzerow {
+
+const ScanKernels &scan_kernels() {
+  static const ScanKernels &kernels = select_kernels();
+  return kernels;
+}
+
+const ScanKernels &scalar_scan_kernels() { return scalar_kernels; }
+
+} // namespace plzerow
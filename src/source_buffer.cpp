@@ -0,0 +1,135 @@
+#include "source_buffer.hpp"
+#include <cstring>
+#include <utility>
+
+#if defined(__unix__) || defined(__APPLE__)
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#define PLZEROW_HAS_MMAP 1
+#endif
+
+namespace plzerow {
+
+SourceBuffer::SourceBuffer(std::vector<char> &&buffer)
+    : _buffer{std::move(buffer)}, _data{_buffer.data()},
+      _size{_buffer.size()} {}
+
+SourceBuffer SourceBuffer::view(std::string_view text) {
+  SourceBuffer source;
+  source._data = text.data();
+  source._size = text.size();
+  return source;
+}
+
+std::optional<SourceBuffer> SourceBuffer::map(const std::string &filename) {
+#ifdef PLZEROW_HAS_MMAP
+  const int fd = ::open(filename.c_str(), O_RDONLY);
+  if (fd < 0) {
+    return std::nullopt;
+  }
+
+  struct stat info {};
+  if (::fstat(fd, &info) != 0) {
+    ::close(fd);
+    return std::nullopt;
+  }
+
+  SourceBuffer source;
+  const auto filesize = static_cast<std::size_t>(info.st_size);
+  if (filesize > 0) {
+    void *mapping = ::mmap(nullptr, filesize, PROT_READ, MAP_PRIVATE, fd, 0);
+    if (mapping == MAP_FAILED) {
+      ::close(fd);
+      return std::nullopt;
+    }
+    ::madvise(mapping, filesize, MADV_SEQUENTIAL);
+    source._mapping = mapping;
+    source._mapping_size = filesize;
+    source._data = static_cast<const char *>(mapping);
+    source._size = filesize;
+  }
+  ::close(fd);
+  return source;
+#else
+  (void)filename;
+  return std::nullopt;
+#endif
+}
+
+std::optional<SourceBuffer> SourceBuffer::stream(const std::string &filename,
+                                                 std::size_t window_size) {
+  SourceBuffer source;
+  source._stream.open(filename, std::ios::binary);
+  if (!source._stream) {
+    return std::nullopt;
+  }
+  source._buffer.resize(window_size > 0 ? window_size : default_window_size);
+  source._data = source._buffer.data();
+  source._exhausted = false;
+  source.refill(0);
+  return source;
+}
+
+SourceBuffer::SourceBuffer(SourceBuffer &&other) noexcept
+    : _buffer{std::move(other._buffer)}, _stream{std::move(other._stream)},
+      _data{std::exchange(other._data, nullptr)},
+      _size{std::exchange(other._size, 0)},
+      _mapping{std::exchange(other._mapping, nullptr)},
+      _mapping_size{std::exchange(other._mapping_size, 0)},
+      _exhausted{std::exchange(other._exhausted, true)} {}
+
+SourceBuffer &SourceBuffer::operator=(SourceBuffer &&other) noexcept {
+  if (this != &other) {
+    release();
+    _buffer = std::move(other._buffer);
+    _stream = std::move(other._stream);
+    _data = std::exchange(other._data, nullptr);
+    _size = std::exchange(other._size, 0);
+    _mapping = std::exchange(other._mapping, nullptr);
+    _mapping_size = std::exchange(other._mapping_size, 0);
+    _exhausted = std::exchange(other._exhausted, true);
+  }
+  return *this;
+}
+
+SourceBuffer::~SourceBuffer() { release(); }
+
+void SourceBuffer::release() {
+#ifdef PLZEROW_HAS_MMAP
+  if (_mapping != nullptr) {
+    ::munmap(_mapping, _mapping_size);
+  }
+#endif
+  _mapping = nullptr;
+  _mapping_size = 0;
+}
+
+const char *SourceBuffer::data() const { return _data; }
+
+std::size_t SourceBuffer::size() const { return _size; }
+
+bool SourceBuffer::exhausted() const { return _exhausted; }
+
+std::size_t SourceBuffer::refill(std::size_t keep_from) {
+  if (_exhausted) {
+    return 0;
+  }
+
+  const auto kept = _size - keep_from;
+  std::memmove(_buffer.data(), _buffer.data() + keep_from, kept);
+  if (kept == _buffer.size()) {
+    // a single token fills the whole window, grow instead of sliding
+    _buffer.resize(_buffer.size() * 2);
+  }
+
+  _stream.read(_buffer.data() + kept,
+               static_cast<std::streamsize>(_buffer.size() - kept));
+  _data = _buffer.data();
+  _size = kept + static_cast<std::size_t>(_stream.gcount());
+  _exhausted = !_stream;
+  return keep_from;
+}
+
+} // namespace plzerow
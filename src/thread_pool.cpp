@@ -0,0 +1,42 @@
+#include "thread_pool.hpp"
+#include <algorithm>
+
+namespace plzerow {
+
+ThreadPool::ThreadPool(unsigned threads) {
+  threads = std::max(threads, 1u);
+  _workers.reserve(threads);
+  for (unsigned i = 0; i < threads; ++i) {
+    _workers.emplace_back([this]() { run(); });
+  }
+}
+
+ThreadPool::~ThreadPool() {
+  {
+    std::lock_guard lock{_mutex};
+    _stopping = true;
+  }
+  _ready.notify_all();
+  // join before the queue and its mutex are destroyed
+  _workers.clear();
+}
+
+unsigned ThreadPool::size() const { return _workers.size(); }
+
+void ThreadPool::run() {
+  for (;;) {
+    std::function<void()> task;
+    {
+      std::unique_lock lock{_mutex};
+      _ready.wait(lock, [this]() { return _stopping || !_tasks.empty(); });
+      if (_tasks.empty()) {
+        return;
+      }
+      task = std::move(_tasks.front());
+      _tasks.pop();
+    }
+    task();
+  }
+}
+
+} // namespace plzerow
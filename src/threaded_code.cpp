@@ -0,0 +1,81 @@
+#include "threaded_code.hpp"
+#include "opcodes.hpp"
+#include <variant>
+
+namespace plzerow {
+
+// Two passes: the first numbers the instructions, the second decodes them
+// and turns jump offsets and call addresses into instruction indices.
+ThreadedCode::ThreadedCode(const Chunk &chunk) {
+  const auto bytes = chunk.cbegin();
+  std::vector<std::uint32_t> indices(chunk.size() + 1, 0);
+  for (std::size_t offset = 0; offset < chunk.size();
+       offset += instruction_size(bytes[offset])) {
+    indices[offset] = static_cast<std::uint32_t>(_offsets.size());
+    _offsets.push_back(static_cast<std::uint32_t>(offset));
+  }
+  indices[chunk.size()] = static_cast<std::uint32_t>(_offsets.size());
+
+  const auto short_operand = [&](std::size_t offset) {
+    return static_cast<std::size_t>(bytes[offset] << 8 | bytes[offset + 1]);
+  };
+  _code.reserve(_offsets.size());
+  for (const auto offset : _offsets) {
+    const auto instruction = bytes[offset];
+    const auto next = offset + instruction_size(instruction);
+    ThreadedInstruction entry{.opcode = instruction};
+    switch (instruction) {
+    case OP_CONSTANT:
+      entry.constant = chunk.constant(bytes[offset + 1]);
+      break;
+    case OP_CONSTANT_LONG:
+      entry.constant = chunk.constant(read_long_constant(bytes + offset + 1));
+      break;
+    case OP_GET_LOCAL:
+    case OP_SET_LOCAL:
+    case OP_ENTER:
+      entry.slot = bytes[offset + 1];
+      break;
+    case OP_GET_VAR:
+    case OP_SET_VAR:
+      entry.hops = bytes[offset + 1];
+      entry.slot = bytes[offset + 2];
+      break;
+    case OP_JUMP:
+    case OP_JUMP_IF_FALSE:
+    case OP_JUMP_IF_NOT_LESS:
+    case OP_JUMP_IF_NOT_GREATER:
+      entry.target = indices[next + short_operand(offset + 1)];
+      break;
+    case OP_LOOP:
+      entry.target = indices[next - short_operand(offset + 1)];
+      break;
+    case OP_CALL: {
+      std::size_t address = 0;
+      for (std::size_t i = 0; i < 4; ++i) {
+        address = address << 8 | bytes[offset + 2 + i];
+      }
+      entry.hops = bytes[offset + 1];
+      entry.target = indices[address];
+      break;
+    }
+    case OP_ADD_CONST:
+    case OP_SUBTRACT_CONST:
+      entry.number = std::visit(Number, chunk.constant(bytes[offset + 1]));
+      break;
+    case OP_INC_LOCAL:
+      entry.slot = bytes[offset + 1];
+      entry.number = std::visit(Number, chunk.constant(bytes[offset + 2]));
+      break;
+    }
+    _code.push_back(entry);
+  }
+}
+
+void ThreadedCode::bind(const HandlerTable &handlers) {
+  for (auto &entry : _code) {
+    entry.handler = handlers[entry.opcode];
+  }
+}
+
+} // namespace plzerow
@@ -5,9 +5,16 @@
 namespace plzerow {
 
 TOKEN Token::type() const { return _token; }
-const std::string &Token::literal() const { return _literal; }
+std::string_view Token::literal() const { return _literal; }
+SymbolId Token::symbol() const {
+  return _token == TOKEN::IDENT ? _payload : no_symbol;
+}
+std::int32_t Token::number() const {
+  return _token == TOKEN::NUMBER ? static_cast<std::int32_t>(_payload) : 0;
+}
 std::size_t Token::linum() const { return _linum; }
 std::size_t Token::token_start() const { return _token_start; }
+LexError Token::error() const { return _error; }
 
 std::ostream &operator<<(std::ostream &os, const Token &token) {
   os << token.linum() << ":" << token.token_start() << " Token='"
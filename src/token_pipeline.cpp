@@ -0,0 +1,70 @@
+#include "token_pipeline.hpp"
+#include "token_type.hpp"
+
+namespace plzerow {
+
+TokenPipeline::TokenPipeline(Lexer &lexer, const std::string &filename)
+    : _lexer{lexer}, _filename{filename} {
+  _lexer.set_report_errors(false);
+  _producer = std::jthread{[this]() { produce(); }};
+}
+
+TokenPipeline::~TokenPipeline() {
+  _queue.close();
+  if (_producer.joinable()) {
+    _producer.join();
+  }
+}
+
+void TokenPipeline::produce() {
+  for (;;) {
+    auto *batch = _queue.acquire();
+    if (batch == nullptr) {
+      return;
+    }
+    while (batch->size() < TokenQueue::batch_size) {
+      batch->push_back(_lexer.next());
+      const auto type = batch->back().type();
+      if (type == TOKEN::ENDFILE || type == TOKEN::ERROR) {
+        _queue.publish();
+        return;
+      }
+    }
+    _queue.publish();
+  }
+}
+
+const Token &TokenPipeline::next() {
+  if (_lex_here) {
+    _pulled = _lexer.next();
+    if (_pulled.error() != LexError::NONE) {
+      Lexer::report_error(_filename, _pulled);
+    }
+    return _pulled;
+  }
+  if (_batch == nullptr || _next == _batch->size()) {
+    if (_batch != nullptr) {
+      _queue.pop();
+    }
+    _batch = &_queue.front();
+    _next = 0;
+  }
+
+  const auto &token = (*_batch)[_next];
+  // the producer has stopped, ENDFILE stays at the front from here on
+  if (token.type() == TOKEN::ENDFILE) {
+    return token;
+  }
+  ++_next;
+  if (token.error() != LexError::NONE) {
+    Lexer::report_error(_filename, token);
+  }
+  if (token.type() == TOKEN::ERROR) {
+    // the producer stopped after it; the lexer is ours once it has exited
+    _producer.join();
+    _lex_here = true;
+  }
+  return token;
+}
+
+} // namespace plzerow
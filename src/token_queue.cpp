@@ -0,0 +1,53 @@
+#include "token_queue.hpp"
+
+namespace plzerow {
+
+TokenQueue::TokenQueue() {
+  for (auto &slot : _slots) {
+    slot.reserve(batch_size);
+  }
+}
+
+std::vector<Token> *TokenQueue::acquire() {
+  const auto head = _head.load(std::memory_order_relaxed);
+  while (head - _cached_tail == capacity) {
+    _tail.wait(_cached_tail, std::memory_order_acquire);
+    _cached_tail = _tail.load(std::memory_order_acquire);
+  }
+  if (_closed.load(std::memory_order_acquire)) {
+    return nullptr;
+  }
+  auto &slot = _slots[head % capacity];
+  slot.clear();
+  return &slot;
+}
+
+void TokenQueue::publish() {
+  _head.fetch_add(1, std::memory_order_release);
+  _head.notify_one();
+}
+
+const std::vector<Token> &TokenQueue::front() {
+  const auto tail = _tail.load(std::memory_order_relaxed);
+  while (tail == _cached_head) {
+    _head.wait(_cached_head, std::memory_order_acquire);
+    _cached_head = _head.load(std::memory_order_acquire);
+  }
+  return _slots[tail % capacity];
+}
+
+void TokenQueue::pop() {
+  _tail.fetch_add(1, std::memory_order_release);
+  _tail.notify_one();
+}
+
+void TokenQueue::close() {
+  // dropping every pending batch moves the tail, which wakes a producer
+  // waiting on a full ring; it then sees the flag
+  _closed.store(true, std::memory_order_release);
+  _tail.store(_head.load(std::memory_order_acquire),
+              std::memory_order_release);
+  _tail.notify_one();
+}
+
+} // namespace plzerow
@@ -1,11 +1,47 @@
 #include "value.hpp"
+#include <cstring>
+#include <functional>
+
+namespace {
+
+std::uint64_t bits(const plzerow::Value &value) {
+  return std::visit(
+      [](auto number) {
+        std::uint64_t bits = 0;
+        std::memcpy(&bits, &number, sizeof number);
+        return bits;
+      },
+      value);
+}
+
+} // namespace
 
 namespace plzerow {
 
 const std::vector<Value> &ValueArray::values() const { return _values; }
 
+std::optional<std::size_t> ValueArray::find(const Value &value) const {
+  const auto found = _indices.find(value);
+  if (found == _indices.end()) {
+    return std::nullopt;
+  }
+  return found->second;
+}
+
 std::size_t ValueArray::append(const Value &value) {
-  _values.push_back(value);
-  return _values.size() - 1;
+  const auto [entry, added] = _indices.try_emplace(value, _values.size());
+  if (added) {
+    _values.push_back(value);
+  }
+  return entry->second;
 }
+
+std::size_t ValueArray::Hash::operator()(const Value &value) const {
+  return std::hash<std::uint64_t>{}(bits(value) * 31 + value.index());
+}
+
+bool ValueArray::Same::operator()(const Value &lhs, const Value &rhs) const {
+  return lhs.index() == rhs.index() && bits(lhs) == bits(rhs);
+}
+
 } // namespace plzerow
@@ -1,16 +1,23 @@
 #include "virtual_machine.hpp"
+#include "arithmetic.hpp"
+#include "bytecode_cache.hpp"
 #include "chunk.hpp"
 #include "debugger.hpp"
 #include "inputhandler.hpp"
+#include "jit.hpp"
+#include "native_build.hpp"
+#include "threaded_code.hpp"
 #include "value.hpp"
-#include <functional>
+#include <fstream>
 #include <iostream>
+#include <sstream>
 #include <string>
 #include <variant>
+#include <vector>
 
 namespace {
 
-void dump_stack(std::stack<plzerow::Value> stack) {
+[[maybe_unused]] void dump_stack(std::stack<plzerow::Value> stack) {
   std::cout << "[ ";
   while (!stack.empty()) {
     auto v = stack.top();
@@ -21,88 +28,794 @@ void dump_stack(std::stack<plzerow::Value> stack) {
   std::cout << "]\n";
 }
 
-auto Negate = [](auto &&arg) -> plzerow::Value { return -arg; };
-
-auto BinaryOp = [](const plzerow::Value &lhs, const plzerow::Value &rhs,
-                   std::function<double(double, double)> f) -> plzerow::Value {
-  auto lhs_v = std::visit(plzerow::Number, lhs);
-  auto rhs_v = std::visit(plzerow::Number, rhs);
-  /*
-   * Pay close attention to the order of the two pops. Note that we assign the
-   * first popped operand to b, not a. It looks backwards. When the operands
-   * themselves are calculated, the left is evaluated first, then the right.
-   * That means the left operand gets pushed before the right operand. So the
-   * right operand will be on top of the stack. Thus, the first value we pop is
-   * b.
-   */
-  return plzerow::Value{f(rhs_v, lhs_v)};
-};
-
 } // namespace
 
+// GCC and Clang take the address of a label, which lets every handler jump
+// straight to the next one; configuring with PLZEROW_COMPUTED_GOTO off
+// defines PLZEROW_SWITCH_DISPATCH and keeps the switch
+#if (defined(__GNUC__) || defined(__clang__)) &&                               \
+    !defined(PLZEROW_SWITCH_DISPATCH)
+#define PLZEROW_COMPUTED_GOTO 1
+#endif
+
 namespace plzerow {
 
+// --dump-ir has nothing to print for a cached program, it always compiles
+VM::VM(CompilerOptions options)
+    : _engine{options.engine}, _jit_verify{options.jit_verify},
+      _native{options.native}, _compiler{options} {
+  if (!options.cache_dir.empty() && !options.dump_ir) {
+    _cache.emplace(options.cache_dir, options);
+  }
+}
+
 InstructionPointer VM::next() { return _ip++; }
 
+std::uint16_t VM::read_short() {
+  const auto high = *next();
+  const auto low = *next();
+  return static_cast<std::uint16_t>(high << 8 | low);
+}
+
+std::uint32_t VM::read_long_constant() {
+  const auto index = plzerow::read_long_constant(_ip);
+  _ip += 3;
+  return index;
+}
+
+std::uint32_t VM::read_address() {
+  std::uint32_t address = 0;
+  for (int i = 0; i < 4; ++i) {
+    address = address << 8 | *next();
+  }
+  return address;
+}
+
 Value VM::pop_stack() {
   auto v = _stack.top();
   _stack.pop();
   return v;
 }
 
+std::int32_t VM::pop_number() { return std::visit(Number, pop_stack()); }
+
+Value &VM::variable(std::size_t hops, std::uint8_t slot) {
+  auto frame = _frames.size() - 1;
+  for (; hops > 0; --hops) {
+    frame = _frames[frame].static_link;
+  }
+  return _variables[_frames[frame].base + slot];
+}
+
+std::int32_t &VM::variable_register(std::size_t hops, std::uint8_t slot) {
+  auto frame = _frames.size() - 1;
+  for (; hops > 0; --hops) {
+    frame = _frames[frame].static_link;
+  }
+  return _registers[_frames[frame].base + slot];
+}
+
+void VM::load(Chunk &&chunk) {
+  _chunk = std::move(chunk);
+  _ip = _chunk.cbegin();
+  _stack = {};
+  _variables.clear();
+  _registers.clear();
+  _numbers.clear();
+  for (std::size_t i = 0; i < _chunk.constant_count(); ++i) {
+    _numbers.push_back(_chunk.visit_constant(i, Number));
+  }
+  if (_engine == Engine::Threaded) {
+    _threaded = ThreadedCode{_chunk};
+  }
+  // the main program's frame, its RETURN halts the VM
+  _frames.assign(1, Frame{0, 0, _ip});
+}
+
+InterpretResult VM::runtime_error(const std::string &err) const {
+  const auto offset = static_cast<std::size_t>(_ip - _chunk.cbegin()) - 1;
+  std::cerr << "[RUNTIME_ERROR] [line " << _chunk.linum(offset) << "] " << err
+            << "\n";
+  return InterpretResult::RUNTIME_ERROR;
+}
+
+void VM::print_globals() const {
+  const auto &globals = _chunk.globals();
+  for (std::size_t slot = 0; slot < globals.size(); ++slot) {
+    std::cout << globals[slot] << " = ";
+    if (_engine == Engine::Register) {
+      std::cout << _registers[slot];
+    } else {
+      std::visit(PrintVisitor, _variables[slot]);
+    }
+    std::cout << "\n";
+  }
+}
+
 InterpretResult VM::run() {
+  switch (_engine) {
+  case Engine::Register:
+    return run_registers();
+  case Engine::Jit:
+    return run_jit();
+  case Engine::Threaded:
+    return run_threaded();
+  default:
+    return run_stack();
+  }
+}
+
+// A chunk the JIT does not translate, or any chunk on a host without it, is
+// interpreted. So is a program that recurses deeper than the native frame
+// area holds, which the interpreter's growing frames can still run. With
+// _jit_verify the interpreter runs first and prints the results, and the
+// native run must end the same way with the same globals.
+InterpretResult VM::run_jit() {
+  const auto code = JitCode::compile(_chunk);
+  if (!code) {
+    return run_stack();
+  }
+  const auto globals = _chunk.globals().size();
+  std::optional<InterpretResult> expected;
+  if (_jit_verify) {
+    expected = run_stack();
+  }
+  const auto result = code->run(globals);
+  if (result.status == JitCode::Status::StackOverflow) {
+    return expected ? *expected : run_stack();
+  }
+
+  if (expected) {
+    const auto failed = *expected != InterpretResult::OK;
+    const auto offset = static_cast<std::size_t>(_ip - _chunk.cbegin()) - 1;
+    bool same = failed == (result.status != JitCode::Status::OK) &&
+                (!failed || offset == result.offset);
+    for (std::size_t slot = 0; slot < globals; ++slot) {
+      same = same &&
+             std::visit(Number, _variables[slot]) == result.globals[slot];
+    }
+    if (!same) {
+      std::cerr << "[JIT_MISMATCH] native code and interpreter disagree\n";
+      return InterpretResult::RUNTIME_ERROR;
+    }
+    return *expected;
+  }
+
+  _variables.assign(result.globals.begin(), result.globals.end());
+  if (result.status != JitCode::Status::OK) {
+    _ip = _chunk.cbegin() + result.offset + 1;
+    return runtime_error("division by zero");
+  }
+  print_globals();
+  return InterpretResult::OK;
+}
+
+// The interpreters' handlers end by jumping straight to the next
+// instruction's handler where labels have addresses, and by going back to a
+// switch on the opcode where they do not. HANDLER_TABLE declares a
+// HandlerTable of the labels of every opcode in a list like
+// PLZEROW_OPCODES, anything else runs unknown.
+#ifdef PLZEROW_COMPUTED_GOTO
+#define HANDLER(opcode) handle_##opcode
+#define HANDLER_ADDRESS(opcode, operands) handlers[opcode] = &&handle_##opcode;
+#define HANDLER_TABLE(handlers, opcodes)                                       \
+  HandlerTable handlers;                                                       \
+  handlers.fill(&&unknown);                                                    \
+  opcodes(HANDLER_ADDRESS)
+#else
+#define HANDLER(opcode) case opcode
+#endif
+
+#ifdef PLZEROW_TRACE
+#define TRACE(offset)                                                          \
+  dump_stack(_stack);                                                          \
+  Debugger::disassemble_instruction(offset, _chunk)
+#define TRACE_REGISTERS(offset)                                                \
+  Debugger::disassemble_register_instruction(offset, _chunk)
+#else
+#define TRACE(offset)
+#define TRACE_REGISTERS(offset)
+#endif
+
+#pragma GCC diagnostic push
+#pragma GCC diagnostic ignored "-Wpedantic"
+
+InterpretResult VM::run_stack() {
+#ifdef PLZEROW_COMPUTED_GOTO
+  HANDLER_TABLE(handlers, PLZEROW_OPCODES);
+#define DISPATCH()                                                             \
+  TRACE(_ip - _chunk.cbegin());                                                \
+  goto *handlers[*next()]
+  DISPATCH();
+#else
+#define DISPATCH() continue
   for (;;) {
-    dump_stack(_stack);
-    Debugger::disassemble_instruction(_ip - _chunk.cbegin(), _chunk);
-    std::uint8_t instruction;
-    switch (instruction = *next()) {
-    case OP_CONSTANT:
-    case OP_CONSTANT_LONG:
-      _stack.push(_chunk.constant(*next()));
-      break;
-    case OP_NEGATE:
-      _stack.push(std::visit(Negate, pop_stack()));
-      break;
-    case OP_MULTIPLY:
-      _stack.push(
-          BinaryOp(pop_stack(), pop_stack(), std::multiplies<std::int32_t>()));
-      break;
-    case OP_DIVIDE:
-      _stack.push(
-          BinaryOp(pop_stack(), pop_stack(), std::divides<std::int32_t>()));
-      break;
-    case OP_ADD:
-      _stack.push(
-          BinaryOp(pop_stack(), pop_stack(), std::plus<std::int32_t>()));
-      break;
-    case OP_SUBTRACT:
-      _stack.push(
-          BinaryOp(pop_stack(), pop_stack(), std::minus<std::int32_t>()));
-      break;
-    case OP_RETURN:
-      std::visit(PrintVisitor, _stack.top());
-      _stack.pop();
+    TRACE(_ip - _chunk.cbegin());
+    switch (*next()) {
+#endif
+  HANDLER(OP_CONSTANT):
+    _stack.push(_chunk.constant(*next()));
+    DISPATCH();
+  HANDLER(OP_CONSTANT_LONG):
+    _stack.push(_chunk.constant(read_long_constant()));
+    DISPATCH();
+  HANDLER(OP_NEGATE):
+    _stack.push(wrapping_negate(pop_number()));
+    DISPATCH();
+  HANDLER(OP_MULTIPLY): {
+    const auto rhs = pop_number();
+    _stack.push(wrapping_multiply(pop_number(), rhs));
+    DISPATCH();
+  }
+  HANDLER(OP_DIVIDE): {
+    const auto rhs = pop_number();
+    if (rhs == 0) {
+      return runtime_error("division by zero");
+    }
+    _stack.push(wrapping_divide(pop_number(), rhs));
+    DISPATCH();
+  }
+  HANDLER(OP_ADD): {
+    const auto rhs = pop_number();
+    _stack.push(wrapping_add(pop_number(), rhs));
+    DISPATCH();
+  }
+  HANDLER(OP_SUBTRACT): {
+    const auto rhs = pop_number();
+    _stack.push(wrapping_subtract(pop_number(), rhs));
+    DISPATCH();
+  }
+  HANDLER(OP_ODD):
+    _stack.push(std::int32_t{(pop_number() & 1) != 0});
+    DISPATCH();
+  HANDLER(OP_EQUAL): {
+    const auto rhs = pop_number();
+    _stack.push(std::int32_t{pop_number() == rhs});
+    DISPATCH();
+  }
+  HANDLER(OP_NOT_EQUAL): {
+    const auto rhs = pop_number();
+    _stack.push(std::int32_t{pop_number() != rhs});
+    DISPATCH();
+  }
+  HANDLER(OP_LESS): {
+    const auto rhs = pop_number();
+    _stack.push(std::int32_t{pop_number() < rhs});
+    DISPATCH();
+  }
+  HANDLER(OP_GREATER): {
+    const auto rhs = pop_number();
+    _stack.push(std::int32_t{pop_number() > rhs});
+    DISPATCH();
+  }
+  HANDLER(OP_GET_LOCAL):
+    _stack.push(_variables[_frames.back().base + *next()]);
+    DISPATCH();
+  HANDLER(OP_SET_LOCAL):
+    _variables[_frames.back().base + *next()] = pop_stack();
+    DISPATCH();
+  HANDLER(OP_GET_VAR): {
+    const auto hops = *next();
+    _stack.push(variable(hops, *next()));
+    DISPATCH();
+  }
+  HANDLER(OP_SET_VAR): {
+    const auto hops = *next();
+    variable(hops, *next()) = pop_stack();
+    DISPATCH();
+  }
+  HANDLER(OP_JUMP):
+    _ip += read_short();
+    DISPATCH();
+  HANDLER(OP_JUMP_IF_FALSE): {
+    const auto offset = read_short();
+    if (pop_number() == 0) {
+      _ip += offset;
+    }
+    DISPATCH();
+  }
+  HANDLER(OP_LOOP): {
+    const auto offset = read_short();
+    _ip -= offset;
+    DISPATCH();
+  }
+  HANDLER(OP_CALL): {
+    auto static_link = _frames.size() - 1;
+    for (auto hops = *next(); hops > 0; --hops) {
+      static_link = _frames[static_link].static_link;
+    }
+    const auto address = read_address();
+    _frames.push_back(Frame{_variables.size(), static_link, _ip});
+    _ip = _chunk.cbegin() + address;
+    DISPATCH();
+  }
+  HANDLER(OP_ADD_CONST):
+    _stack.push(wrapping_add(pop_number(),
+                             std::visit(Number, _chunk.constant(*next()))));
+    DISPATCH();
+  HANDLER(OP_SUBTRACT_CONST):
+    _stack.push(wrapping_subtract(
+        pop_number(), std::visit(Number, _chunk.constant(*next()))));
+    DISPATCH();
+  HANDLER(OP_INC_LOCAL): {
+    auto &value = _variables[_frames.back().base + *next()];
+    value = wrapping_add(std::visit(Number, value),
+                         std::visit(Number, _chunk.constant(*next())));
+    DISPATCH();
+  }
+  HANDLER(OP_JUMP_IF_NOT_LESS): {
+    const auto offset = read_short();
+    const auto rhs = pop_number();
+    if (!(pop_number() < rhs)) {
+      _ip += offset;
+    }
+    DISPATCH();
+  }
+  HANDLER(OP_JUMP_IF_NOT_GREATER): {
+    const auto offset = read_short();
+    const auto rhs = pop_number();
+    if (!(pop_number() > rhs)) {
+      _ip += offset;
+    }
+    DISPATCH();
+  }
+  HANDLER(OP_ENTER):
+    _variables.resize(_variables.size() + *next(), Value{std::int32_t{0}});
+    DISPATCH();
+  HANDLER(OP_RETURN): {
+    if (_frames.size() == 1) {
+      print_globals();
       return InterpretResult::OK;
-    default:
-      std::cout << "COMPILE_ERROR\n";
-      return InterpretResult::COMPILE_ERROR;
     }
+    const auto frame = _frames.back();
+    _frames.pop_back();
+    _variables.resize(frame.base, Value{std::int32_t{0}});
+    _ip = frame.return_address;
+    DISPATCH();
   }
+#ifdef PLZEROW_COMPUTED_GOTO
+unknown:
+#else
+  default:
+#endif
+    std::cout << "COMPILE_ERROR\n";
+    return InterpretResult::COMPILE_ERROR;
+#ifndef PLZEROW_COMPUTED_GOTO
+    }
+  }
+#endif
+#undef DISPATCH
+}
 
-  return InterpretResult::OK;
+// Runs the same instructions as run_stack, with their operands decoded and
+// jumps resolved when the chunk was loaded. Frames are kept as they are
+// there, the instruction a call returns to is kept in returns.
+InterpretResult VM::run_threaded() {
+#ifdef PLZEROW_COMPUTED_GOTO
+  HANDLER_TABLE(handlers, PLZEROW_OPCODES);
+  _threaded.bind(handlers);
+#endif
+  const auto *const code = _threaded.code();
+  const auto *ip = code;
+  std::vector<const ThreadedInstruction *> returns;
+  const auto fail = [&](const std::string &err) {
+    _ip = _chunk.cbegin() + _threaded.offset(ip) + 1;
+    return runtime_error(err);
+  };
+
+#ifdef PLZEROW_COMPUTED_GOTO
+#define DISPATCH()                                                             \
+  TRACE(_threaded.offset(ip));                                                 \
+  goto *ip->handler
+  DISPATCH();
+#else
+#define DISPATCH() continue
+  for (;;) {
+    TRACE(_threaded.offset(ip));
+    switch (ip->opcode) {
+#endif
+  HANDLER(OP_CONSTANT):
+  HANDLER(OP_CONSTANT_LONG):
+    _stack.push(ip->constant);
+    ++ip;
+    DISPATCH();
+  HANDLER(OP_NEGATE):
+    _stack.push(wrapping_negate(pop_number()));
+    ++ip;
+    DISPATCH();
+  HANDLER(OP_MULTIPLY): {
+    const auto rhs = pop_number();
+    _stack.push(wrapping_multiply(pop_number(), rhs));
+    ++ip;
+    DISPATCH();
+  }
+  HANDLER(OP_DIVIDE): {
+    const auto rhs = pop_number();
+    if (rhs == 0) {
+      return fail("division by zero");
+    }
+    _stack.push(wrapping_divide(pop_number(), rhs));
+    ++ip;
+    DISPATCH();
+  }
+  HANDLER(OP_ADD): {
+    const auto rhs = pop_number();
+    _stack.push(wrapping_add(pop_number(), rhs));
+    ++ip;
+    DISPATCH();
+  }
+  HANDLER(OP_SUBTRACT): {
+    const auto rhs = pop_number();
+    _stack.push(wrapping_subtract(pop_number(), rhs));
+    ++ip;
+    DISPATCH();
+  }
+  HANDLER(OP_ODD):
+    _stack.push(std::int32_t{(pop_number() & 1) != 0});
+    ++ip;
+    DISPATCH();
+  HANDLER(OP_EQUAL): {
+    const auto rhs = pop_number();
+    _stack.push(std::int32_t{pop_number() == rhs});
+    ++ip;
+    DISPATCH();
+  }
+  HANDLER(OP_NOT_EQUAL): {
+    const auto rhs = pop_number();
+    _stack.push(std::int32_t{pop_number() != rhs});
+    ++ip;
+    DISPATCH();
+  }
+  HANDLER(OP_LESS): {
+    const auto rhs = pop_number();
+    _stack.push(std::int32_t{pop_number() < rhs});
+    ++ip;
+    DISPATCH();
+  }
+  HANDLER(OP_GREATER): {
+    const auto rhs = pop_number();
+    _stack.push(std::int32_t{pop_number() > rhs});
+    ++ip;
+    DISPATCH();
+  }
+  HANDLER(OP_GET_LOCAL):
+    _stack.push(_variables[_frames.back().base + ip->slot]);
+    ++ip;
+    DISPATCH();
+  HANDLER(OP_SET_LOCAL):
+    _variables[_frames.back().base + ip->slot] = pop_stack();
+    ++ip;
+    DISPATCH();
+  HANDLER(OP_GET_VAR):
+    _stack.push(variable(ip->hops, ip->slot));
+    ++ip;
+    DISPATCH();
+  HANDLER(OP_SET_VAR):
+    variable(ip->hops, ip->slot) = pop_stack();
+    ++ip;
+    DISPATCH();
+  HANDLER(OP_JUMP):
+  HANDLER(OP_LOOP):
+    ip = code + ip->target;
+    DISPATCH();
+  HANDLER(OP_JUMP_IF_FALSE):
+    ip = pop_number() == 0 ? code + ip->target : ip + 1;
+    DISPATCH();
+  HANDLER(OP_CALL): {
+    auto static_link = _frames.size() - 1;
+    for (auto hops = ip->hops; hops > 0; --hops) {
+      static_link = _frames[static_link].static_link;
+    }
+    _frames.push_back(Frame{_variables.size(), static_link, nullptr});
+    returns.push_back(ip + 1);
+    ip = code + ip->target;
+    DISPATCH();
+  }
+  HANDLER(OP_ADD_CONST):
+    _stack.push(wrapping_add(pop_number(), ip->number));
+    ++ip;
+    DISPATCH();
+  HANDLER(OP_SUBTRACT_CONST):
+    _stack.push(wrapping_subtract(pop_number(), ip->number));
+    ++ip;
+    DISPATCH();
+  HANDLER(OP_INC_LOCAL): {
+    auto &value = _variables[_frames.back().base + ip->slot];
+    value = wrapping_add(std::visit(Number, value), ip->number);
+    ++ip;
+    DISPATCH();
+  }
+  HANDLER(OP_JUMP_IF_NOT_LESS): {
+    const auto rhs = pop_number();
+    ip = !(pop_number() < rhs) ? code + ip->target : ip + 1;
+    DISPATCH();
+  }
+  HANDLER(OP_JUMP_IF_NOT_GREATER): {
+    const auto rhs = pop_number();
+    ip = !(pop_number() > rhs) ? code + ip->target : ip + 1;
+    DISPATCH();
+  }
+  HANDLER(OP_ENTER):
+    _variables.resize(_variables.size() + ip->slot, Value{std::int32_t{0}});
+    ++ip;
+    DISPATCH();
+  HANDLER(OP_RETURN): {
+    if (_frames.size() == 1) {
+      print_globals();
+      return InterpretResult::OK;
+    }
+    const auto frame = _frames.back();
+    _frames.pop_back();
+    _variables.resize(frame.base, Value{std::int32_t{0}});
+    ip = returns.back();
+    returns.pop_back();
+    DISPATCH();
+  }
+#ifdef PLZEROW_COMPUTED_GOTO
+unknown:
+#else
+  default:
+#endif
+    std::cout << "COMPILE_ERROR\n";
+    return InterpretResult::COMPILE_ERROR;
+#ifndef PLZEROW_COMPUTED_GOTO
+    }
+  }
+#endif
+#undef DISPATCH
+}
+
+// Register operands index the current frame from base, which is kept in a
+// local and reloaded on CALL and RETURN. So is the instruction pointer:
+// handlers that load _ip from memory after the previous one stored it wait
+// for that store on every dispatch, and _ip is only set where an error is
+// reported. Operands are read at fixed offsets from ip, which then skips
+// them.
+InterpretResult VM::run_registers() {
+  auto base = _frames.back().base;
+  auto ip = _ip;
+  auto reg = [&](std::uint8_t index) -> std::int32_t & {
+    return _registers[base + index];
+  };
+  const auto jump_offset = [](InstructionPointer operand) {
+    return static_cast<std::uint16_t>(operand[0] << 8 | operand[1]);
+  };
+#ifdef PLZEROW_COMPUTED_GOTO
+  HANDLER_TABLE(handlers, PLZEROW_REG_OPCODES);
+#define DISPATCH()                                                             \
+  TRACE_REGISTERS(ip - _chunk.cbegin());                                       \
+  goto *handlers[*ip++]
+  DISPATCH();
+#else
+#define DISPATCH() continue
+  for (;;) {
+    TRACE_REGISTERS(ip - _chunk.cbegin());
+    switch (*ip++) {
+#endif
+  HANDLER(REG_LOADK):
+    reg(ip[0]) = _numbers[ip[1]];
+    ip += 2;
+    DISPATCH();
+  HANDLER(REG_LOADK_LONG):
+    reg(ip[0]) = _numbers[plzerow::read_long_constant(ip + 1)];
+    ip += 4;
+    DISPATCH();
+  HANDLER(REG_MOVE):
+    reg(ip[0]) = reg(ip[1]);
+    ip += 2;
+    DISPATCH();
+  HANDLER(REG_NEGATE):
+    reg(ip[0]) = wrapping_negate(reg(ip[1]));
+    ip += 2;
+    DISPATCH();
+  HANDLER(REG_ODD):
+    reg(ip[0]) = (reg(ip[1]) & 1) != 0;
+    ip += 2;
+    DISPATCH();
+  HANDLER(REG_ADD):
+    reg(ip[0]) = wrapping_add(reg(ip[1]), reg(ip[2]));
+    ip += 3;
+    DISPATCH();
+  HANDLER(REG_SUBTRACT):
+    reg(ip[0]) = wrapping_subtract(reg(ip[1]), reg(ip[2]));
+    ip += 3;
+    DISPATCH();
+  HANDLER(REG_MULTIPLY):
+    reg(ip[0]) = wrapping_multiply(reg(ip[1]), reg(ip[2]));
+    ip += 3;
+    DISPATCH();
+  HANDLER(REG_DIVIDE): {
+    const auto rhs = reg(ip[2]);
+    if (rhs == 0) {
+      _ip = ip + 3;
+      return runtime_error("division by zero");
+    }
+    reg(ip[0]) = wrapping_divide(reg(ip[1]), rhs);
+    ip += 3;
+    DISPATCH();
+  }
+  HANDLER(REG_EQUAL):
+    reg(ip[0]) = reg(ip[1]) == reg(ip[2]);
+    ip += 3;
+    DISPATCH();
+  HANDLER(REG_NOT_EQUAL):
+    reg(ip[0]) = reg(ip[1]) != reg(ip[2]);
+    ip += 3;
+    DISPATCH();
+  HANDLER(REG_LESS):
+    reg(ip[0]) = reg(ip[1]) < reg(ip[2]);
+    ip += 3;
+    DISPATCH();
+  HANDLER(REG_GREATER):
+    reg(ip[0]) = reg(ip[1]) > reg(ip[2]);
+    ip += 3;
+    DISPATCH();
+  HANDLER(REG_GET_VAR):
+    reg(ip[0]) = variable_register(ip[1], ip[2]);
+    ip += 3;
+    DISPATCH();
+  HANDLER(REG_SET_VAR):
+    variable_register(ip[0], ip[1]) = reg(ip[2]);
+    ip += 3;
+    DISPATCH();
+  HANDLER(REG_JUMP):
+    ip += 2 + jump_offset(ip);
+    DISPATCH();
+  HANDLER(REG_JUMP_IF_FALSE):
+    ip += reg(ip[0]) == 0 ? 3 + jump_offset(ip + 1) : 3;
+    DISPATCH();
+  HANDLER(REG_LOOP):
+    ip -= jump_offset(ip) - 2;
+    DISPATCH();
+  HANDLER(REG_CALL): {
+    auto static_link = _frames.size() - 1;
+    for (auto hops = ip[0]; hops > 0; --hops) {
+      static_link = _frames[static_link].static_link;
+    }
+    std::uint32_t address = 0;
+    for (std::size_t i = 1; i <= 4; ++i) {
+      address = address << 8 | ip[i];
+    }
+    base = _registers.size();
+    _frames.push_back(Frame{base, static_link, ip + 5});
+    ip = _chunk.cbegin() + address;
+    DISPATCH();
+  }
+  HANDLER(REG_ENTER):
+    _registers.resize(_registers.size() + ip[0], 0);
+    ++ip;
+    DISPATCH();
+  HANDLER(REG_RETURN): {
+    if (_frames.size() == 1) {
+      print_globals();
+      return InterpretResult::OK;
+    }
+    const auto frame = _frames.back();
+    _frames.pop_back();
+    _registers.resize(frame.base);
+    ip = frame.return_address;
+    base = _frames.back().base;
+    DISPATCH();
+  }
+#ifdef PLZEROW_COMPUTED_GOTO
+unknown:
+#else
+  default:
+#endif
+    std::cout << "COMPILE_ERROR\n";
+    return InterpretResult::COMPILE_ERROR;
+#ifndef PLZEROW_COMPUTED_GOTO
+    }
+  }
+#endif
+#undef DISPATCH
+}
+
+#pragma GCC diagnostic pop
+
+#undef HANDLER
+#undef HANDLER_ADDRESS
+#undef HANDLER_TABLE
+#undef TRACE
+#undef TRACE_REGISTERS
+
+void VM::execute(CompilerResult result) {
+  if (result != CompilerResult::OK) {
+    return;
+  }
+  load(_compiler.take_chunk());
+  run();
 }
 
 void VM::repl() {
   for (;;) {
     std::cout << "> ";
     auto source_code = InputHandler::read_from_repl(std::cin);
-    _compiler.compile(std::move(source_code));
+    execute(_compiler.compile(std::move(source_code)));
+  }
+}
+
+// The cache is keyed by the whole source, so a streamed source that did not
+// fit a single window is compiled every time.
+NativeCheck VM::runfile(const std::string &filename, InputMode input_mode) {
+  if (_native.enabled()) {
+    return translate(filename, input_mode);
+  }
+  auto source = InputHandler::open_file(filename, input_mode);
+  if (!_cache || !source.exhausted()) {
+    execute(_compiler.compile(filename, std::move(source)));
+    return NativeCheck::Same;
+  }
+  const auto key = _cache->key({source.data(), source.size()});
+  if (auto chunk = _cache->load(key)) {
+    load(std::move(*chunk));
+    run();
+    return NativeCheck::Same;
+  }
+  if (_compiler.compile(filename, std::move(source)) != CompilerResult::OK) {
+    return NativeCheck::Same;
+  }
+  auto chunk = _compiler.take_chunk();
+  _cache->store(key, chunk);
+  load(std::move(chunk));
+  run();
+  return NativeCheck::Same;
+}
+
+// The program goes through the whole compiler first, so one the VM would
+// reject is not translated either.
+NativeCheck VM::translate(const std::string &filename, InputMode input_mode) {
+  auto source = InputHandler::open_file(filename, input_mode);
+  if (_compiler.compile(filename, std::move(source)) != CompilerResult::OK) {
+    return NativeCheck::Same;
   }
+  const auto c_source = _compiler.c_source();
+  if (!_native.emit_c.empty()) {
+    std::ofstream out{_native.emit_c, std::ios::binary};
+    out << c_source;
+    out.close();
+    if (out.fail()) {
+      std::cerr << "unable to write " << _native.emit_c << "\n";
+    }
+  }
+  if (!_native.output.empty()) {
+    build_native(c_source, _native.output, _native.shared);
+  }
+  if (_native.verify) {
+    return verify_native(c_source);
+  }
+  return NativeCheck::Same;
 }
 
-void VM::runfile(const std::string &filename) {
-  auto source_code = InputHandler::read_from_file(filename);
-  _compiler.compile(std::move(source_code));
+// Runs the program natively and in the VM, with whichever engine is
+// selected, and compares what they print; the VM's output is passed on
+// either way, even when the native program could not be built.
+NativeCheck VM::verify_native(const std::string &c_source) {
+  const auto native = run_native(c_source);
+
+  std::ostringstream out;
+  std::ostringstream err;
+  auto *const cout = std::cout.rdbuf(out.rdbuf());
+  auto *const cerr = std::cerr.rdbuf(err.rdbuf());
+  load(_compiler.take_chunk());
+  const auto result = run();
+  std::cout.rdbuf(cout);
+  std::cerr.rdbuf(cerr);
+  std::cout << out.str();
+  std::cerr << err.str();
+
+  if (!native) {
+    std::cerr << "[NATIVE_NOT_BUILT] the native executable could not be "
+                 "built\n";
+    return NativeCheck::NotBuilt;
+  }
+  if ((native->status == 0) != (result == InterpretResult::OK) ||
+      native->out != out.str() || native->err != err.str()) {
+    std::cerr << "[NATIVE_MISMATCH] native executable and interpreter "
+                 "disagree\n";
+    return NativeCheck::Differs;
+  }
+  return NativeCheck::Same;
 }
 
 } // namespace plzerow
@@ -0,0 +1,73 @@
+"""Times startup with a cold and a warm bytecode cache.
+
+Every program is run with --cache-dir pointing at an empty directory, which
+compiles it and stores the bytecode, and then again with the same
+directory, which maps the stored bytecode instead. Each is the best of
+--runs, a cold run getting a fresh directory every time. Without programs,
+one of --size MB is generated with tools/bench_lex.py's program corpus: many
+procedures and a main program that calls none of them, so the time is
+startup. Other options are passed to plzerow, since they are part of the
+cache key:
+
+    python3 tools/bench_cache.py build/plzerow
+    python3 tools/bench_cache.py build/plzerow test/big.pl0 -- -O2
+"""
+
+import argparse
+import os
+import shutil
+import subprocess
+import sys
+import tempfile
+import time
+
+from bench_lex import program
+
+
+def run(command):
+    start = time.perf_counter()
+    subprocess.run(command, stdin=subprocess.DEVNULL, capture_output=True,
+                   check=True)
+    return time.perf_counter() - start
+
+
+def main():
+    parser = argparse.ArgumentParser()
+    parser.add_argument("plzerow", help="path to the plzerow executable")
+    parser.add_argument("programs", nargs="*", help=".pl0 programs")
+    parser.add_argument("--size", type=float, default=0.9,
+                        help="MB of generated program without programs")
+    parser.add_argument("--runs", type=int, default=5)
+    # argparse would take options after -- for more programs
+    argv = sys.argv[1:]
+    split = argv.index("--") if "--" in argv else len(argv)
+    args = parser.parse_args(argv[:split])
+    flags = argv[split + 1:]
+
+    scratch = tempfile.mkdtemp()
+    try:
+        programs = args.programs
+        if not programs:
+            generated = os.path.join(scratch, "generated.pl0")
+            with open(generated, "w") as output:
+                output.write(program(int(args.size * 1e6)))
+            programs = [generated]
+        print(f"{'program':24}{'cold':>10}{'warm':>10}")
+        for path in programs:
+            cold = None
+            for i in range(args.runs):
+                cache = os.path.join(scratch, f"cache{i}")
+                command = [args.plzerow, f"--cache-dir={cache}", *flags, path]
+                seconds = run(command)
+                cold = seconds if cold is None else min(cold, seconds)
+            warm = min(run(command) for _ in range(args.runs))
+            for i in range(args.runs):
+                shutil.rmtree(os.path.join(scratch, f"cache{i}"))
+            name = path.rsplit("/", 1)[-1]
+            print(f"{name:24}{cold:>9.3f}s{warm:>9.3f}s")
+    finally:
+        shutil.rmtree(scratch)
+
+
+if __name__ == "__main__":
+    main()
@@ -0,0 +1,65 @@
+"""Times the interpreter's dispatch variants on the same programs.
+
+Every build is run with every engine on every program, and the best of
+--runs wall clock times is reported. Builds are given as label=path, so one
+configured with -DPLZEROW_COMPUTED_GOTO=OFF can be compared to a default
+one:
+
+    python3 tools/bench_dispatch.py switch=build-switch/plzerow \\
+        goto=build/plzerow --engines stack,threaded test/*.pl0
+"""
+
+import argparse
+import subprocess
+import sys
+import time
+
+
+def best_time(command, runs):
+    best = None
+    output = None
+    for _ in range(runs):
+        start = time.perf_counter()
+        result = subprocess.run(command, capture_output=True, text=True)
+        elapsed = time.perf_counter() - start
+        best = elapsed if best is None else min(best, elapsed)
+        output = result.stdout + result.stderr
+    return best, output
+
+
+def main():
+    parser = argparse.ArgumentParser()
+    parser.add_argument("arguments", nargs="+",
+                        help="label=path builds and .pl0 programs")
+    parser.add_argument("--engines", default="stack,threaded")
+    parser.add_argument("--runs", type=int, default=3)
+    args = parser.parse_intermixed_args()
+
+    builds = [a.split("=", 1) for a in args.arguments if "=" in a]
+    programs = [a for a in args.arguments if "=" not in a]
+    engines = args.engines.split(",")
+    if not builds or not programs:
+        parser.error("need at least one label=path build and one program")
+
+    variants = [(label, path, engine)
+                for label, path in builds for engine in engines]
+    names = [f"{label}/{engine}" for label, _, engine in variants]
+    width = max(len(name) for name in names + ["program"]) + 2
+    print("program".ljust(24) + "".join(name.rjust(width) for name in names))
+    for program in programs:
+        row = program.rsplit("/", 1)[-1].ljust(24)
+        expected = None
+        for label, path, engine in variants:
+            seconds, output = best_time(
+                [path, f"--engine={engine}", program], args.runs)
+            if expected is None:
+                expected = output
+            elif output != expected:
+                print(f"{program}: {label}/{engine} printed something else",
+                      file=sys.stderr)
+            row += f"{seconds:.3f}s".rjust(width)
+        print(row)
+
+
+if __name__ == "__main__":
+    main()
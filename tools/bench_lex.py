@@ -0,0 +1,125 @@
+"""Times the lexer's scanning kernels against the scan they replaced.
+
+Runs plzerow --bench-lex, which tokenizes a file with the byte-at-a-time
+scan the lexer did before the kernels, the scalar kernels and the SIMD ones
+picked for the CPU, and prints the best MB/s of each and its speedup over
+the first. It then looks up every word of the file with the keyword perfect
+hash and with the std::unordered_map<std::string, TOKEN> the lexer used
+before, and prints the best millions of words a second of each. Without
+programs, a corpus of --size MB is generated first:
+
+  program      procedures of assignments, loops and comments with
+               indentation, the mix the kernels skip through
+  identifiers  nothing but keywords and identifiers, some of them a
+               keyword's length or sharing its first and last letters, so
+               the time goes to scanning and classifying words
+
+--output keeps the generated corpus in a file.
+
+    python3 tools/bench_lex.py build/plzerow
+    python3 tools/bench_lex.py build/plzerow --corpus identifiers --size 17
+    python3 tools/bench_lex.py build/plzerow test/*.pl0
+"""
+
+import argparse
+import os
+import random
+import subprocess
+import tempfile
+
+
+KEYWORDS = ["var", "odd", "const", "if", "do", "then", "call", "begin",
+            "while", "end", "procedure"]
+# close to keywords: same length, first or last letter, or a prefix
+NEAR_KEYWORDS = ["val", "old", "count", "it", "dx", "them", "cell", "being",
+                 "whale", "ends", "procedures", "els", "printf", "fr"]
+
+
+def identifiers(size):
+    rng = random.Random(1)
+    # a fixed pool, so interning finds most names and stays out of the way
+    pool = ["".join(rng.choice("abcdefghijklmnopqrstuvwxyz_")
+                    for _ in range(rng.randint(1, 12))) for _ in range(1000)]
+    words = []
+    written = 0
+    while written < size:
+        roll = rng.random()
+        if roll < 0.3:
+            word = rng.choice(KEYWORDS)
+        elif roll < 0.6:
+            word = rng.choice(NEAR_KEYWORDS)
+        else:
+            word = rng.choice(pool)
+        words.append(word)
+        written += len(word) + 1
+    lines = [" ".join(words[i:i + 12]) for i in range(0, len(words), 12)]
+    return "\n".join(lines) + "\n"
+
+
+def program(size):
+    rng = random.Random(1)
+    parts = ["var total, count, limit;\n"]
+    written = len(parts[0])
+    procedure = 0
+    while written < size:
+        names = [f"value_{procedure}_{i}" for i in range(4)]
+        lines = [f"procedure step_{procedure};\n",
+                 f"    var {', '.join(names)};\n",
+                 "begin\n",
+                 "    { initialise the counters before the loop runs }\n"]
+        for name in names:
+            lines.append(f"    {name} := {rng.randint(0, 99999)};\n")
+        lines.append(f"    while {names[0]} < limit do\n")
+        lines.append("    begin\n")
+        for name in names[1:]:
+            lines.append(f"        {name} := {name} + {names[0]} * "
+                         f"{rng.randint(1, 999)};\n")
+        lines.append(f"        {names[0]} := {names[0]} + 1\n")
+        lines.append("    end;\n")
+        lines.append(f"    total := total + {names[1]}\n")
+        lines.append("end;\n\n")
+        text = "".join(lines)
+        parts.append(text)
+        written += len(text)
+        procedure += 1
+    parts.append("begin\n    total := 0;\n    limit := 10\nend.\n")
+    return "".join(parts)
+
+
+def main():
+    parser = argparse.ArgumentParser()
+    parser.add_argument("plzerow", help="path to the plzerow executable")
+    parser.add_argument("programs", nargs="*", help=".pl0 programs")
+    parser.add_argument("--size", type=float, default=20,
+                        help="MB of generated corpus without programs")
+    parser.add_argument("--corpus", choices=["program", "identifiers"],
+                        default="program")
+    parser.add_argument("--output", help="write the generated corpus here")
+    args = parser.parse_args()
+
+    programs = args.programs
+    corpus = None
+    if not programs:
+        generate = identifiers if args.corpus == "identifiers" else program
+        text = generate(int(args.size * 1e6))
+        if args.output:
+            with open(args.output, "w") as output:
+                output.write(text)
+            programs = [args.output]
+        else:
+            corpus = tempfile.NamedTemporaryFile("w", suffix=".pl0",
+                                                 delete=False)
+            corpus.write(text)
+            corpus.close()
+            programs = [corpus.name]
+    try:
+        for path in programs:
+            print(path)
+            subprocess.run([args.plzerow, "--bench-lex", path], check=True)
+    finally:
+        if corpus:
+            os.unlink(corpus.name)
+
+
+if __name__ == "__main__":
+    main()
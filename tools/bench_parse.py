@@ -0,0 +1,60 @@
+"""Times the parser on a large generated program.
+
+Runs plzerow --bench-parse, which parses the program from tokens lexed up
+front (Parser<TokenArray>), straight from the lexer (Parser<Lexer>), from
+the lexer through a std::function as before the parser was templated
+(Parser<TokenFunction>) and from the lexer running on a second thread
+(Parser<TokenPipeline>, --pipeline) and prints the best millions of tokens
+a second of each. Without programs, one
+of --size MB is generated with tools/bench_lex.py's program corpus, which is
+valid PL/0; --output keeps it.
+
+The pipeline can only beat the lexer row with a second core free, and by at
+most the shorter of lexing and parsing.
+
+    python3 tools/bench_parse.py build/plzerow --size 33
+    python3 tools/bench_parse.py build/plzerow test/*.pl0
+"""
+
+import argparse
+import os
+import subprocess
+import tempfile
+
+from bench_lex import program
+
+
+def main():
+    parser = argparse.ArgumentParser()
+    parser.add_argument("plzerow", help="path to the plzerow executable")
+    parser.add_argument("programs", nargs="*", help=".pl0 programs")
+    parser.add_argument("--size", type=float, default=20,
+                        help="MB of generated program without programs")
+    parser.add_argument("--output", help="write the generated program here")
+    args = parser.parse_args()
+
+    programs = args.programs
+    generated = None
+    if not programs:
+        text = program(int(args.size * 1e6))
+        if args.output:
+            with open(args.output, "w") as output:
+                output.write(text)
+            programs = [args.output]
+        else:
+            generated = tempfile.NamedTemporaryFile("w", suffix=".pl0",
+                                                    delete=False)
+            generated.write(text)
+            generated.close()
+            programs = [generated.name]
+    try:
+        for path in programs:
+            print(path)
+            subprocess.run([args.plzerow, "--bench-parse", path], check=True)
+    finally:
+        if generated:
+            os.unlink(generated.name)
+
+
+if __name__ == "__main__":
+    main()
@@ -0,0 +1,47 @@
+"""Checks that the JIT prints what the stack interpreter prints.
+
+Every program is run with --engine=stack and --engine=jit at -O0 and -O2,
+and anything the two print differently, on stdout or stderr, is shown as a
+diff. The exit status is non-zero if any program differed:
+
+    python3 tools/check_jit.py build/plzerow test/*.pl0
+"""
+
+import argparse
+import difflib
+import subprocess
+import sys
+
+LEVELS = ["-O0", "-O2"]
+
+
+def output(command):
+    result = subprocess.run(command, capture_output=True, text=True)
+    return (result.stdout + result.stderr).splitlines(keepends=True)
+
+
+def main():
+    parser = argparse.ArgumentParser()
+    parser.add_argument("plzerow", help="path to the plzerow executable")
+    parser.add_argument("programs", nargs="+", help=".pl0 programs")
+    args = parser.parse_args()
+
+    mismatches = 0
+    for program in args.programs:
+        for level in LEVELS:
+            expected = output([args.plzerow, "--engine=stack", level, program])
+            actual = output([args.plzerow, "--engine=jit", level, program])
+            if actual == expected:
+                print(f"ok        {program} {level}")
+                continue
+            mismatches += 1
+            print(f"MISMATCH  {program} {level}")
+            sys.stdout.writelines(difflib.unified_diff(
+                expected, actual, "stack", "jit"))
+    if mismatches:
+        print(f"{mismatches} mismatches", file=sys.stderr)
+    return 1 if mismatches else 0
+
+
+if __name__ == "__main__":
+    sys.exit(main())
@@ -0,0 +1,44 @@
+"""Checks that the C backend's executables print what the interpreter prints.
+
+Every program is run with --native-verify at -O0 and -O2, which builds it
+with the system C compiler ($CC or cc), runs it and the interpreter and
+exits with 1 if they printed something different and 2 if it could not be
+built. The exit status is non-zero if any program differed or failed to
+build:
+
+    python3 tools/check_native.py build/plzerow test/*.pl0
+"""
+
+import argparse
+import subprocess
+import sys
+
+LEVELS = ["-O0", "-O2"]
+VERDICTS = {0: "ok", 1: "MISMATCH", 2: "NOT BUILT"}
+
+
+def main():
+    parser = argparse.ArgumentParser()
+    parser.add_argument("plzerow", help="path to the plzerow executable")
+    parser.add_argument("programs", nargs="+", help=".pl0 programs")
+    args = parser.parse_args()
+
+    failures = 0
+    for program in args.programs:
+        for level in LEVELS:
+            result = subprocess.run(
+                [args.plzerow, "--native-verify", level, program],
+                capture_output=True, text=True)
+            verdict = VERDICTS.get(result.returncode,
+                                   f"EXIT {result.returncode}")
+            print(f"{verdict:<10}{program} {level}")
+            if result.returncode != 0:
+                failures += 1
+                sys.stdout.write(result.stderr)
+    if failures:
+        print(f"{failures} failures", file=sys.stderr)
+    return 1 if failures else 0
+
+
+if __name__ == "__main__":
+    sys.exit(main())
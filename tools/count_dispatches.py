@@ -0,0 +1,85 @@
+"""Counts the instructions each engine dispatches and times it.
+
+A build configured with -DPLZEROW_TRACE=ON prints the chunk and then every
+instruction it executes; the instructions after the listing are the
+dispatches. A Release build gives the wall time, best of --runs:
+
+    python3 tools/count_dispatches.py --trace build-trace/plzerow \\
+        --release build/plzerow test/loops.pl0 test/big.pl0
+
+Tracing prints a line per instruction, so count on short runs such as
+test/loops.pl0 and time the long ones.
+"""
+
+import argparse
+import re
+import subprocess
+import time
+
+INSTRUCTION = re.compile(r"^(\d{4}) ")
+
+
+def dispatches(trace, engine, program, flags):
+    """Instruction lines after the disassembly listing, which is the first
+    run of increasing offsets after the "== name ==" header."""
+    process = subprocess.Popen([trace, f"--engine={engine}", *flags, program],
+                               stdout=subprocess.PIPE, text=True)
+    listing = None
+    previous = -1
+    count = 0
+    for line in process.stdout:
+        if listing is None:
+            listing = True if line.startswith("== ") else None
+            continue
+        match = INSTRUCTION.match(line)
+        if listing:
+            if match and int(match.group(1)) > previous:
+                previous = int(match.group(1))
+                continue
+            listing = False
+        if match:
+            count += 1
+    process.wait()
+    return count
+
+
+def best_time(release, engine, program, flags, runs):
+    best = None
+    for _ in range(runs):
+        start = time.perf_counter()
+        subprocess.run([release, f"--engine={engine}", *flags, program],
+                       capture_output=True)
+        elapsed = time.perf_counter() - start
+        best = elapsed if best is None else min(best, elapsed)
+    return best
+
+
+def main():
+    parser = argparse.ArgumentParser()
+    parser.add_argument("programs", nargs="+", help=".pl0 programs")
+    parser.add_argument("--trace", help="a PLZEROW_TRACE build, counts")
+    parser.add_argument("--release", help="a Release build, times")
+    parser.add_argument("--engines", default="stack,register")
+    parser.add_argument("--runs", type=int, default=5)
+    parser.add_argument("-O", dest="level", default="0",
+                        help="optimization level")
+    args = parser.parse_intermixed_args()
+    if not args.trace and not args.release:
+        parser.error("need --trace, --release or both")
+
+    flags = [f"-O{args.level}"]
+    print(f"{'program':24}{'engine':>10}{'dispatches':>14}{'wall':>10}")
+    for program in args.programs:
+        for engine in args.engines.split(","):
+            count = (dispatches(args.trace, engine, program, flags)
+                     if args.trace else None)
+            seconds = (best_time(args.release, engine, program, flags,
+                                 args.runs) if args.release else None)
+            name = program.rsplit("/", 1)[-1]
+            print(f"{name:24}{engine:>10}"
+                  f"{'-' if count is None else count:>14}"
+                  f"{'-' if seconds is None else f'{seconds:.3f}s':>10}")
+
+
+if __name__ == "__main__":
+    main()
@@ -1,53 +1,93 @@
 import sys
 
 ast_nodes = [
-    "Block     : NodeContainer constDecls | NodeContainer varDecls | NodeContainer procedures | std::unique_ptr<ASTNode> statement",
-    "ConstDecl : std::string name | int value",
-    "VarDecl   : std::string name",
-    "Procedure : std::string name | std::unique_ptr<ASTNode> block",
-    "Statement : std::unique_ptr<ASTNode> statement",
-    "Assignment: std::string name | std::unique_ptr<ASTNode> expression",
-    "Call      : std::string name",
-    "Begin     : std::unique_ptr<ASTNode> statement | NodeContainer statements",
-    "If        : std::unique_ptr<ASTNode> condition | std::unique_ptr<ASTNode> statement",
-    "While     : std::unique_ptr<ASTNode> condition | std::unique_ptr<ASTNode> statement",
-    "Condition : TOKEN op | std::unique_ptr<ASTNode> left | std::unique_ptr<ASTNode> right",
-    "OddCondition: std::unique_ptr<ASTNode> expression",
-    "Comparison: TOKEN op | std::unique_ptr<ASTNode> left | std::unique_ptr<ASTNode> right",
-    "Expression: TOKEN op | std::unique_ptr<ASTNode> left | ExprContainer right",
-    "Term      : TOKEN op | std::unique_ptr<ASTNode> left | ExprContainer right",
-    "Binary    : TOKEN op | std::unique_ptr<ASTNode> left | std::unique_ptr<ASTNode> right",
-    "Unary     : TOKEN op | std::unique_ptr<ASTNode> right",
-    "Factor    : TOKEN op | std::unique_ptr<ASTNode> right",
-    "Primary   : std::string right",
-    "Program   : std::unique_ptr<ASTNode> block",
+    "Block     : NodeRange constDecls | NodeRange varDecls | NodeRange procedures | NodeIndex statement",
+    "ConstDecl : SymbolId name | int value",
+    "VarDecl   : SymbolId name",
+    "Procedure : SymbolId name | NodeIndex block",
+    "Statement : NodeIndex statement",
+    "Assignment: SymbolId name | NodeIndex expression",
+    "Call      : SymbolId name",
+    "Begin     : NodeIndex statement | NodeRange statements",
+    "If        : NodeIndex condition | NodeIndex statement",
+    "While     : NodeIndex condition | NodeIndex statement",
+    "Condition : TOKEN op | NodeIndex left | NodeIndex right",
+    "OddCondition: NodeIndex expression",
+    "Comparison: TOKEN op | NodeIndex left | NodeIndex right",
+    "Expression: TOKEN op | NodeIndex left | ExprRange right",
+    "Term      : TOKEN op | NodeIndex left | ExprRange right",
+    "Binary    : TOKEN op | NodeIndex left | NodeIndex right",
+    "Unary     : TOKEN op | NodeIndex right",
+    "Factor    : TOKEN op | NodeIndex right",
+    "Primary   : SymbolId name",
+    "Literal   : std::int32_t value",
+    "Program   : NodeIndex block",
 ]
 
 
+COLUMNS = 80
+
+
+def wrap(prefix, items, suffix, indent):
+    """Fills lines of at most COLUMNS with items separated by spaces, the
+    first starting with prefix and the rest indented, the way clang-format
+    lays out argument lists."""
+    lines = [prefix + items[0]]
+    for item in items[1:]:
+        if len(lines[-1]) + 1 + len(item) <= COLUMNS:
+            lines[-1] += " " + item
+        else:
+            lines.append(" " * indent + item)
+    if len(lines[-1]) + len(suffix) <= COLUMNS:
+        lines[-1] += suffix
+    else:
+        lines.append(" " * indent + suffix.lstrip())
+    return lines
+
+
+def constructor(name, params, inits):
+    one_line = f"  {name}({', '.join(params)}) : {', '.join(inits)} {{}}"
+    if len(one_line) <= COLUMNS:
+        return one_line + "\n"
+    lines = wrap(f"  {name}(", [p + "," for p in params[:-1]] + [params[-1]],
+                 ")", len(name) + 3)
+    lines += wrap("      : ", [i + "," for i in inits[:-1]] + [inits[-1]],
+                  " {}", 8)
+    return "\n".join(lines) + "\n"
+
+
 def generate_header(nodes):
     header = """
 #pragma once
 
-#include <memory>
-#include <string>
-#include <vector>
-#include <variant>
+#include "interner.hpp"
+#include "source_loc.hpp"
 #include "token_type.hpp"
+#include <cstdint>
+#include <type_traits>
+#include <variant>
 
 namespace plzerow {
 
-class ASTNode;
+// Nodes live in an Ast node table and refer to each other by index. Every
+// node is trivially destructible, so dropping the table frees the whole tree
+// without visiting it.
+using NodeIndex = std::uint32_t;
+constexpr NodeIndex no_node = ~NodeIndex{0};
 
-using ExprContainer = std::vector<std::pair<TOKEN, std::unique_ptr<ASTNode>>>;
-using NodeContainer = std::vector<std::unique_ptr<ASTNode>>;
+// contiguous runs in the Ast child and operand pools
+struct NodeRange {
+  std::uint32_t first;
+  std::uint32_t count;
+};
+using ExprRange = NodeRange;
 
-"""
+struct Operand {
+  TOKEN op;
+  NodeIndex node;
+};
 
-    def needs_move(type):
-        for t in ("std::unique_ptr", "NodeContainer", "ExprContainer"):
-            if t in type:
-                return True
-        return False
+"""
 
     node_classes = []
     for node in nodes:
@@ -67,64 +107,42 @@ using NodeContainer = std::vector<std::unique_ptr<ASTNode>>;
 
         header += f"struct {struct_name} {{\n"
 
-        header += "    " + struct_name + "("
-        header += ", ".join(
-            [f"{f.rsplit(' ', 1)[0]} {f.rsplit(' ', 1)[1]}" for f in fields]
-        )
-        header += ") : "
-        header += ", ".join(
-            [
-                f"_{f.rsplit(' ', 1)[1]}(std::move({f.rsplit(' ', 1)[1]}))"
-                if needs_move(f.rsplit(" ", 1)[0])
-                else f"_{f.rsplit(' ', 1)[1]}({f.rsplit(' ', 1)[1]})"
-                for f in fields
-            ]
-        )
-        header += " {}\n"
-
-        header += f"    {struct_name}({struct_name}&&) = default;\n"
-        header += f"    {struct_name}& operator=({struct_name}&&) = default;\n"
+        names = [f.rsplit(" ", 1)[1] for f in fields]
+        inits = [f"_{name}({name})" for name in names]
+        header += constructor(struct_name, fields, inits)
 
         for field in fields:
             try:
                 ftype, fname = field.rsplit(" ", 1)
-                header += f"    {ftype} _{fname};\n"
+                header += f"  {ftype} _{fname};\n"
             except ValueError:
                 print(f"Error parsing field '{field}' in class '{struct_name}'")
 
         header += "};\n\n"
 
-    header += """
-class ASTNode {
+    header += """class ASTNode {
 public:
-    template <typename T>
-    ASTNode(std::size_t linum, std::size_t column, T &&value);
-    template <typename Visitor> auto accept(Visitor &&visitor) const;
+  template <typename T> ASTNode(SourceLoc loc, T &&value);
+  template <typename Visitor> auto accept(Visitor &&visitor) const;
 
-    std::size_t _linum;
-    std::size_t _column;
-    std::variant<
+  SourceLoc _loc;
 """
-    header += ",\n        ".join(f"{class_name}" for class_name in node_classes)
+    header += "\n".join(
+        wrap("  std::variant<", [f"{name}," for name in node_classes[:-1]]
+             + [f"{node_classes[-1]}>"], "", 15)
+    )
     header += """
-    > _value;
+      _value;
 };
 
+static_assert(std::is_trivially_destructible_v<ASTNode>);
+
 template <typename T>
-ASTNode::ASTNode(std::size_t linum,
-                 std::size_t column, T &&value)
-     :_linum(linum), _column(column),
-      _value(std::move(value)) {}
+ASTNode::ASTNode(SourceLoc loc, T &&value)
+    : _loc(loc), _value(std::forward<T>(value)) {}
 
 template <typename Visitor> auto ASTNode::accept(Visitor &&visitor) const {
-    return std::visit(std::forward<Visitor>(visitor), _value);
-}
-
-template <typename T, typename... Args>
-std::unique_ptr<ASTNode> make_ast_node(std::size_t linum,
-                                       std::size_t column, Args &&...args) {
-  return std::make_unique<ASTNode>(linum, column,
-                                   T{std::forward<Args>(args)...});
+  return std::visit(std::forward<Visitor>(visitor), _value);
 }
 
 } // namespace plzerow